@@ -84,6 +84,8 @@ const PackageSchema = new mongoose.Schema({
         count: { type: Number, default: 0 }
     }],
     lastDownloadedAt: { type: Date },
+    // Downloads and ratings change without a publish, so they keep their own stamp
+    statsUpdatedAt: { type: Date, default: Date.now },
 
     // Timestamps
     createdAt: { type: Date, default: Date.now },
@@ -92,12 +94,15 @@ const PackageSchema = new mongoose.Schema({
 });
 
 // Indexes
-PackageSchema.index({ downloads: -1 });
+PackageSchema.index({ downloads: -1, _id: -1 }); // Listing sorts, _id breaks ties for cursors
 PackageSchema.index({ weeklyDownloads: -1 });
-PackageSchema.index({ averageRating: -1 });
-PackageSchema.index({ createdAt: -1 });
+PackageSchema.index({ averageRating: -1, _id: -1 });
+PackageSchema.index({ createdAt: -1, _id: -1 });
+PackageSchema.index({ updatedAt: 1, _id: 1 }); // Delta listings (?since=) and sort=updated
+PackageSchema.index({ statsUpdatedAt: 1 }); // Delta listings: counts and ratings changed since
 PackageSchema.index({ category: 1 });
 PackageSchema.index({ tags: 1 });
+PackageSchema.index({ 'runtime.type': 1 });
 PackageSchema.index({ keywords: 1 });
 PackageSchema.index({ deprecated: 1 });
 
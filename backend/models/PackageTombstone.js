@@ -0,0 +1,20 @@
+const mongoose = require('mongoose');
+
+// Kept for deleted packages so delta syncs (?since=) can tell clients to drop them
+const TOMBSTONE_RETENTION_DAYS = 90;
+
+const PackageTombstoneSchema = new mongoose.Schema({
+    id: { type: String, required: true, unique: true }, // ID of the deleted package
+    deletedAt: { type: Date, default: Date.now }
+});
+
+// Expire old tombstones; clients older than this must fetch the full list
+PackageTombstoneSchema.index(
+    { deletedAt: 1 },
+    { expireAfterSeconds: TOMBSTONE_RETENTION_DAYS * 24 * 60 * 60 }
+);
+
+const PackageTombstone = mongoose.model('PackageTombstone', PackageTombstoneSchema);
+PackageTombstone.RETENTION_DAYS = TOMBSTONE_RETENTION_DAYS;
+
+module.exports = PackageTombstone;
@@ -1,10 +1,15 @@
 const express = require('express');
+const mongoose = require('mongoose');
 const router = express.Router();
 const Package = require('../models/Package');
 const PackageVersion = require('../models/PackageVersion');
+const PackageTombstone = require('../models/PackageTombstone');
 const Review = require('../models/Review');
 const User = require('../models/User');
 const jwt = require('jsonwebtoken');
+const zlib = require('zlib');
+const crypto = require('crypto');
+const { promisify } = require('util');
 
 const SECRET = process.env.JWT_SECRET || 'nex-secret-key-change-me';
 
@@ -39,18 +44,137 @@ const adminAuth = (req, res, next) => {
     }
 };
 
+// ============ COMPRESSION ============
+
+// Encodings we can produce, in order of preference (zstd needs Node 22.15+)
+const encoders = [
+    zlib.zstdCompress && {
+        name: 'zstd',
+        compress: promisify(zlib.zstdCompress)
+    },
+    {
+        name: 'br',
+        compress: (body) => promisify(zlib.brotliCompress)(body, {
+            params: {
+                [zlib.constants.BROTLI_PARAM_MODE]: zlib.constants.BROTLI_MODE_TEXT,
+                [zlib.constants.BROTLI_PARAM_QUALITY]: 5,
+                [zlib.constants.BROTLI_PARAM_SIZE_HINT]: body.length
+            }
+        })
+    },
+    {
+        name: 'gzip',
+        compress: promisify(zlib.gzip)
+    }
+].filter(Boolean);
+
+// Bodies smaller than this are not worth compressing
+const MIN_COMPRESS_BYTES = 1024;
+
+// Pick the best encoding the client accepts (q > 0)
+const negotiateEncoding = (req) => {
+    const header = req.get('Accept-Encoding') || '';
+    const accepted = new Set();
+
+    for (const part of header.split(',')) {
+        const [name, ...params] = part.trim().toLowerCase().split(';');
+        const q = params.find(p => p.trim().startsWith('q='));
+        if (name && (!q || parseFloat(q.trim().slice(2)) > 0)) accepted.add(name);
+    }
+
+    return encoders.find(e => accepted.has(e.name) || accepted.has('*'));
+};
+
+// Send a JSON payload, compressed when the client supports it
+const sendJson = async (req, res, payload) => {
+    const body = Buffer.from(JSON.stringify(payload));
+    res.type('application/json');
+    res.vary('Accept-Encoding');
+
+    const encoder = body.length >= MIN_COMPRESS_BYTES ? negotiateEncoding(req) : null;
+    if (!encoder) return res.send(body);
+
+    res.set('Content-Encoding', encoder.name);
+    res.send(await encoder.compress(body));
+};
+
 // ============ PACKAGE LISTING ============
 
-// GET /api/packages - List all packages
+// GET /api/packages?since=<timestamp> - Packages changed and deleted since a previous listing
+const listChanges = async (req, res) => {
+    const since = new Date(req.query.since);
+    if (isNaN(since.getTime())) {
+        return res.status(400).json({ msg: 'since must be an ISO 8601 timestamp' });
+    }
+
+    // Tombstones expire, so very old clients have to start over
+    const horizon = new Date();
+    horizon.setDate(horizon.getDate() - PackageTombstone.RETENTION_DAYS);
+    if (since < horizon) {
+        return res.status(410).json({ msg: 'since is too old, fetch the full list' });
+    }
+
+    // Taken before querying so a change made meanwhile shows up in the next delta
+    const timestamp = new Date().toISOString();
+
+    // A download or rating counts as a change too, or clients would keep stale numbers
+    const [packages, tombstones] = await Promise.all([
+        Package.find(
+            { $or: [{ updatedAt: { $gte: since } }, { statsUpdatedAt: { $gte: since } }] },
+            '-__v -manifest -downloadHistory'
+        ),
+        PackageTombstone.find({ deletedAt: { $gte: since } }, 'id')
+    ]);
+
+    await sendJson(req, res, {
+        timestamp,
+        since: since.toISOString(),
+        count: packages.length,
+        packages: packages,
+        deleted: tombstones.map(t => t.id)
+    });
+};
+
+// Sort orders of GET /api/packages. _id breaks ties, so a cursor names an exact position
+const LISTING_SORTS = {
+    created: { field: 'createdAt', order: -1 },
+    downloads: { field: 'downloads', order: -1 },
+    rating: { field: 'averageRating', order: -1 },
+    updated: { field: 'updatedAt', order: -1 },
+    name: { field: 'name', order: 1 }
+};
+const DATE_FIELDS = ['createdAt', 'updatedAt'];
+
+// Opaque cursor: the sort key and _id of the last package on a page
+const encodeCursor = (pkg, sort) =>
+    Buffer.from(JSON.stringify([pkg[sort.field], String(pkg._id)])).toString('base64url');
+
+const decodeCursor = (cursor, sort) => {
+    try {
+        const [value, id] = JSON.parse(Buffer.from(cursor, 'base64url').toString());
+        if (!mongoose.Types.ObjectId.isValid(id)) return null;
+        return {
+            value: DATE_FIELDS.includes(sort.field) ? new Date(value) : value,
+            id: new mongoose.Types.ObjectId(id)
+        };
+    } catch (err) {
+        return null;
+    }
+};
+
+// GET /api/packages - List packages, a page at a time when asked for a cursor
 router.get('/', async (req, res) => {
     try {
-        const { category, tag, deprecated, search, sort, limit = 50 } = req.query;
+        if (req.query.since) return await listChanges(req, res);
+
+        const { category, tag, runtime, deprecated, search, sort, cursor, limit = 50 } = req.query;
 
         let query = {};
 
         // Filters
         if (category) query.category = category;
         if (tag) query.tags = tag;
+        if (runtime) query['runtime.type'] = runtime;
         if (deprecated === 'true') query.deprecated = true;
         else if (deprecated === 'false') query.deprecated = { $ne: true };
 
@@ -59,21 +183,121 @@ router.get('/', async (req, res) => {
             query.$text = { $search: search };
         }
 
-        // Sort options
-        let sortOption = { createdAt: -1 };
-        if (sort === 'downloads') sortOption = { downloads: -1 };
-        else if (sort === 'rating') sortOption = { averageRating: -1 };
-        else if (sort === 'updated') sortOption = { updatedAt: -1 };
-        else if (sort === 'name') sortOption = { name: 1 };
+        const sortBy = LISTING_SORTS[sort] || LISTING_SORTS.created;
+        const sortOption = { [sortBy.field]: sortBy.order, _id: sortBy.order };
+
+        // Resume strictly after the cursor's position in that order
+        if (cursor) {
+            const after = decodeCursor(cursor, sortBy);
+            if (!after) {
+                return res.status(400).json({ msg: 'Invalid cursor' });
+            }
+            const op = sortBy.order < 0 ? '$lt' : '$gt';
+            query.$or = [
+                { [sortBy.field]: { [op]: after.value } },
+                { [sortBy.field]: after.value, _id: { [op]: after.id } }
+            ];
+        }
 
+        // One extra row tells whether another page follows
+        const pageSize = Math.max(parseInt(limit) || 50, 1);
         const packages = await Package.find(query, '-__v -manifest -downloadHistory')
             .sort(sortOption)
-            .limit(parseInt(limit));
+            .limit(pageSize + 1);
 
-        res.json({
+        const more = packages.length > pageSize;
+        if (more) packages.pop();
+
+        const body = {
             timestamp: new Date().toISOString(),
             count: packages.length,
             packages: packages
+        };
+        if (more) body.nextCursor = encodeCursor(packages[packages.length - 1], sortBy);
+
+        await sendJson(req, res, body);
+    } catch (err) {
+        console.error(err);
+        res.status(500).send('Server Error');
+    }
+});
+
+// ============ INDEX SHARDS ============
+
+// The index split by a hash of each package's name (its id after the dot),
+// so a client resolving one name downloads one shard instead of every
+// package. The CLI computes the same hash (cli/src/package/shard.c).
+const SHARD_COUNT = 64;
+const SHARD_TABLE_TTL_MS = 60 * 1000;
+
+// FNV-1a over the ASCII-lowercased bytes of the name
+const shardOf = (id) => {
+    let hash = 0x811c9dc5;
+    for (const byte of Buffer.from(id.slice(id.indexOf('.') + 1))) {
+        hash ^= byte >= 0x41 && byte <= 0x5a ? byte + 32 : byte;
+        hash = Math.imul(hash, 0x01000193) >>> 0;
+    }
+    return hash % SHARD_COUNT;
+};
+
+// Ids per shard and a version that changes with any of them, rebuilt once a minute
+let shardTable = null;
+
+const loadShardTable = () => {
+    if (shardTable && Date.now() - shardTable.builtAt < SHARD_TABLE_TTL_MS) return shardTable.ready;
+
+    const ready = Package.find({}, 'id updatedAt').sort({ id: 1 }).lean().then(rows => {
+        const ids = Array.from({ length: SHARD_COUNT }, () => []);
+        const hashes = ids.map(() => crypto.createHash('sha1'));
+        for (const row of rows) {
+            const shard = shardOf(row.id);
+            ids[shard].push(row.id);
+            hashes[shard].update(`${row.id} ${new Date(row.updatedAt).getTime()}\n`);
+        }
+        return {
+            timestamp: new Date().toISOString(),
+            ids,
+            versions: hashes.map(h => h.digest('hex').slice(0, 16))
+        };
+    });
+    shardTable = { builtAt: Date.now(), ready };
+    ready.catch(() => { shardTable = null; });
+    return ready;
+};
+
+// GET /api/packages/shards - Shard count, and the size and version of each shard
+router.get('/shards', async (req, res) => {
+    try {
+        const table = await loadShardTable();
+        await sendJson(req, res, {
+            timestamp: table.timestamp,
+            count: SHARD_COUNT,
+            shards: table.ids.map((ids, i) => ({ count: ids.length, version: table.versions[i] }))
+        });
+    } catch (err) {
+        console.error(err);
+        res.status(500).send('Server Error');
+    }
+});
+
+// GET /api/packages/shards/:shard - The packages of one shard, as in the full listing
+router.get('/shards/:shard', async (req, res) => {
+    try {
+        const shard = Number(req.params.shard);
+        if (!Number.isInteger(shard) || shard < 0 || shard >= SHARD_COUNT) {
+            return res.status(404).json({ msg: 'No such shard' });
+        }
+
+        const table = await loadShardTable();
+        const packages = await Package.find({ id: { $in: table.ids[shard] } },
+            '-__v -manifest -downloadHistory');
+
+        await sendJson(req, res, {
+            timestamp: table.timestamp,
+            shard,
+            version: table.versions[shard],
+            count: packages.length,
+            packages
         });
     } catch (err) {
         console.error(err);
@@ -360,6 +584,7 @@ router.post('/:id/deprecate', adminAuth, async (req, res) => {
         pkg.deprecationMessage = message || 'This package has been deprecated';
         pkg.deprecatedAt = Date.now();
         if (replacementPackage) pkg.replacementPackage = replacementPackage;
+        pkg.updatedAt = Date.now();
 
         await pkg.save();
         res.json({ msg: 'Package deprecated', package: pkg.id });
@@ -378,6 +603,7 @@ router.post('/:id/undeprecate', adminAuth, async (req, res) => {
         pkg.deprecationMessage = undefined;
         pkg.deprecatedAt = undefined;
         pkg.replacementPackage = undefined;
+        pkg.updatedAt = Date.now();
 
         await pkg.save();
         res.json({ msg: 'Deprecation removed', package: pkg.id });
@@ -504,6 +730,9 @@ router.post('/', adminAuth, async (req, res) => {
 
         await pkg.save();
 
+        // A republished id is live again
+        await PackageTombstone.deleteOne({ id: manifest.id });
+
         // Save version history
         const versionEntry = new PackageVersion({
             packageId: manifest.id,
@@ -560,6 +789,13 @@ router.delete('/:id', adminAuth, async (req, res) => {
         // Delete package
         await pkg.deleteOne();
 
+        // Leave a tombstone for delta syncs
+        await PackageTombstone.updateOne(
+            { id: req.params.id },
+            { deletedAt: Date.now() },
+            { upsert: true }
+        );
+
         res.json({ msg: 'Package and all versions removed' });
     } catch (err) {
         console.error(err.message);
@@ -602,6 +838,7 @@ async function trackDownload(pkg) {
         .filter(h => h.date >= monthAgo)
         .reduce((sum, h) => sum + h.count, 0);
 
+    pkg.statsUpdatedAt = new Date();
     await pkg.save();
 }
 
@@ -634,6 +871,7 @@ async function updatePackageRating(packageId, newRating, oldRating = null) {
         pkg.averageRating = 0;
     }
 
+    pkg.statsUpdatedAt = new Date();
     await pkg.save();
 }
 
@@ -0,0 +1,60 @@
+#!/bin/bash
+# Shared helpers for the nex benchmark scripts
+
+GREEN='\033[0;32m'
+RED='\033[0;31m'
+YELLOW='\033[1;33m'
+BLUE='\033[0;34m'
+NC='\033[0m' # No Color
+
+BENCH_DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" &> /dev/null && pwd )"
+STUB_PORT="${STUB_PORT:-8765}"
+STUB_PID=""
+
+# Locate the nex binary (override with NEX=/path/to/nex)
+find_nex() {
+    if [ -n "$NEX" ]; then
+        return
+    elif [ -f "$BENCH_DIR/../build/nex" ]; then
+        NEX="$BENCH_DIR/../build/nex"
+    else
+        echo -e "${RED}Error: 'nex' binary not found.${NC}"
+        echo "Please build the project first (cd build && cmake --build .)"
+        exit 1
+    fi
+    NEX="$(realpath "$NEX")"
+}
+
+# Run nex against the stub with a throwaway home directory
+use_sandbox_home() {
+    export HOME="$(mktemp -d /tmp/nex_bench_XXXXXX)"
+    export NEX_REGISTRY_URL="http://127.0.0.1:$STUB_PORT/api"
+    mkdir -p "$HOME/.nex"
+}
+
+start_stub() {
+    python3 "$BENCH_DIR/registry_stub.py" --port "$STUB_PORT" "$@" > /dev/null &
+    STUB_PID=$!
+    for _ in $(seq 1 100); do
+        curl -s "http://127.0.0.1:$STUB_PORT/__stats" > /dev/null && return
+        sleep 0.1
+    done
+    echo -e "${RED}Error: registry stub did not start${NC}"
+    exit 1
+}
+
+stop_stub() {
+    if [ -n "$STUB_PID" ]; then
+        kill "$STUB_PID" 2> /dev/null
+        wait "$STUB_PID" 2> /dev/null
+        STUB_PID=""
+    fi
+}
+
+# Print one field of the stub's /__stats counters
+stub_stat() {
+    curl -s "http://127.0.0.1:$STUB_PORT/__stats" |
+        python3 -c "import json, sys; print(json.load(sys.stdin)['$1'])"
+}
+
+trap stop_stub EXIT
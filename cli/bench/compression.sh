@@ -0,0 +1,34 @@
+#!/bin/bash
+# Compare bytes on the wire for the registry index with and without
+# response compression, using the local registry stub.
+#
+#   ./compression.sh [package-count]
+
+source "$(dirname "${BASH_SOURCE[0]}")/common.sh"
+
+PACKAGES="${1:-20000}"
+find_nex
+use_sandbox_home
+
+# Keep the HTTP cache out of the measurement
+"$NEX" config http_cache_max_size 0 > /dev/null
+
+measure() {
+    start_stub --packages "$PACKAGES" "$@"
+    "$NEX" search tool-1 > /dev/null
+    BYTES=$(stub_stat bytes_sent)
+    stop_stub
+}
+
+echo -e "${YELLOW}Registry index transfer size ($PACKAGES packages)${NC}"
+
+measure --identity
+BEFORE=$BYTES
+echo -e "  identity     ${BLUE}$BEFORE${NC} bytes"
+
+measure
+AFTER=$BYTES
+echo -e "  compressed   ${BLUE}$AFTER${NC} bytes"
+
+python3 -c "print('  saved        %.1f%%' % (100.0 * (1 - $AFTER / $BEFORE)))"
+rm -rf "$HOME"
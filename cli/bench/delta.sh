@@ -0,0 +1,65 @@
+#!/bin/bash
+# Sync the local registry index after a few packages change and a few
+# more are downloaded, once with delta listings (?since=) and once against
+# a registry that ignores them, and check the merged index matches the
+# registry exactly, download counts included.
+#
+#   ./delta.sh [package-count]
+
+source "$(dirname "${BASH_SOURCE[0]}")/common.sh"
+
+PACKAGES="${1:-100000}"
+find_nex
+
+now_ms() {
+    date +%s%3N
+}
+
+STUB_URL="http://127.0.0.1:$STUB_PORT"
+
+# Fetch the index, change the registry, then let a lookup of a newly
+# published package force a sync
+measure() {
+    use_sandbox_home
+    "$NEX" config http_cache_max_size 0 > /dev/null
+    # The new package must trigger a sync, not be ruled out by the fresh index
+    "$NEX" config not_found_ttl 0 > /dev/null
+    start_stub --packages "$PACKAGES" "$@"
+
+    "$NEX" search tool-1 > /dev/null
+    local before=$(stub_stat bytes_sent)
+
+    local added=$(curl -s "$STUB_URL/__churn?add=3&update=5&delete=2&stats=20" |
+        python3 -c "import json, sys; print(json.load(sys.stdin)['added'][0].split('.')[1])")
+
+    local start=$(now_ms)
+    "$NEX" info "$added" > /dev/null
+    local end=$(now_ms)
+    SYNC_BYTES=$(( $(stub_stat bytes_sent) - before ))
+    SYNC_MS=$(( end - start ))
+
+    if curl -s "$STUB_URL/api/packages?limit=$(( PACKAGES * 2 ))" | python3 -c "
+import json, sys
+remote = json.load(sys.stdin)['packages']
+local = json.load(open('$HOME/.nex/index.json'))['packages']
+key = lambda packages: sorted((p['id'], p['version'], p['downloads']) for p in packages)
+sys.exit(key(remote) != key(local))"; then
+        SYNC_OK="${GREEN}✓${NC} matches registry"
+    else
+        SYNC_OK="${RED}✗${NC} differs from registry"
+    fi
+
+    stop_stub
+    rm -rf "$HOME"
+}
+
+echo -e "${YELLOW}Index sync after 3 new, 5 updated, 2 deleted and 20 downloaded packages ($PACKAGES packages)${NC}"
+
+measure --no-delta
+echo -e "  full list    ${BLUE}$SYNC_BYTES${NC} bytes  ${BLUE}$SYNC_MS${NC} ms  $SYNC_OK"
+FULL=$SYNC_BYTES
+
+measure
+echo -e "  delta        ${BLUE}$SYNC_BYTES${NC} bytes  ${BLUE}$SYNC_MS${NC} ms  $SYNC_OK"
+
+python3 -c "print('  saved        %.2f%% of sync traffic' % (100.0 * (1 - $SYNC_BYTES / $FULL)))"
@@ -0,0 +1,73 @@
+#!/bin/bash
+# Check resumable downloads (the way `nex self-update` fetches a release)
+# against the stub's artifact: an interrupted transfer resumes, and a
+# .part left over from an older build is replaced, never finished with
+# bytes of the new one.
+#
+#   cmake --build build --target download_check && ./download.sh
+
+source "$(dirname "${BASH_SOURCE[0]}")/common.sh"
+
+find_nex
+DOWNLOAD_CHECK="${DOWNLOAD_CHECK:-$(dirname "$NEX")/download_check}"
+if [ ! -x "$DOWNLOAD_CHECK" ]; then
+    echo -e "${RED}Error: 'download_check' not found.${NC}"
+    echo "Build it first (cmake --build build --target download_check)"
+    exit 1
+fi
+
+use_sandbox_home
+start_stub --packages 10
+
+URL="http://127.0.0.1:$STUB_PORT/download/nex"
+TARGET="$HOME/nex.bin"
+FAILED=0
+
+publish() {
+    curl -s "http://127.0.0.1:$STUB_PORT/__artifact?build=$1&size=$2&cut=${3:-0}" > /dev/null
+}
+
+# Leave a .part of the first $2 bytes of build $1, as an interrupted run would
+leave_part() {
+    publish "$1" "$3"
+    curl -s "$URL" -o "$HOME/build.bin"
+    head -c "$2" "$HOME/build.bin" > "$TARGET.part"
+    printf '{"url":"%s","etag":"\\"build-%d\\""}' "$URL" "$1" > "$TARGET.part.json"
+}
+
+check() {
+    local name="$1"
+    local status=$("$DOWNLOAD_CHECK" "$URL" "$TARGET" 2> /dev/null | tail -n 1)
+    curl -s "$URL" -o "$HOME/expected.bin"
+    if [ "$status" = "200" ] && cmp -s "$TARGET" "$HOME/expected.bin" &&
+       [ ! -e "$TARGET.part" ] && [ ! -e "$TARGET.part.json" ]; then
+        echo -e "  ${GREEN}✓${NC} $name"
+    else
+        echo -e "  ${RED}✗${NC} $name (status $status)"
+        FAILED=1
+    fi
+    rm -f "$TARGET" "$TARGET.part" "$TARGET.part.json"
+}
+
+echo -e "${YELLOW}Resumable downloads${NC}"
+
+publish 1 200000 70000
+check "transfer cut short is resumed"
+
+leave_part 1 70000 200000
+check ".part of the same build is continued (206)"
+
+leave_part 1 70000 200000
+publish 2 150000
+check ".part of an older build is replaced (200)"
+
+leave_part 1 70000 200000
+publish 2 70000
+check "new build as large as the stale .part is still fetched"
+
+leave_part 1 200000 200000
+check "complete .part the server cannot continue (416) starts over"
+
+stop_stub
+rm -rf "$HOME"
+exit $FAILED
@@ -0,0 +1,30 @@
+/*
+ * Driver for resumable downloads (http_download_resumable in
+ * src/http/client.c), used by download.sh against registry_stub.py
+ *
+ * Downloads url to path the way `nex self-update` fetches a release,
+ * picking up any <path>.part left behind, and prints the status it got.
+ *
+ *   cmake --build build --target download_check
+ *   ./build/download_check http://127.0.0.1:8765/download/nex /tmp/nex.bin
+ */
+
+#include "nex.h"
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <url> <path>\n", argv[0]);
+        return 2;
+    }
+    
+    if (http_init() != 0) {
+        fprintf(stderr, "Failed to initialize HTTP client\n");
+        return 2;
+    }
+    
+    long status = http_download_resumable(argv[1], argv[2]);
+    printf("%ld\n", status);
+    
+    http_cleanup();
+    return status == 200 ? 0 : 1;
+}
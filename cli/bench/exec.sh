@@ -0,0 +1,73 @@
+#!/bin/bash
+# Per-run overhead of `nex run`: a linked package whose command does
+# nothing is run many times and compared with running the command
+# itself. A command plain enough to exec directly is timed against one
+# that needs /bin/sh, and against a bash package, whose runtime is looked
+# up on PATH first. Set BASELINE=/path/to/nex to add another build.
+#
+#   ./exec.sh [runs]
+
+source "$(dirname "${BASH_SOURCE[0]}")/common.sh"
+
+RUNS="${1:-500}"
+find_nex
+
+use_sandbox_home
+PACKAGE_DIR="$HOME/bench-tool"
+mkdir -p "$PACKAGE_DIR"
+cat > "$PACKAGE_DIR/nex.json" << 'JSON'
+{
+  "id": "bench.exec-tool",
+  "name": "Exec bench",
+  "version": "1.0.0",
+  "repository": "https://example.com/bench/exec-tool",
+  "runtime": { "type": "binary" },
+  "commands": {
+    "default": "true --flag",
+    "shell": "true --flag; true"
+  }
+}
+JSON
+(cd "$PACKAGE_DIR" && "$NEX" link > /dev/null)
+
+mkdir -p "$PACKAGE_DIR-bash"
+sed -e 's/exec-tool/exec-bash/' -e 's/"binary"/"bash"/' "$PACKAGE_DIR/nex.json" > "$PACKAGE_DIR-bash/nex.json"
+(cd "$PACKAGE_DIR-bash" && "$NEX" link > /dev/null)
+
+# Microseconds per run of "$@": the fastest of five batches, so a noisy
+# moment on the machine does not decide the result
+per_run_us() {
+    local batch=$(( (RUNS + 4) / 5 ))
+    local best=""
+    for _ in 1 2 3 4 5; do
+        local start=$(date +%s%N)
+        for _ in $(seq 1 "$batch"); do
+            "$@" > /dev/null
+        done
+        local end=$(date +%s%N)
+        local us=$(( (end - start) / batch / 1000 ))
+        if [ -z "$best" ] || [ "$us" -lt "$best" ]; then
+            best=$us
+        fi
+    done
+    echo "$best"
+}
+
+report() {
+    printf "  %-26s ${BLUE}%6s${NC} us/run\n" "$1" "$2"
+}
+
+echo -e "${YELLOW}Per-run overhead of 'nex run' ($RUNS runs)${NC}"
+BARE=$(per_run_us "$(type -P true)" --flag)
+report "command alone" "$BARE"
+DIRECT=$(per_run_us "$NEX" run exec-tool)
+report "nex run (direct exec)" "$DIRECT"
+report "nex run (needs sh)" "$(per_run_us "$NEX" run exec-tool shell)"
+report "nex run (bash runtime)" "$(per_run_us "$NEX" run exec-bash)"
+if [ -n "$BASELINE" ]; then
+    report "baseline nex run" "$(per_run_us "$BASELINE" run exec-tool)"
+    report "baseline (bash runtime)" "$(per_run_us "$BASELINE" run exec-bash)"
+fi
+
+echo -e "  nex adds ${GREEN}$(( DIRECT - BARE ))${NC} us per run"
+rm -rf "$HOME"
@@ -0,0 +1,67 @@
+#!/bin/bash
+# Per-keystroke latency of `nex search -i`: types a few queries one key at
+# a time on a pseudo-terminal (so raw input and redrawing are included)
+# and reads the per-key times from --timings.
+#
+#   ./interactive.sh [package-count...]
+
+source "$(dirname "${BASH_SOURCE[0]}")/common.sh"
+
+SIZES="${*:-100000}"
+find_nex
+
+# Type each query (\b is backspace), one process per query, and summarize
+type_queries() {
+    python3 - "$NEX" "$@" <<'EOF'
+import os, pty, select, subprocess, sys, threading, time
+nex, queries = sys.argv[1], sys.argv[2:]
+times = []
+for query in queries:
+    master, slave = pty.openpty()
+    proc = subprocess.Popen([nex, "--timings", "search", "-i"], stdin=slave, stdout=slave,
+                            stderr=subprocess.PIPE, text=True)
+    os.close(slave)
+
+    def drain():
+        try:
+            while os.read(master, 65536):
+                pass
+        except OSError:
+            pass
+    threading.Thread(target=drain, daemon=True).start()
+
+    time.sleep(0.5)
+    for key in query.replace("\\b", "\x7f") + "\r":
+        os.write(master, key.encode())
+        time.sleep(0.02)
+    stderr = proc.communicate(timeout=30)[1]
+    os.close(master)
+    for line in stderr.splitlines():
+        fields = line.split()
+        if fields and fields[0] == "key":
+            times.append(float(fields[-2]))
+
+if not times:
+    print("-")
+    sys.exit()
+times.sort()
+pick = lambda q: times[min(len(times) - 1, int(q * len(times)))]
+fast = sum(1 for t in times if t < 5.0) * 100 // len(times)
+print("%d %.1f %.1f %.1f %d" % (len(times), pick(0.5), pick(0.95), times[-1], fast))
+EOF
+}
+
+QUERIES=("json parser" "image converter" "pdf" "toolbox\b\b\bx" "git hooks")
+
+echo -e "${YELLOW}Keystroke latency of 'nex search -i'${NC}"
+for size in $SIZES; do
+    start_stub --packages "$size"
+    use_sandbox_home
+    "$NEX" search json > /dev/null    # Download and compile the index first
+
+    read -r KEYS P50 P95 MAX FAST <<< "$(type_queries "${QUERIES[@]}")"
+    rm -rf "$HOME"
+    stop_stub
+    printf "  %7d packages   %3s keys   p50 ${BLUE}%5s${NC} ms   p95 ${BLUE}%5s${NC} ms   max ${BLUE}%5s${NC} ms   ${GREEN}%3s%%${NC} under 5 ms\n" \
+        "$size" "$KEYS" "$P50" "$P95" "$MAX" "$FAST"
+done
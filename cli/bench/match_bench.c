@@ -0,0 +1,160 @@
+/*
+ * Microbenchmark for the search matcher (src/utils/match.c)
+ *
+ * Builds a synthetic index of a million packages in memory, laid out
+ * like the string pool of ~/.nex/index.bin (each package's id, name,
+ * description and keywords back to back, NUL-terminated), and times a
+ * full scan per query:
+ *
+ *   copy     the old matcher: lowercase a copy of each field, then strstr
+ *   field    match_contains() on each field
+ *   pool     match_find() over the whole pool, hits mapped to packages
+ *
+ * The field and pool scans run with every implementation the CPU has.
+ *
+ *   cmake --build build --target match_bench && ./build/match_bench [count]
+ */
+
+#include "nex.h"
+#include <ctype.h>
+#include <time.h>
+
+#define FIELDS 4
+#define ROUNDS 5
+
+static const char *words[] = {
+    "fast", "json", "yaml", "image", "video", "audio", "text", "pdf", "csv", "http",
+    "api", "git", "docker", "cloud", "lint", "format", "test", "build", "deploy",
+    "scrape", "crawl", "convert", "resize", "compress", "encrypt", "hash", "parse",
+    "render", "serve", "sync", "backup", "monitor", "log"
+};
+#define WORD_COUNT (sizeof(words) / sizeof(words[0]))
+
+typedef struct {
+    char *pool;
+    size_t size;
+    size_t *starts;     /* Offset of each package's first field, plus the end */
+    int count;
+} Pool;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/* The old matcher: lowercase a copy of the field, then strstr */
+static int copy_contains(const char *text, const char *needle_lower) {
+    char buffer[1024];
+    size_t i = 0;
+    for (; text[i] && i < sizeof(buffer) - 1; i++) {
+        buffer[i] = (char)tolower((unsigned char)text[i]);
+    }
+    buffer[i] = '\0';
+    return strstr(buffer, needle_lower) != NULL;
+}
+
+static int scan_fields(const Pool *p, const char *query, int copy) {
+    size_t len = strlen(query);
+    int found = 0;
+    for (int i = 0; i < p->count; i++) {
+        const char *field = p->pool + p->starts[i];
+        for (int f = 0; f < FIELDS; f++) {
+            if (copy ? copy_contains(field, query) : match_contains(field, query, len)) {
+                found++;
+                break;
+            }
+            field += strlen(field) + 1;
+        }
+    }
+    return found;
+}
+
+static int scan_pool(const Pool *p, const char *query) {
+    size_t len = strlen(query);
+    size_t pos = 0;
+    int found = 0;
+    int n = 0;
+    
+    while (pos < p->size) {
+        const char *hit = match_find(p->pool + pos, p->size - pos, query, len);
+        if (!hit) break;
+        
+        size_t offset = (size_t)(hit - p->pool);
+        while (p->starts[n + 1] <= offset) n++;
+        found++;
+        pos = p->starts[++n];
+    }
+    return found;
+}
+
+static void build_pool(Pool *p, int count) {
+    p->count = count;
+    p->size = 0;
+    p->pool = malloc((size_t)count * 160);
+    p->starts = malloc(((size_t)count + 1) * sizeof(size_t));
+    if (!p->pool || !p->starts) exit(1);
+    
+    unsigned int seed = 1;
+    for (int i = 0; i < count; i++) {
+        const char *w[6];
+        for (int j = 0; j < 6; j++) {
+            seed = seed * 1103515245u + 12345u;
+            w[j] = words[(seed >> 16) % WORD_COUNT];
+        }
+        
+        p->starts[i] = p->size;
+        char *out = p->pool + p->size;
+        int len = sprintf(out, "author%d.tool-%d", i % 997, i) + 1;
+        len += sprintf(out + len, "%c%s %s", toupper((unsigned char)w[0][0]), w[0] + 1, w[1]) + 1;
+        len += sprintf(out + len, "A %s tool to %s %s and %s files", w[2], w[3], w[4], w[5]) + 1;
+        len += sprintf(out + len, "%s\n%s\n%s", w[0], w[1], w[2]) + 1;
+        p->size += (size_t)len;
+    }
+    p->starts[count] = p->size;
+}
+
+int main(int argc, char *argv[]) {
+    int count = argc > 1 ? atoi(argv[1]) : 1000000;
+    if (count <= 0) count = 1000000;
+    
+    Pool pool;
+    build_pool(&pool, count);
+    
+    const char *queries[] = { "zzzz", "json", "tool-77777", "compress files", "a" };
+    const char *impls[] = { "scalar", "sse2", "avx2" };
+    
+    printf("%d packages, %.1f MB of searchable text, best of %d scans\n\n",
+           count, pool.size / 1048576.0, ROUNDS);
+    printf("%-16s %-6s %-8s %10s %10s %10s\n", "query", "mode", "matcher", "ms", "MB/s", "matches");
+    
+    for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+        int expected = -1;
+        
+        /* Row 0 is the copying baseline, then field and pool per implementation */
+        for (size_t row = 0; row < 1 + 2 * sizeof(impls) / sizeof(impls[0]); row++) {
+            const char *impl = row == 0 ? "copy" : impls[(row - 1) / 2];
+            int pool_mode = row > 0 && row % 2 == 0;
+            if (row > 0 && match_use(impl) != 0) continue;
+            
+            double best = 0;
+            int found = 0;
+            for (int r = 0; r < ROUNDS; r++) {
+                double start = now_ms();
+                found = pool_mode ? scan_pool(&pool, queries[q]) : scan_fields(&pool, queries[q], row == 0);
+                double elapsed = now_ms() - start;
+                if (r == 0 || elapsed < best) best = elapsed;
+            }
+            
+            if (expected < 0) expected = found;
+            printf("%-16s %-6s %-8s %10.1f %10.0f %10d%s\n", queries[q],
+                   row == 0 ? "copy" : pool_mode ? "pool" : "field", impl, best,
+                   pool.size / 1048576.0 / (best / 1000.0), found,
+                   found == expected ? "" : "  MISMATCH");
+        }
+    }
+    
+    free(pool.pool);
+    free(pool.starts);
+    return 0;
+}
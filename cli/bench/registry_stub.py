@@ -0,0 +1,453 @@
+#!/usr/bin/env python3
+"""
+Local stand-in for the nex registry API, used by the scripts in this folder.
+
+Serves a synthetic package index at /api/packages and per-package manifests
+at /api/packages/<letter>/<author>/<name>/nex.json, negotiates response
+compression like the real backend, and counts the bytes it puts on the wire
+so benchmarks can report transfer sizes. Fault injection (--delay-ms,
+--slow-every, --fail-first) makes it a slow or flaky server for the retry
+and hedging benchmarks. `?since=` delta listings work like the real
+backend; /__churn publishes, updates, deletes and downloads packages to
+give them something to report. Other listings come a page at a time (50 packages
+unless `limit` says otherwise) with a `nextCursor` for the next one, and
+`?search=` and `sort` narrow and order them, like the backend. /api/packages/shards lists
+the index shards and /api/packages/shards/<n> serves one of them.
+/download/nex is a release artifact that honours Range and If-Range like a
+CDN; /__artifact publishes a new build of it (and can cut the next
+response short) to exercise resumable downloads.
+
+    python3 registry_stub.py --port 8765 --packages 5000
+    python3 registry_stub.py --delay-ms 2000 --slow-every 4
+    NEX_REGISTRY_URL=http://127.0.0.1:8765/api nex search tool-42
+    curl http://127.0.0.1:8765/__stats
+    curl 'http://127.0.0.1:8765/__churn?add=3&update=2&delete=1&stats=5'
+    curl 'http://127.0.0.1:8765/__artifact?build=2&size=65536&cut=1000'
+"""
+
+import argparse
+import base64
+import gzip
+import hashlib
+import json
+import random
+import re
+import threading
+import time
+from datetime import datetime, timezone
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlsplit
+
+try:
+    import brotli
+except ImportError:
+    brotli = None
+
+try:
+    import zstandard
+except ImportError:
+    zstandard = None
+
+WORDS = ("fast json yaml image video audio text pdf csv http api git docker "
+         "cloud lint format test build deploy scrape crawl convert resize "
+         "compress encrypt hash parse render serve sync backup monitor log").split()
+CATEGORIES = ["cli", "utility", "development", "automation", "data", "web", "security", "other"]
+RUNTIMES = ["python", "node", "bash", "binary"]
+SORTS = {"created": ("createdAt", -1), "downloads": ("downloads", -1),
+         "rating": ("averageRating", -1), "updated": ("updatedAt", -1), "name": ("name", 1)}
+TIMESTAMP = re.compile(r"^\d{4}-\d\d-\d\dT\d\d:\d\d:\d\d(\.\d+)?Z$")
+SHARD_COUNT = 64
+
+
+def now_iso():
+    return datetime.now(timezone.utc).strftime("%Y-%m-%dT%H:%M:%S.%f")[:-3] + "Z"
+
+
+def shard_of(package_id):
+    """FNV-1a of the ASCII-lowercased id after the dot, as the backend computes it."""
+    h = 0x811C9DC5
+    for byte in package_id[package_id.find(".") + 1:].encode():
+        h = ((h ^ (byte + 32 if 0x41 <= byte <= 0x5A else byte)) * 0x01000193) & 0xFFFFFFFF
+    return h % SHARD_COUNT
+
+
+def make_package(i, rng):
+    author = "author%d" % (i % 997)
+    name = "tool-%d" % i
+    words = rng.sample(WORDS, 6)
+    return {
+        "id": "%s.%s" % (author, name),
+        "shortName": name,
+        "name": "%s %s" % (words[0].capitalize(), words[1]),
+        "version": "1.%d.%d" % (i % 10, i % 7),
+        "description": "A %s tool to %s %s and %s files" % tuple(words[2:6]),
+        "author": {"name": author},
+        "repository": "https://github.com/%s/%s" % (author, name),
+        "runtime": {"type": RUNTIMES[i % len(RUNTIMES)]},
+        "keywords": words[:3],
+        "category": CATEGORIES[i % len(CATEGORIES)],
+        "tags": words[3:5],
+        "deprecated": i % 50 == 0,
+        "downloads": rng.randint(0, 100000),
+        "averageRating": round(rng.uniform(0, 5), 1),
+        "updatedAt": "2025-01-01T00:00:00.000Z",
+    }
+
+
+class Registry:
+    def __init__(self, count, seed=1):
+        rng = random.Random(seed)
+        self.packages = [make_package(i, rng) for i in range(count)]
+        self.by_id = {p["id"]: p for p in self.packages}
+        self.deleted = {}
+        self.changed_at = now_iso()
+        self.next_index = count
+        self.rng = rng
+        self.lock = threading.Lock()
+        self.stats = {"requests": 0, "bytes_sent": 0, "not_modified": 0, "failed": 0}
+        self.shard_table = None
+        self.sorted = {}
+        self.arrivals = 0
+        self.artifact = (1, b"")
+        self.artifact_cut = 0
+        self.publish_artifact(1, 65536)
+        self.delay_ms = 0
+        self.slow_every = 0
+        self.fail_first = 0
+
+    def arrive(self):
+        """Number this request; returns (delay in seconds, whether to fail it)."""
+        with self.lock:
+            self.arrivals += 1
+            n = self.arrivals
+        fail = n <= self.fail_first
+        slow = self.delay_ms and (not self.slow_every or n % self.slow_every == 0)
+        return (self.delay_ms / 1000.0 if slow else 0), fail
+
+    def listing(self, since):
+        with self.lock:
+            timestamp = now_iso()
+            changed = [p for p in self.packages
+                       if p["updatedAt"] >= since or p.get("statsUpdatedAt", "") >= since]
+            deleted = [i for i, at in self.deleted.items() if at >= since]
+        return {"timestamp": timestamp, "since": since, "count": len(changed),
+                "packages": changed, "deleted": deleted}
+
+    def page(self, search=None, sort=None, limit=50, cursor=None, filters=None):
+        """One page of a filtered, sorted listing; None for a bad cursor."""
+        field, order = SORTS.get(sort, SORTS["created"])
+        terms = set(search.lower().split()) if search else None
+        filters = filters or {}
+        key = lambda p: (p.get(field) or 0, p["id"])
+        if not terms and not filters:
+            return self.plain_page(field, order, key, limit, cursor)
+        with self.lock:
+            if terms:
+                # Like a $text query: any word of name, description, keywords or tags
+                matches = [p for p in self.packages if terms & set(
+                    " ".join([p["name"], p["description"]] + p["keywords"] + p["tags"]).lower().split())]
+            else:
+                matches = list(self.packages)
+        if "category" in filters:
+            matches = [p for p in matches if p["category"] == filters["category"]]
+        if "tag" in filters:
+            matches = [p for p in matches if filters["tag"] in p["tags"]]
+        if "runtime" in filters:
+            matches = [p for p in matches if p["runtime"]["type"] == filters["runtime"]]
+        if filters.get("deprecated") == "false":
+            matches = [p for p in matches if not p["deprecated"]]
+        matches.sort(key=key, reverse=order < 0)
+        if cursor:
+            try:
+                after = tuple(json.loads(base64.urlsafe_b64decode(cursor + "==")))
+            except ValueError:
+                return None
+            matches = [p for p in matches if (key(p) < after if order < 0 else key(p) > after)]
+        body = {"timestamp": now_iso(), "count": min(limit, len(matches)), "packages": matches[:limit]}
+        if len(matches) > limit:
+            last = json.dumps(list(key(matches[limit - 1]))).encode()
+            body["nextCursor"] = base64.urlsafe_b64encode(last).decode().rstrip("=")
+        return body
+
+    def plain_page(self, field, order, key, limit, cursor):
+        """page() of the whole registry, from an order kept until the next change."""
+        with self.lock:
+            cached = self.sorted.get(field)
+            if cached is None or cached[0] != self.changed_at:
+                ordered = sorted(self.packages, key=key, reverse=order < 0)
+                cached = (self.changed_at, ordered, {p["id"]: i for i, p in enumerate(ordered)})
+                self.sorted[field] = cached
+        _, ordered, position = cached
+        start = 0
+        if cursor:
+            try:
+                after = tuple(json.loads(base64.urlsafe_b64decode(cursor + "==")))
+            except ValueError:
+                return None
+            start = position[after[1]] + 1 if len(after) == 2 and after[1] in position else None
+            if start is None:
+                start = next((i for i, p in enumerate(ordered)
+                              if (key(p) < after if order < 0 else key(p) > after)), len(ordered))
+        matches = ordered[start:start + limit + 1]
+        body = {"timestamp": now_iso(), "count": min(limit, len(matches)), "packages": matches[:limit]}
+        if len(matches) > limit:
+            last = json.dumps(list(key(matches[limit - 1]))).encode()
+            body["nextCursor"] = base64.urlsafe_b64encode(last).decode().rstrip("=")
+        return body
+
+    def shards(self):
+        """(timestamp, packages per shard, version per shard), rebuilt after a change."""
+        with self.lock:
+            if self.shard_table is None or self.shard_table[0] != self.changed_at:
+                members = [[] for _ in range(SHARD_COUNT)]
+                for pkg in sorted(self.packages, key=lambda p: p["id"]):
+                    members[shard_of(pkg["id"])].append(pkg)
+                versions = [hashlib.sha1("".join("%s %s\n" % (p["id"], p["updatedAt"]) for p in shard)
+                                         .encode()).hexdigest()[:16] for shard in members]
+                self.shard_table = (self.changed_at, members, versions)
+            return self.shard_table
+
+    def churn(self, add=0, update=0, delete=0, stats=0):
+        """Publish, re-publish and delete packages, and download some, as of now."""
+        result = {"added": [], "updated": [], "deleted": [], "stats": []}
+        with self.lock:
+            stamp = self.changed_at = now_iso()
+            removed = set(self.rng.sample(range(len(self.packages)), min(delete, len(self.packages))))
+            for i in removed:
+                pkg = self.packages[i]
+                del self.by_id[pkg["id"]]
+                self.deleted[pkg["id"]] = stamp
+                result["deleted"].append(pkg["id"])
+            self.packages = [p for i, p in enumerate(self.packages) if i not in removed]
+            for pkg in self.rng.sample(self.packages, min(update, len(self.packages))):
+                pkg["version"] = "2.%d.0" % self.rng.randint(0, 99)
+                pkg["updatedAt"] = stamp
+                result["updated"].append(pkg["id"])
+            for pkg in self.rng.sample(self.packages, min(stats, len(self.packages))):
+                pkg["downloads"] += self.rng.randint(1, 1000)
+                pkg["statsUpdatedAt"] = stamp
+                result["stats"].append(pkg["id"])
+            for _ in range(add):
+                pkg = make_package(self.next_index, self.rng)
+                pkg["updatedAt"] = stamp
+                self.next_index += 1
+                self.packages.append(pkg)
+                self.by_id[pkg["id"]] = pkg
+                self.deleted.pop(pkg["id"], None)
+                result["added"].append(pkg["id"])
+            result.update(timestamp=stamp, count=len(self.packages))
+        return result
+
+    def publish_artifact(self, build, size, cut=0):
+        """Replace /download/nex with `size` bytes that differ per build."""
+        line = ("nex build %d\n" % build).encode()
+        with self.lock:
+            self.artifact = (build, (line * (size // len(line) + 1))[:size])
+            self.artifact_cut = cut
+        return {"etag": '"build-%d"' % build, "size": size}
+
+    def count(self, sent, not_modified=False):
+        with self.lock:
+            self.stats["requests"] += 1
+            self.stats["bytes_sent"] += sent
+            if not_modified:
+                self.stats["not_modified"] += 1
+
+
+def negotiate(header, allow):
+    accepted = set()
+    for part in (header or "").split(","):
+        fields = part.strip().lower().split(";")
+        q = [f for f in fields[1:] if f.strip().startswith("q=")]
+        if fields[0] and (not q or float(q[0].strip()[2:]) > 0):
+            accepted.add(fields[0])
+    for name in ("zstd", "br", "gzip"):
+        if name in allow and name in accepted:
+            return name
+    return None
+
+
+def compress(encoding, body):
+    if encoding == "zstd":
+        return zstandard.ZstdCompressor(level=3).compress(body)
+    if encoding == "br":
+        return brotli.compress(body, quality=5)
+    return gzip.compress(body, compresslevel=6)
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    registry = None
+    encodings = ()
+    delta = True
+    sharded = True
+
+    def log_message(self, *args):
+        pass
+
+    def handle(self):
+        # Clients drop connections on purpose here (cut transfers, hedging)
+        try:
+            super().handle()
+        except ConnectionResetError:
+            pass
+
+    def send_json(self, payload, status=200):
+        body = json.dumps(payload, separators=(",", ":")).encode()
+        etag = '"%s"' % hashlib.sha1(body).hexdigest()[:16]
+
+        if self.headers.get("If-None-Match") == etag:
+            self.send_response(304)
+            self.send_header("ETag", etag)
+            self.send_header("Content-Length", "0")
+            self.end_headers()
+            self.registry.count(0, not_modified=True)
+            return
+
+        encoding = negotiate(self.headers.get("Accept-Encoding"), self.encodings)
+        if encoding and len(body) >= 1024:
+            body = compress(encoding, body)
+        else:
+            encoding = None
+
+        self.send_response(status)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(body)))
+        self.send_header("ETag", etag)
+        self.send_header("Vary", "Accept-Encoding")
+        if encoding:
+            self.send_header("Content-Encoding", encoding)
+        self.end_headers()
+        self.wfile.write(body)
+        self.registry.count(len(body))
+
+    def send_artifact(self):
+        with self.registry.lock:
+            build, body = self.registry.artifact
+            cut, self.registry.artifact_cut = self.registry.artifact_cut, 0
+        etag = '"build-%d"' % build
+
+        # A range is honoured only while If-Range still names this build
+        status, start = 200, 0
+        match = re.fullmatch(r"bytes=(\d+)-", self.headers.get("Range", ""))
+        if match and self.headers.get("If-Range", etag) == etag:
+            status, start = 206, int(match.group(1))
+            if start >= len(body):
+                self.send_response(416)
+                self.send_header("Content-Range", "bytes */%d" % len(body))
+                self.send_header("Content-Length", "0")
+                self.end_headers()
+                return
+
+        self.send_response(status)
+        self.send_header("Content-Type", "application/octet-stream")
+        self.send_header("Content-Length", str(len(body) - start))
+        self.send_header("ETag", etag)
+        if status == 206:
+            self.send_header("Content-Range", "bytes %d-%d/%d" % (start, len(body) - 1, len(body)))
+        self.end_headers()
+        sent = body[start:start + cut] if cut else body[start:]
+        self.wfile.write(sent)
+        self.registry.count(len(sent))
+        if cut:
+            self.close_connection = True
+
+    def do_GET(self):
+        path = self.path.split("?", 1)[0]
+
+        if path == "/__stats":
+            return self.send_json(self.registry.stats)
+        if path == "/__artifact":
+            query = parse_qs(urlsplit(self.path).query)
+            return self.send_json(self.registry.publish_artifact(
+                **{k: int(v[0]) for k, v in query.items() if k in ("build", "size", "cut")}))
+        if path == "/__churn":
+            query = parse_qs(urlsplit(self.path).query)
+            return self.send_json(self.registry.churn(
+                **{k: int(v[0]) for k, v in query.items() if k in ("add", "update", "delete", "stats")}))
+
+        delay, fail = self.registry.arrive()
+        if delay:
+            time.sleep(delay)
+        if fail:
+            with self.registry.lock:
+                self.registry.stats["failed"] += 1
+            self.send_response(503)
+            self.send_header("Retry-After", "0")
+            self.send_header("Content-Length", "0")
+            self.end_headers()
+            return
+
+        if path == "/download/nex":
+            return self.send_artifact()
+
+        if path == "/api/packages":
+            query = {k: v[0] for k, v in parse_qs(urlsplit(self.path).query).items()}
+            since = query.get("since")
+            if since is not None and self.delta:
+                if not TIMESTAMP.match(since):
+                    return self.send_json({"msg": "since must be an ISO 8601 timestamp"}, status=400)
+                return self.send_json(self.registry.listing(since))
+            filters = {k: query[k] for k in ("category", "tag", "runtime", "deprecated") if k in query}
+            page = self.registry.page(query.get("search"), query.get("sort"),
+                                      max(int(query.get("limit", "50") or 50), 1), query.get("cursor"),
+                                      filters)
+            if page is None:
+                return self.send_json({"msg": "Invalid cursor"}, status=400)
+            return self.send_json(page)
+
+        parts = path.strip("/").split("/")
+        if self.sharded and parts[:3] == ["api", "packages", "shards"] and len(parts) <= 4:
+            timestamp, members, versions = self.registry.shards()
+            if len(parts) == 3:
+                return self.send_json({"timestamp": timestamp, "count": SHARD_COUNT,
+                                       "shards": [{"count": len(m), "version": v}
+                                                  for m, v in zip(members, versions)]})
+            if parts[3].isdigit() and int(parts[3]) < SHARD_COUNT:
+                n = int(parts[3])
+                return self.send_json({"timestamp": timestamp, "shard": n, "version": versions[n],
+                                       "count": len(members[n]), "packages": members[n]})
+        if len(parts) == 6 and parts[:2] == ["api", "packages"] and parts[5] == "nex.json":
+            pkg = self.registry.by_id.get("%s.%s" % (parts[3], parts[4]))
+            if pkg:
+                manifest = dict(pkg, commands={"default": "python main.py"}, entrypoint="main.py")
+                return self.send_json(manifest)
+
+        self.send_json({"msg": "Not Found"}, status=404)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("--port", type=int, default=8765)
+    parser.add_argument("--packages", type=int, default=1000)
+    parser.add_argument("--identity", action="store_true", help="never compress responses")
+    parser.add_argument("--delay-ms", type=int, default=0, help="stall responses this long")
+    parser.add_argument("--slow-every", type=int, default=0,
+                        help="stall only every Nth request (default: all of them)")
+    parser.add_argument("--fail-first", type=int, default=0,
+                        help="answer the first N requests with 503")
+    parser.add_argument("--no-delta", action="store_true",
+                        help="ignore ?since= like a registry without delta listings")
+    parser.add_argument("--no-shards", action="store_true",
+                        help="answer 404 for shards like a registry without them")
+    args = parser.parse_args()
+
+    Handler.registry = Registry(args.packages)
+    Handler.registry.delay_ms = args.delay_ms
+    Handler.registry.slow_every = args.slow_every
+    Handler.registry.fail_first = args.fail_first
+    Handler.delta = not args.no_delta
+    Handler.sharded = not args.no_shards
+    if not args.identity:
+        Handler.encodings = tuple(name for name, ok in
+                                  (("zstd", zstandard), ("br", brotli), ("gzip", True)) if ok)
+
+    server = ThreadingHTTPServer(("127.0.0.1", args.port), Handler)
+    server.daemon_threads = True
+    print("registry stub on http://127.0.0.1:%d/api (%d packages, encodings: %s)" % (
+        args.port, args.packages, ", ".join(Handler.encodings) or "identity"), flush=True)
+    server.serve_forever()
+
+
+if __name__ == "__main__":
+    main()
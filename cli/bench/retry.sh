@@ -0,0 +1,64 @@
+#!/bin/bash
+# Exercise the HTTP retry policy and request hedging against a slow,
+# flaky registry stub.
+#
+#   ./retry.sh [runs]
+
+source "$(dirname "${BASH_SOURCE[0]}")/common.sh"
+
+RUNS="${1:-10}"
+find_nex
+use_sandbox_home
+
+# Every request must reach the stub
+"$NEX" config http_cache_max_size 0 > /dev/null
+
+now_ms() {
+    date +%s%3N
+}
+
+echo -e "${YELLOW}Recovery from transient failures${NC}"
+start_stub --packages 2000 --fail-first 2
+if "$NEX" search tool-1 > /dev/null 2>&1; then
+    echo -e "  ${GREEN}✓${NC} search succeeded after $(stub_stat failed) failed attempts"
+else
+    echo -e "  ${RED}✗${NC} search failed despite retries"
+fi
+stop_stub
+
+# Searches use the local index once it exists, so start over without one
+"$NEX" config http_retries 0 > /dev/null
+rm -f "$HOME/.nex/index.json" "$HOME/.nex/index.bin"
+start_stub --packages 2000 --fail-first 1
+if "$NEX" search tool-1 > /dev/null 2>&1; then
+    echo -e "  ${RED}✗${NC} search succeeded with retries disabled"
+else
+    echo -e "  ${GREEN}✓${NC} with http_retries 0 the first failure is final"
+fi
+stop_stub
+"$NEX" config http_retries 3 > /dev/null
+
+# Every other request stalls for 2s; a hedge re-sends it after 300ms.
+# `info` fetches the manifest from the registry on every run.
+run_series() {
+    local start end
+    start=$(now_ms)
+    for _ in $(seq 1 "$RUNS"); do
+        "$NEX" info tool-1 > /dev/null 2>&1
+    done
+    end=$(now_ms)
+    echo $(( (end - start) / RUNS ))
+}
+
+echo -e "${YELLOW}Tail latency with every 2nd request stalled by 2000ms ($RUNS runs)${NC}"
+start_stub --packages 2000 --delay-ms 2000 --slow-every 2
+
+"$NEX" config http_hedge false > /dev/null
+echo -e "  unhedged     ${BLUE}$(run_series)${NC} ms/run"
+
+"$NEX" config http_hedge true > /dev/null
+"$NEX" config http_hedge_ms 300 > /dev/null
+echo -e "  hedged       ${BLUE}$(run_series)${NC} ms/run"
+
+stop_stub
+rm -rf "$HOME"
@@ -0,0 +1,44 @@
+#!/bin/bash
+# Time to the first search result as the registry grows: a local search
+# on a fresh machine (download and compile the index first) against
+# --remote, which only asks for the first page of matches.
+#
+#   ./search.sh [package-count...]
+
+source "$(dirname "${BASH_SOURCE[0]}")/common.sh"
+
+SIZES="${*:-10000 100000}"
+find_nex
+
+# Milliseconds until nex prints its first result row
+first_result_ms() {
+    python3 - "$NEX" "$@" <<'EOF'
+import re, subprocess, sys, time
+start = time.monotonic()
+nex = subprocess.Popen(sys.argv[1:], stdout=subprocess.PIPE, stderr=subprocess.DEVNULL, text=True)
+for line in nex.stdout:
+    if re.match(r"^\S+\.\S+ ", line):
+        print(int((time.monotonic() - start) * 1000))
+        break
+else:
+    print("-")
+nex.kill()
+nex.wait()
+EOF
+}
+
+echo -e "${YELLOW}Time to first result for 'json'${NC}"
+for size in $SIZES; do
+    start_stub --packages "$size"
+
+    use_sandbox_home
+    LOCAL=$(first_result_ms search json)
+    rm -rf "$HOME"
+
+    use_sandbox_home
+    REMOTE=$(first_result_ms search --remote json)
+    rm -rf "$HOME"
+
+    stop_stub
+    printf "  %7d packages   local (cold) ${BLUE}%6s${NC} ms   --remote ${BLUE}%5s${NC} ms\n" "$size" "$LOCAL" "$REMOTE"
+done
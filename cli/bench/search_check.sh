@@ -0,0 +1,124 @@
+#!/bin/bash
+# Check local search against a brute-force reference: every query and
+# filter combination, plain and with -i typed through a pipe, must return
+# exactly the packages of index.json a straight scan finds. Queries of
+# different lengths and filters of different sizes take each way the
+# search can pick its candidates (narrowest facet, rarest trigram, pool
+# scan, the previous results under -i). Runs again after a delta sync.
+#
+#   ./search_check.sh [package-count]
+
+source "$(dirname "${BASH_SOURCE[0]}")/common.sh"
+
+PACKAGES="${1:-5000}"
+find_nex
+use_sandbox_home
+"$NEX" config not_found_ttl 0 > /dev/null
+start_stub --packages "$PACKAGES"
+
+STUB_URL="http://127.0.0.1:$STUB_PORT"
+FAILED=0
+
+check_all() {
+    python3 - "$NEX" "$HOME/.nex/index.json" <<'EOF' || FAILED=1
+import itertools, json, re, subprocess, sys
+
+nex, index_path = sys.argv[1:3]
+packages = json.load(open(index_path))["packages"]
+
+def expected(query, category, tag, runtime, no_deprecated):
+    query = query.lower()
+    found = set()
+    for p in packages:
+        if category and p.get("category", "").lower() != category.lower():
+            continue
+        if tag and tag.lower() not in [t.lower() for t in p.get("tags", [])]:
+            continue
+        if runtime and p.get("runtime", {}).get("type", "").lower() != runtime.lower():
+            continue
+        if no_deprecated and p.get("deprecated"):
+            continue
+        fields = [p["id"], p.get("name", ""), p.get("description", "")] + p.get("keywords", [])
+        if query and not any(query in f.lower() for f in fields):
+            continue
+        found.add(p["id"])
+    return found
+
+def search(args, keys=None):
+    out = subprocess.run([nex, "search", "--limit", "1000000"] + args, input=keys,
+                         capture_output=True, text=True).stdout
+    return set(re.findall(r"^(\S+\.\S+) ", out, re.M))
+
+def typed(keys):
+    """The query -i ends up with: backspace, Ctrl-U and Ctrl-W edit it."""
+    query = ""
+    for key in keys.rstrip("\n"):
+        if key == "\x7f":
+            query = query[:-1]
+        elif key == "\x15":
+            query = ""
+        elif key == "\x17":
+            query = query.rstrip(" ")
+            query = query[:query.rfind(" ") + 1]
+        else:
+            query += key
+    return query
+
+def filter_args(category, tag, runtime, no_deprecated):
+    args = []
+    if category: args += ["--category", category]
+    if tag: args += ["--tag", tag]
+    if runtime: args += ["--runtime", runtime]
+    if no_deprecated: args.append("--no-deprecated")
+    return args
+
+# Short queries have no trigram; "tool" is in every package, "tool-12" in few
+queries = ["", "j", "js", "json", "JSON", "to", "tool", "tool-12", "r0.tool-1",
+           "pdf files", "a csv", "x", "qj", "zzz"]
+# A category holds 1/8 of the packages, a tag about 1/16, deprecated 1/50
+filters = list(itertools.product([None, "cli", "Security"], [None, "pdf"],
+                                 [None, "python", "binary"], [0, 1]))
+# Typed one key at a time, each refining the results of the last
+keys = ["json\n", "jsonx\x7f\n", "pdf\x17csv\n", "tool-1\x15to\n", "t\x7f\x7f\x7fjs\n",
+        "tool-12\x7f3\n", "a csv\x17\x17fast\n", "zzz\x7f\x7f\x7fpdf\n"]
+
+cases = failures = 0
+def compare(label, got, want):
+    global cases, failures
+    cases += 1
+    if got != want:
+        failures += 1
+        print("  FAIL %s: %d found, %d expected" % (label, len(got), len(want)))
+
+for flt in filters:
+    for query in queries:
+        if query or any(flt):
+            compare("search %s %r" % (" ".join(filter_args(*flt)), query),
+                    search(filter_args(*flt) + ([query] if query else [])), expected(query, *flt))
+for flt in filters[::5]:
+    for k in keys:
+        compare("search -i %s %r" % (" ".join(filter_args(*flt)), k),
+                search(["-i"] + filter_args(*flt), keys=k), expected(typed(k), *flt))
+
+print("  %d cases, %d failures" % (cases, failures))
+sys.exit(1 if failures else 0)
+EOF
+}
+
+echo -e "${YELLOW}Local search against a brute-force scan of index.json ($PACKAGES packages)${NC}"
+"$NEX" search tool-1 > /dev/null
+check_all
+
+echo -e "${YELLOW}...after a delta sync${NC}"
+curl -s "$STUB_URL/__churn?add=30&update=50&delete=20&stats=50" > /dev/null
+"$NEX" __index-refresh
+check_all
+
+stop_stub
+rm -rf "$HOME"
+if [ "$FAILED" = 0 ]; then
+    echo -e "${GREEN}✓${NC} search matches the reference"
+else
+    echo -e "${RED}✗${NC} search differs from the reference"
+fi
+exit $FAILED
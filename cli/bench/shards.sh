@@ -0,0 +1,46 @@
+#!/bin/bash
+# Bytes and time of a cold `nex info <short-name>` (no local index yet),
+# once resolving the name from one index shard and once against a
+# registry without shards, which means downloading the whole index.
+#
+#   ./shards.sh [package-count]
+
+source "$(dirname "${BASH_SOURCE[0]}")/common.sh"
+
+PACKAGES="${1:-100000}"
+find_nex
+
+now_ms() {
+    date +%s%3N
+}
+
+measure() {
+    use_sandbox_home
+    start_stub --packages "$PACKAGES" "$@"
+    curl -s "http://127.0.0.1:$STUB_PORT/api/packages/shards" > /dev/null  # Warm the stub
+    local before=$(stub_stat bytes_sent)
+
+    local start=$(now_ms)
+    if "$NEX" info tool-42 | grep -q "author42.tool-42"; then
+        COLD_OK="${GREEN}✓${NC} resolved"
+    else
+        COLD_OK="${RED}✗${NC} not resolved"
+    fi
+    local end=$(now_ms)
+    COLD_BYTES=$(( $(stub_stat bytes_sent) - before ))
+    COLD_MS=$(( end - start ))
+
+    stop_stub
+    rm -rf "$HOME"
+}
+
+echo -e "${YELLOW}Cold 'nex info tool-42' with no local index ($PACKAGES packages)${NC}"
+
+measure --no-shards
+echo -e "  full index   ${BLUE}$COLD_BYTES${NC} bytes  ${BLUE}$COLD_MS${NC} ms  $COLD_OK"
+FULL=$COLD_BYTES
+
+measure
+echo -e "  one shard    ${BLUE}$COLD_BYTES${NC} bytes  ${BLUE}$COLD_MS${NC} ms  $COLD_OK"
+
+python3 -c "print('  downloaded   %.2f%% of the full-index bytes' % (100.0 * $COLD_BYTES / $FULL))"
@@ -29,8 +29,7 @@
 #define NEX_VERSION "1.9.0"
 #define NEX_USER_AGENT "nex/1.9.0"
 
-/* Registry configuration */
-/* Registry configuration */
+/* Registry configuration (defaults; see config_get_registry_url) */
 #define REGISTRY_BASE_URL "https://nex-9ujp.onrender.com/api"
 #define REGISTRY_INDEX_URL REGISTRY_BASE_URL "/packages"
 
@@ -43,6 +42,7 @@
 #define MAX_COMMAND_LEN 2048
 #define MAX_COMMANDS 16
 #define MAX_KEYWORDS 16
+#define HTTP_MAX_PARALLEL 16
 
 /* Runtime types */
 typedef enum {
@@ -90,14 +90,110 @@ typedef struct {
 typedef struct {
     char *data;
     size_t size;
+    size_t capacity;
     long status_code;
 } HttpResponse;
 
+/* Streaming body consumer: return 0 to continue, non-zero to abort */
+typedef int (*HttpSink)(const char *data, size_t size, void *ctx);
+
+/* Connection phases of the most recent request, in milliseconds */
+typedef struct {
+    double dns_ms;
+    double connect_ms;
+    double tls_ms;
+    int reused;         /* Answered on an already open connection */
+} HttpTimings;
+
+/* Compiled registry index, memory-mapped from ~/.nex/index.bin */
+typedef struct IndexMap IndexMap;
+
+/* Incremental writer of index.bin (package/index_map.c) */
+typedef struct IndexBuilder IndexBuilder;
+struct cJSON;
+
+/* One package of the compiled index; strings point into the mapping */
+typedef struct {
+    const char *id;
+    const char *short_name;
+    const char *name;
+    const char *version;
+    const char *description;
+    const char *keywords;   /* Newline-separated */
+} IndexEntry;
+
+/* Facets a search must match; NULL (or 0) for no constraint */
+typedef struct {
+    const char *category;
+    const char *tag;
+    const char *runtime;
+    int no_deprecated;
+} IndexFilter;
+
+/*
+ * Called by JsonStream with a member name of the root object and raw JSON
+ * text (NUL-terminated); return 0 to continue, non-zero to abort
+ */
+typedef int (*JsonStreamFn)(const char *member, const char *json, size_t len, void *ctx);
+
+/* Incremental JSON reader state (utils/json_stream.c) */
+typedef struct {
+    JsonStreamFn on_value;
+    JsonStreamFn on_item;
+    void *ctx;
+    int state;
+    int depth;
+    int in_string;
+    int escaped;
+    int in_array;           /* Inside an array member of the root */
+    int capturing;          /* Buffering a value for a callback */
+    int capture_depth;
+    int bare;               /* The value is a number or literal */
+    int failed;
+    char member[64];
+    size_t member_length;
+    char *buffer;
+    size_t length;
+    size_t capacity;
+} JsonStream;
+
+/* Keys from terminal_read_key other than plain characters */
+typedef enum {
+    TERM_KEY_EOF = -1,
+    TERM_KEY_NONE = 0,      /* A key with no use here, such as an arrow */
+    TERM_KEY_ENTER = 0x100,
+    TERM_KEY_BACKSPACE,
+    TERM_KEY_ESCAPE,
+    TERM_KEY_CANCEL,        /* Ctrl-C */
+    TERM_KEY_CLEAR,         /* Ctrl-U */
+    TERM_KEY_DELETE_WORD    /* Ctrl-W */
+} TerminalKey;
+
+/* One row of the --timings table, in milliseconds */
+typedef struct {
+    double dns_ms;
+    double connect_ms;
+    double tls_ms;
+    double ttfb_ms;         /* Request sent until the first response byte */
+    double transfer_ms;
+    double total_ms;
+    long long bytes;
+} TimingPhases;
+
+/* A program asked for its version (runtime_probe_all) */
+typedef struct {
+    const char *program;
+    char version[128];      /* First line of `program --version`, or "" */
+    int found;              /* The program is on PATH */
+    int timed_out;          /* ...but did not answer in time */
+} RuntimeProbe;
+
 /* ============ Function Declarations ============ */
 
 /* Commands - see commands folder */
 int cmd_install(int argc, char *argv[]);
 int cmd_run(int argc, char *argv[]);
+int cmd_run_planned(int argc, char *argv[], int *result);
 int cmd_update(int argc, char *argv[]);
 int cmd_remove(int argc, char *argv[]);
 int cmd_list(int argc, char *argv[]);
@@ -122,21 +218,76 @@ int nex_self_update(void);
 int http_init(void);
 void http_cleanup(void);
 HttpResponse* http_get(const char *url);
+HttpResponse** http_get_many(const char **urls, int count, int max_parallel);
+long http_get_stream(const char *url, HttpSink sink, void *ctx);
+long http_download_to_fd(const char *url, int fd);
+long http_download_resumable(const char *url, const char *path);
 void http_response_free(HttpResponse *response);
+void http_responses_free(HttpResponse **responses, int count);
+void http_get_timings(HttpTimings *timings);
+void http_set_offline(int offline);
+int http_is_offline(void);
 
 /* Package management (package/manager.c) */
 int package_parse_manifest(const char *json, PackageInfo *info);
 int package_fetch_manifest(const char *package_id, PackageInfo *info);
+int package_fetch_manifests(const char **package_ids, int count, PackageInfo *infos, int *results);
 int package_install(const char *package_id);
 int package_remove(const char *package_id);
 int package_is_installed(const char *package_id, LocalPackage *local);
+int package_load_local(const char *install_path, PackageInfo *info, char *manifest_path, size_t size);
+int package_command_line(const PackageInfo *info, const char *command, char *exec_cmd, size_t size);
 int package_execute(const char *package_id, const char *command, int argc, char *argv[]);
 int package_resolve_name(const char *name_or_id, char *resolved_id, size_t resolved_size);
+int package_count_local(const char *name);
+
+/* Local registry index (package/index.c) */
+int index_ensure(int force_refresh);
+int index_refresh(void);
+int index_refresh_detached(void);
+int index_available(void);
+int index_recently_synced(void);
+int index_not_found_has(const char *name);
+void index_not_found_add(const char *name);
+
+/* Registry index shards (package/shard.c) */
+int shard_resolve_name(const char *name, char *resolved_id, size_t resolved_size);
+
+/* Precompiled run plans (package/plan.c) */
+int plan_write(const char *package_id, const char *install_path);
+int plan_run(const char *package_id, const char *command, int argc, char *argv[], int *result);
+int plan_find(const char *name, char *package_id, size_t size);
+void plan_remove(const char *package_id);
+
+/* Compiled registry index (package/index_map.c) */
+IndexMap* index_map_open(int force_refresh);
+void index_map_close(IndexMap *map);
+int index_map_build(void);
+IndexBuilder* index_builder_new(void);
+int index_builder_add(IndexBuilder *builder, struct cJSON *pkg);
+int index_builder_write(IndexBuilder *builder, long long source_mtime, long long source_size);
+void index_builder_free(IndexBuilder *builder);
+int index_map_count(const IndexMap *map);
+void index_map_entry(const IndexMap *map, int index, IndexEntry *entry);
+int index_map_find_id(const IndexMap *map, const char *id);
+int index_map_find_name(const IndexMap *map, const char *name, int *found);
+int index_map_may_contain(const IndexMap *map, const char *name);
+int index_map_search(const IndexMap *map, const char *query, const IndexFilter *filter, int **matches);
+int index_map_search_within(const IndexMap *map, const char *query, const IndexFilter *filter,
+                            const int *within, int within_count, int **matches);
+int index_map_rank(const IndexMap *map, const char *query, const int *matches, int count,
+                   int k, int *top);
 
 /* Configuration (config/config.c) */
 int config_init(void);
 int config_get_home_dir(char *buffer, size_t size);
 int config_get_packages_dir(char *buffer, size_t size);
+int config_get_cache_dir(char *buffer, size_t size);
+long config_get_long(const char *key, long default_value);
+int config_get_bool(const char *key, int default_value);
+const char* config_get_string(const char *key);
+const char* config_get_registry_url(void);
+int config_get_registry_index_url(char *buffer, size_t size);
 int config_ensure_directories(void);
 int config_save_local_package(const LocalPackage *pkg);
 int config_remove_local_package(const char *package_id);
@@ -151,9 +302,50 @@ int make_directory_recursive(const char *path);
 RuntimeType runtime_from_string(const char *str);
 const char* runtime_to_string(RuntimeType runtime);
 int run_command(const char *command);
+int get_executable_path(char *path, size_t size);
+void url_encode(const char *src, char *dest, size_t dest_size);
+
+/* Running package commands (utils/process.c) */
+char** command_split(const char *command, int *argc);
+void command_free(char **argv);
+int process_run(const char *dir, char *const argv[], int replace);
+int process_run_shell(const char *dir, const char *command, int argc, char *argv[], int replace);
+int process_find_program(const char *name, char *path, size_t size);
+unsigned long long process_path_hash(void);
+void process_forget_programs(void);
+
+/* Timing breakdown (utils/timing.c) */
+void timing_init(int enabled);
+int timing_enabled(void);
+double timing_now_ms(void);
+void timing_add(const char *kind, const char *label, const TimingPhases *phases);
+void timing_print(void);
+
+/* Interactive terminal input (utils/terminal.c) */
+int terminal_is_tty(FILE *stream);
+int terminal_raw_begin(void);
+void terminal_raw_end(void);
+int terminal_size(int *rows, int *cols);
+int terminal_read_key(void);
+
+/* Case-insensitive substring matching (utils/match.c) */
+const char* match_find(const char *text, size_t len, const char *needle_lower, size_t needle_len);
+int match_contains(const char *text, const char *needle_lower, size_t needle_len);
+const char* match_backend(void);
+int match_use(const char *name);
+
+/* Streaming JSON reader (utils/json_stream.c) */
+void json_stream_init(JsonStream *stream, JsonStreamFn on_value, JsonStreamFn on_item, void *ctx);
+int json_stream_feed(JsonStream *stream, const char *data, size_t size);
+int json_stream_finish(JsonStream *stream);
+void json_stream_free(JsonStream *stream);
+int json_stream_file(const char *path, JsonStreamFn on_value, JsonStreamFn on_item, void *ctx);
 
 /* Runtime management (runtime/runtime.c) */
 int runtime_is_installed(RuntimeType runtime);
+void runtime_probe_all(RuntimeProbe *probes, int count, int use_cache);
+int runtime_probe_version(const char *program, char *version, size_t size);
+int runtime_find(RuntimeType runtime, char *path, size_t size);
 int runtime_ensure_available(RuntimeType runtime);
 int runtime_install(RuntimeType runtime);
 int runtime_install_python(void);
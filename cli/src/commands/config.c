@@ -97,6 +97,17 @@ int cmd_config(int argc, char *argv[]) {
         printf("  registry_url      Custom registry URL\n");
         printf("  global_path       Path for global packages\n");
         printf("  auto_update       Auto-check for CLI updates (true/false)\n");
+        printf("  http_cache_ttl    Seconds a cached response is reused without revalidating (default 300)\n");
+        printf("  http_cache_max_size  Max size of ~/.nex/cache/http in MB, 0 disables (default 50)\n");
+        printf("  http_retries      Retries for transient network errors (default 3)\n");
+        printf("  http_backoff_ms   Base delay before the first retry, doubled per attempt (default 250)\n");
+        printf("  http_connect_timeout  Seconds to wait for a connection (default 15)\n");
+        printf("  http_timeout      Seconds allowed per API request, 0 for no limit (default 0)\n");
+        printf("  http_hedge        Re-send slow API requests (true/false, default false)\n");
+        printf("  http_hedge_ms     Hedge delay in ms, 0 for the p95 of recent requests (default 0)\n");
+        printf("  index_ttl         Seconds before the local registry index is refreshed in the background (default 3600)\n");
+        printf("  not_found_ttl     Seconds a \"package not found\" answer is trusted, 0 to always ask (default 60)\n");
+        printf("  http_net_cache    Remember DNS results and TLS sessions between runs (true/false, default true)\n");
         printf("\n");
         
         cJSON_Delete(config);
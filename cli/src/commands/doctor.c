@@ -4,18 +4,42 @@
 
 #include "nex.h"
 
-static int check_command(const char *cmd, const char *name) {
-    printf("  %-15s ", name);
-    int ret = system(cmd);
-    if (ret == 0) {
-        printf("\033[32m✓ Installed\033[0m\n");
-        return 1;
-    } else {
-        printf("\033[31m✗ Not found\033[0m\n");
-        return 0;
+/* Report each runtime; all of them are run together with a deadline */
+static void check_runtimes(const char **programs, const char **names, int count) {
+    RuntimeProbe probes[4];
+    memset(probes, 0, sizeof(probes));
+    for (int i = 0; i < count; i++) {
+        probes[i].program = programs[i];
+    }
+    
+    /* Asked afresh: doctor is run when something looks wrong */
+    runtime_probe_all(probes, count, 0);
+    
+    for (int i = 0; i < count; i++) {
+        printf("  %-15s ", names[i]);
+        if (probes[i].timed_out) {
+            printf("\033[31m✗ Not responding\033[0m\n");
+        } else if (probes[i].found) {
+            /* Some programs print their version to stderr, or not at all */
+            printf("\033[32m✓ Installed\033[0m");
+            if (probes[i].version[0]) {
+                printf(" \033[90m%s\033[0m", probes[i].version);
+            }
+            printf("\n");
+        } else {
+            printf("\033[31m✗ Not found\033[0m\n");
+        }
     }
 }
 
+/* The connectivity check only needs the status, not the body */
+static int discard_body(const char *data, size_t size, void *ctx) {
+    (void)data;
+    (void)size;
+    (void)ctx;
+    return 0;
+}
+
 static void check_dir(const char *path, const char *desc) {
     if (access(path, 0) == 0) { // 0 is F_OK
         printf("  \033[32m✓\033[0m %s (\033[90m%s\033[0m)\n", desc, path);
@@ -48,15 +72,13 @@ int cmd_doctor(int argc, char *argv[]) {
     /* 2. Runtimes */
     printf("\033[1m[Runtimes]\033[0m\n");
 #ifdef _WIN32
-    check_command("git --version >nul 2>&1", "Git");
-    check_command("python --version >nul 2>&1", "Python");
-    check_command("node --version >nul 2>&1", "Node.js");
+    const char *programs[] = { "git", "python", "node" };
+    const char *names[] = { "Git", "Python", "Node.js" };
 #else
-    check_command("git --version >/dev/null 2>&1", "Git");
-    check_command("python3 --version >/dev/null 2>&1", "Python3");
-    check_command("node --version >/dev/null 2>&1", "Node.js");
-    check_command("bash --version >/dev/null 2>&1", "Bash");
+    const char *programs[] = { "git", "python3", "node", "bash" };
+    const char *names[] = { "Git", "Python3", "Node.js", "Bash" };
 #endif
+    check_runtimes(programs, names, (int)(sizeof(programs) / sizeof(programs[0])));
     printf("\n");
     
     /* 3. Directories */
@@ -75,14 +97,33 @@ int cmd_doctor(int argc, char *argv[]) {
     printf("\033[1m[Connectivity]\033[0m\n");
     printf("  Registry        ");
     
-    HttpResponse *res = http_get(REGISTRY_BASE_URL "/index.json");
-    if (res && res->status_code == 200) {
+    /*
+     * One package of the listing, streamed past the response cache: a
+     * cached answer would prove nothing, and the index is kept in
+     * index.json already
+     */
+    char index_url[MAX_URL_LEN];
+    char url[MAX_URL_LEN];
+    config_get_registry_index_url(index_url, sizeof(index_url));
+    snprintf(url, sizeof(url), "%s?limit=1", index_url);
+    
+    long status = http_get_stream(url, discard_body, NULL);
+    if (status == 200) {
         printf("\033[32m✓ Accessible\033[0m\n");
+        
+        HttpTimings timings;
+        http_get_timings(&timings);
+        printf("  Handshake       ");
+        if (timings.reused) {
+            printf("reused open connection\n");
+        } else {
+            printf("dns %.1f ms, connect %.1f ms, tls %.1f ms\n",
+                timings.dns_ms, timings.connect_ms, timings.tls_ms);
+        }
     } else {
         printf("\033[31m✗ Unreachable\033[0m\n");
-        if (res) printf("    (Status: %ld)\n", res->status_code);
+        if (status > 0) printf("    (Status: %ld)\n", status);
     }
-    if (res) http_response_free(res);
     
     printf("\n");
     
@@ -108,6 +108,7 @@ int cmd_link(int argc, char *argv[]) {
     
     cJSON_AddStringToObject(links, package_id, cwd);
     save_links(links);
+    plan_write(package_id, cwd);
     
     printf("\n  \033[32m🔗 Package Linked!\033[0m\n\n");
     printf("  \033[1m%s\033[0m -> %s\n\n", package_id, cwd);
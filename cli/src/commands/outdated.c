@@ -27,30 +27,58 @@ int cmd_outdated(int argc, char *argv[]) {
     
     int outdated_count = 0;
     
+    printf("Checking %d package(s)...\r", count);
+    fflush(stdout);
+    
+    /* Fetch all latest manifests in one batch */
+    const char **ids = calloc(count, sizeof(char *));
+    PackageInfo *latest = calloc(count, sizeof(PackageInfo));
+    int *results = calloc(count, sizeof(int));
+    if (!ids || !latest || !results) {
+        print_error("Out of memory");
+        free(ids);
+        free(latest);
+        free(results);
+        free(packages);
+        return 1;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        ids[i] = packages[i].id;
+    }
+    
+    int fetched = package_fetch_manifests(ids, count, latest, results);
+    
+    /* Clear progress line */
+    printf("                                                 \r");
+    
+    if (fetched < 0) {
+        print_error("Failed to fetch package info");
+        free(ids);
+        free(latest);
+        free(results);
+        free(packages);
+        return 1;
+    }
+    
     for (int i = 0; i < count; i++) {
         /* Extract short name */
         const char *short_name = strchr(packages[i].id, '.');
         short_name = short_name ? short_name + 1 : packages[i].id;
         
-        /* Fetch latest manifest */
-        PackageInfo latest;
-        memset(&latest, 0, sizeof(latest));
-        
-        printf("Checking %s...\r", short_name);
-        fflush(stdout);
-        
-        if (package_fetch_manifest(packages[i].id, &latest) == 0) {
+        if (results[i] == 0) {
             /* Compare versions (simple string comparison for now) */
-            if (strcmp(packages[i].version, latest.version) != 0) {
+            if (strcmp(packages[i].version, latest[i].version) != 0) {
                 printf("%-25s \033[90m%-15s\033[0m \033[32m%-15s\033[0m\n", 
-                    short_name, packages[i].version, latest.version);
+                    short_name, packages[i].version, latest[i].version);
                 outdated_count++;
             }
         }
     }
     
-    /* Clear progress line */
-    printf("                                                 \r");
+    free(ids);
+    free(latest);
+    free(results);
     
     if (outdated_count == 0) {
         printf("\n\033[32mAll packages are up to date! 🎉\033[0m\n\n");
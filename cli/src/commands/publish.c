@@ -4,28 +4,6 @@
 
 #include "nex.h"
 #include "cJSON.h"
-#include <ctype.h>
-
-/* Simple URL encoding helper */
-static void url_encode(const char *src, char *dest, size_t dest_size) {
-    static const char hex[] = "0123456789ABCDEF";
-    size_t i = 0, j = 0;
-    
-    while (src[i] && j < dest_size - 4) {
-        unsigned char c = src[i];
-        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
-            dest[j++] = c;
-        } else if (c == ' ') {
-            dest[j++] = '+';
-        } else {
-            dest[j++] = '%';
-            dest[j++] = hex[c >> 4];
-            dest[j++] = hex[c & 0x0F];
-        }
-        i++;
-    }
-    dest[j] = '\0';
-}
 
 static void open_url(const char *url) {
     char cmd[MAX_COMMAND_LEN];
@@ -4,6 +4,53 @@
 
 #include "nex.h"
 
+/* Split `<package> [command] [args...]` into the command and its arguments */
+static const char* split_run_args(int argc, char *argv[], int *cmd_argc, char ***cmd_argv) {
+    const char *command = "default";
+    *cmd_argc = 0;
+    *cmd_argv = NULL;
+    
+    /* Check for command name */
+    if (argc > 1) {
+        /* Check if it's a command name or an argument (starts with -) */
+        if (argv[1][0] != '-') {
+            command = argv[1];
+            *cmd_argc = argc - 2;
+            *cmd_argv = argv + 2;
+        } else {
+            *cmd_argc = argc - 1;
+            *cmd_argv = argv + 1;
+        }
+    }
+    return command;
+}
+
+/*
+ * Run a package from its run plan alone, before nex sets up its HTTP
+ * client. Aliases, full ids and short names that one plan answers for
+ * qualify. Returns 0 with the outcome in result if the package was run,
+ * or -1 to go through cmd_run.
+ */
+int cmd_run_planned(int argc, char *argv[], int *result) {
+    if (argc < 1) {
+        return -1;
+    }
+    
+    char package_id[MAX_NAME_LEN];
+    if (!resolve_alias(argv[0], package_id, sizeof(package_id))) {
+        if (strchr(argv[0], '.')) {
+            snprintf(package_id, sizeof(package_id), "%s", argv[0]);
+        } else if (plan_find(argv[0], package_id, sizeof(package_id)) != 0) {
+            return -1;
+        }
+    }
+    
+    int cmd_argc;
+    char **cmd_argv;
+    const char *command = split_run_args(argc, argv, &cmd_argc, &cmd_argv);
+    return plan_run(package_id, command, cmd_argc, cmd_argv, result);
+}
+
 int cmd_run(int argc, char *argv[]) {
     if (argc < 1) {
         print_error("Usage: nex run <package> [command] [args...]");
@@ -25,21 +72,14 @@ int cmd_run(int argc, char *argv[]) {
         }
     }
     
-    const char *command = "default";
-    int cmd_argc = 0;
-    char **cmd_argv = NULL;
+    int cmd_argc;
+    char **cmd_argv;
+    const char *command = split_run_args(argc, argv, &cmd_argc, &cmd_argv);
     
-    /* Check for command name */
-    if (argc > 1) {
-        /* Check if it's a command name or an argument (starts with -) */
-        if (argv[1][0] != '-') {
-            command = argv[1];
-            cmd_argc = argc - 2;
-            cmd_argv = argv + 2;
-        } else {
-            cmd_argc = argc - 1;
-            cmd_argv = argv + 1;
-        }
+    /* A current run plan means it is installed and says how to run it */
+    int result;
+    if (plan_run(package_id, command, cmd_argc, cmd_argv, &result) == 0) {
+        return result;
     }
     
     LocalPackage local;
@@ -1,131 +1,535 @@
 /*
  * Search command - Search the package registry
+ *
+ * By default the local index is searched and the best matches are shown,
+ * ranked by relevance and popularity. --remote (implied by --sort,
+ * which needs the registry's download and rating counts) sends the query
+ * to the registry instead and prints each page of results as it arrives,
+ * following the cursor to the next page until --limit is reached.
+ *
+ * --category, --tag, --runtime and --no-deprecated narrow either kind of
+ * search; with a filter the query may be left out.
+ *
+ * -i searches the local index as the query is typed. The index stays
+ * mapped for the whole session, and the results of each shorter query
+ * are kept: typing a character only rechecks the previous results, and
+ * deleting one goes back to results already found.
  */
 
 #include "nex.h"
 #include "cJSON.h"
-#include <ctype.h>
 
-int cmd_search(int argc, char *argv[]) {
-    if (argc < 1) {
-        print_error("Usage: nex search <query>");
-        printf("Example: nex search \"python utility\"\n");
-        return 1;
-    }
+#define SEARCH_FIRST_PAGE 20    /* Small, so the first results show up quickly */
+#define SEARCH_PAGE 100
+#define SEARCH_DEFAULT_LIMIT 20 /* Local results shown without --limit */
+#define INTERACTIVE_MAX_QUERY 128
+#define INTERACTIVE_MIN_ROWS 5
+#define INTERACTIVE_PROMPT "Search: "
+
+typedef struct {
+    JsonStream json;
+    int shown;
+    int limit;                  /* 0 for every match */
+    char cursor[256];           /* Next page, empty on the last one */
+} RemoteSearch;
+
+static void format_result(char *line, size_t size, const char *id, const char *version,
+                          const char *description) {
+    const char *pkg_ver = version[0] ? version : "?";
     
-    /* Combine all args into search query */
-    char query[MAX_COMMAND_LEN] = {0};
-    for (int i = 0; i < argc; i++) {
-        if (i > 0) strcat(query, " ");
-        strcat(query, argv[i]);
-    }
+    /* Truncate description if too long */
+    char desc_short[50];
+    strncpy(desc_short, description, 46);
+    desc_short[46] = '\0';
+    if (strlen(description) > 46) strcat(desc_short, "...");
     
-    /* Convert query to lowercase for case-insensitive search */
-    char query_lower[MAX_COMMAND_LEN];
-    for (size_t i = 0; i < strlen(query) + 1; i++) {
-        query_lower[i] = (char)tolower((unsigned char)query[i]);
+    snprintf(line, size, "%-40s %-12s %s", id, pkg_ver, desc_short);
+}
+
+static void print_result(const char *id, const char *version, const char *description) {
+    char line[MAX_NAME_LEN + MAX_VERSION_LEN + 64];
+    format_result(line, sizeof(line), id, version, description);
+    printf("%s\n", line);
+}
+
+static const char* json_string(cJSON *object, const char *key) {
+    cJSON *item = cJSON_GetObjectItemCaseSensitive(object, key);
+    return cJSON_IsString(item) ? item->valuestring : "";
+}
+
+static int remote_value(const char *member, const char *json, size_t len, void *ctx) {
+    RemoteSearch *search = ctx;
+    if (!json || strcmp(member, "nextCursor") != 0) {
+        return 0;
     }
     
-    print_info("Searching for: %s", query);
-    
-    /* Fetch index */
-    HttpResponse *response = http_get(REGISTRY_INDEX_URL);
-    if (!response || response->status_code != 200) {
-        print_error("Failed to fetch package index");
-        if (response) http_response_free(response);
-        return 1;
+    cJSON *cursor = cJSON_Parse(json);
+    if (cJSON_IsString(cursor) && len < sizeof(search->cursor)) {
+        strcpy(search->cursor, cursor->valuestring);
+    }
+    cJSON_Delete(cursor);
+    return 0;
+}
+
+/* Print each package as soon as its JSON is complete */
+static int remote_item(const char *member, const char *json, size_t len, void *ctx) {
+    (void)len;
+    RemoteSearch *search = ctx;
+    if (strcmp(member, "packages") != 0 || (search->limit && search->shown >= search->limit)) {
+        return 0;
     }
     
-    /* Parse JSON */
-    cJSON *json = cJSON_Parse(response->data);
-    http_response_free(response);
+    cJSON *pkg = cJSON_Parse(json);
+    if (!pkg) return -1;
+    print_result(json_string(pkg, "id"), json_string(pkg, "version"), json_string(pkg, "description"));
+    cJSON_Delete(pkg);
     
-    if (!json) {
-        print_error("Failed to parse package index");
-        return 1;
-    }
+    search->shown++;
+    return 0;
+}
+
+static int remote_sink(const char *data, size_t size, void *ctx) {
+    RemoteSearch *search = ctx;
+    return json_stream_feed(&search->json, data, size);
+}
+
+/* Append "&name=value" to a query string when value is set */
+static void append_param(char *buffer, size_t size, const char *name, const char *value) {
+    if (!value || !value[0]) return;
     
-    cJSON *packages = cJSON_GetObjectItemCaseSensitive(json, "packages");
-    if (!cJSON_IsArray(packages)) {
-        print_error("Invalid index format");
-        cJSON_Delete(json);
+    char encoded[MAX_NAME_LEN * 3];
+    size_t len = strlen(buffer);
+    url_encode(value, encoded, sizeof(encoded));
+    snprintf(buffer + len, size - len, "&%s=%s", name, encoded);
+}
+
+static void print_no_results(const char *query) {
+    if (query[0]) {
+        printf("No packages found matching '%s'\n", query);
+    } else {
+        printf("No packages found matching the filters\n");
+    }
+}
+
+static int search_remote(const char *query, const IndexFilter *filter, const char *sort, int limit) {
+    if (http_is_offline()) {
+        print_error("Remote search is not available offline");
         return 1;
     }
     
+    char index_url[MAX_URL_LEN];
+    char encoded[MAX_COMMAND_LEN * 3];
+    char filters[MAX_NAME_LEN * 10] = "";
+    config_get_registry_index_url(index_url, sizeof(index_url));
+    url_encode(query, encoded, sizeof(encoded));
+    append_param(filters, sizeof(filters), "category", filter->category);
+    append_param(filters, sizeof(filters), "tag", filter->tag);
+    append_param(filters, sizeof(filters), "runtime", filter->runtime);
+    append_param(filters, sizeof(filters), "deprecated", filter->no_deprecated ? "false" : NULL);
+    
+    RemoteSearch search;
+    memset(&search, 0, sizeof(search));
+    search.limit = limit;
+    
     printf("\nSearch results:\n\n");
     printf("%-40s %-12s %s\n", "PACKAGE", "VERSION", "DESCRIPTION");
     printf("%-40s %-12s %s\n", "-------", "-------", "-----------");
     
-    int found = 0;
-    cJSON *pkg;
-    cJSON_ArrayForEach(pkg, packages) {
-        cJSON *id = cJSON_GetObjectItemCaseSensitive(pkg, "id");
-        cJSON *name = cJSON_GetObjectItemCaseSensitive(pkg, "name");
-        cJSON *version = cJSON_GetObjectItemCaseSensitive(pkg, "version");
-        cJSON *description = cJSON_GetObjectItemCaseSensitive(pkg, "description");
-        cJSON *keywords = cJSON_GetObjectItemCaseSensitive(pkg, "keywords");
-        
-        /* Check if query matches id, name, description, or keywords */
-        int matches = 0;
-        
-        if (cJSON_IsString(id)) {
-            char temp[MAX_NAME_LEN];
-            strncpy(temp, id->valuestring, MAX_NAME_LEN - 1);
-            for (size_t i = 0; i < strlen(temp); i++) temp[i] = (char)tolower((unsigned char)temp[i]);
-            if (strstr(temp, query_lower)) matches = 1;
+    int first = 1;
+    do {
+        int page = first ? SEARCH_FIRST_PAGE : SEARCH_PAGE;
+        if (limit && limit - search.shown < page) {
+            page = limit - search.shown;
         }
         
-        if (!matches && cJSON_IsString(name)) {
-            char temp[MAX_NAME_LEN];
-            strncpy(temp, name->valuestring, MAX_NAME_LEN - 1);
-            for (size_t i = 0; i < strlen(temp); i++) temp[i] = (char)tolower((unsigned char)temp[i]);
-            if (strstr(temp, query_lower)) matches = 1;
+        /* The cursor is URL-safe base64, so it goes in as is */
+        char *url = malloc(strlen(index_url) + strlen(encoded) + strlen(filters) + sizeof(search.cursor) + 96);
+        if (!url) {
+            print_error("Search failed: out of memory");
+            return 1;
         }
+        sprintf(url, "%s?search=%s&limit=%d%s%s%s%s%s", index_url, encoded, page, filters,
+                sort ? "&sort=" : "", sort ? sort : "",
+                search.cursor[0] ? "&cursor=" : "", search.cursor);
+        search.cursor[0] = '\0';
         
-        if (!matches && cJSON_IsString(description)) {
-            char temp[MAX_DESCRIPTION_LEN];
-            strncpy(temp, description->valuestring, MAX_DESCRIPTION_LEN - 1);
-            for (size_t i = 0; i < strlen(temp); i++) temp[i] = (char)tolower((unsigned char)temp[i]);
-            if (strstr(temp, query_lower)) matches = 1;
-        }
+        json_stream_init(&search.json, remote_value, remote_item, &search);
+        long status = http_get_stream(url, remote_sink, &search);
+        int complete = json_stream_finish(&search.json) == 0;
+        json_stream_free(&search.json);
+        free(url);
+        fflush(stdout);
         
-        if (!matches && cJSON_IsArray(keywords)) {
-            cJSON *keyword;
-            cJSON_ArrayForEach(keyword, keywords) {
-                if (cJSON_IsString(keyword)) {
-                    char temp[MAX_NAME_LEN];
-                    strncpy(temp, keyword->valuestring, MAX_NAME_LEN - 1);
-                    for (size_t i = 0; i < strlen(temp); i++) temp[i] = (char)tolower((unsigned char)temp[i]);
-                    if (strstr(temp, query_lower)) {
-                        matches = 1;
-                        break;
-                    }
-                }
+        if (status != 200 || !complete) {
+            if (status == 200) {
+                print_error("Registry search failed: malformed response");
+            } else if (status > 0) {
+                print_error("Registry search failed (HTTP %ld)", status);
             }
+            return 1;
         }
-        
-        if (matches) {
-            const char *pkg_id = cJSON_IsString(id) ? id->valuestring : "unknown";
-            const char *pkg_ver = cJSON_IsString(version) ? version->valuestring : "?";
-            const char *pkg_desc = cJSON_IsString(description) ? description->valuestring : "";
-            
-            /* Truncate description if too long */
-            char desc_short[50];
-            strncpy(desc_short, pkg_desc, 46);
-            desc_short[46] = '\0';
-            if (strlen(pkg_desc) > 46) strcat(desc_short, "...");
-            
-            printf("%-40s %-12s %s\n", pkg_id, pkg_ver, desc_short);
-            found++;
-        }
+        first = 0;
+    } while (search.cursor[0] && (!limit || search.shown < limit));
+    
+    if (search.shown == 0) {
+        print_no_results(query);
+    } else {
+        printf("\nShowing %d package(s). Install with: nex install <package>\n", search.shown);
+    }
+    return 0;
+}
+
+/* Print ranked local results with the usual header and summary */
+static void print_ranked(const IndexMap *index, const char *query, const int *top, int shown, int found) {
+    printf("\nSearch results:\n\n");
+    printf("%-40s %-12s %s\n", "PACKAGE", "VERSION", "DESCRIPTION");
+    printf("%-40s %-12s %s\n", "-------", "-------", "-----------");
+    
+    for (int i = 0; i < shown; i++) {
+        IndexEntry pkg;
+        index_map_entry(index, top[i], &pkg);
+        print_result(pkg.id, pkg.version, pkg.description);
     }
     
     if (found == 0) {
-        printf("No packages found matching '%s'\n", query);
+        print_no_results(query);
+    } else if (shown < found) {
+        printf("\nShowing %d of %d package(s). Install with: nex install <package>\n", shown, found);
     } else {
         printf("\nFound %d package(s). Install with: nex install <package>\n", found);
     }
+}
+
+static int search_local(const char *query, const IndexFilter *filter, int limit) {
+    /* Map the compiled local index (fetched on first use) */
+    IndexMap *index = index_map_open(0);
+    if (!index) {
+        return 1;
+    }
     
-    cJSON_Delete(json);
+    int *matches = NULL;
+    int found = index_map_search(index, query, filter, &matches);
+    if (found < 0) {
+        print_error("Search failed: out of memory");
+        index_map_close(index);
+        return 1;
+    }
+    
+    /* Best matches first; only the top ones are kept while ranking */
+    int k = limit ? limit : SEARCH_DEFAULT_LIMIT;
+    int *top = malloc((size_t)(k < found ? k : (found ? found : 1)) * sizeof(int));
+    int shown = top ? index_map_rank(index, query, matches, found, k, top) : -1;
+    free(matches);
+    if (shown < 0) {
+        print_error("Search failed: out of memory");
+        free(top);
+        index_map_close(index);
+        return 1;
+    }
+    
+    print_ranked(index, query, top, shown, found);
+    free(top);
+    index_map_close(index);
+    return 0;
+}
+
+/* ============ Interactive ============ */
+
+/* Matches of the first length bytes of the query */
+typedef struct {
+    size_t length;
+    int *matches;
+    int count;
+} QueryLevel;
+
+typedef struct {
+    IndexMap *index;
+    const IndexFilter *filter;
+    char query[INTERACTIVE_MAX_QUERY + 1];
+    size_t length;
+    QueryLevel levels[INTERACTIVE_MAX_QUERY + 1];   /* Each a prefix of the query, longest last */
+    int depth;
+    int *top;
+    int shown;
+    int rows;                   /* Results ranked per update */
+    int cols;
+    int live;                   /* Redraw after each key: stdout is a terminal */
+} InteractiveSearch;
+
+/* Forget results for prefixes longer than the query now is */
+static void interactive_truncate(InteractiveSearch *session, size_t length) {
+    session->length = length;
+    session->query[length] = '\0';
+    while (session->depth > 1 && session->levels[session->depth - 1].length > length) {
+        free(session->levels[--session->depth].matches);
+    }
+}
+
+/* Results for the whole query, rechecking those of its longest known prefix */
+static int interactive_match(InteractiveSearch *session) {
+    const QueryLevel *base = &session->levels[session->depth - 1];
+    if (base->length == session->length) {
+        return 0;
+    }
+    
+    QueryLevel level = { session->length, NULL, 0 };
+    if (base->count > 0) {
+        level.count = index_map_search_within(session->index, session->query, session->filter,
+                                              base->matches, base->count, &level.matches);
+        if (level.count < 0) return -1;
+    }
+    session->levels[session->depth++] = level;
     return 0;
 }
+
+static void interactive_draw(const InteractiveSearch *session, double ms) {
+    const QueryLevel *level = &session->levels[session->depth - 1];
+    char line[MAX_NAME_LEN + MAX_VERSION_LEN + 64];
+    int width = session->cols > 1 && session->cols <= (int)sizeof(line) ? session->cols - 1 : (int)sizeof(line);
+    
+    /* Redraw in place; \033[K clears what a longer line left behind */
+    printf("\033[H\033[1m%s\033[0m%s\033[K\n", INTERACTIVE_PROMPT, session->query);
+    if (level->count == 0) {
+        printf("\033[90mNo packages found\033[0m\033[K\n");
+    } else {
+        printf("\033[90m%d package(s), %.1f ms\033[0m\033[K\n", level->count, ms);
+    }
+    
+    snprintf(line, sizeof(line), "%-40s %-12s %s", "PACKAGE", "VERSION", "DESCRIPTION");
+    printf("%.*s\033[K\n", width, line);
+    for (int i = 0; i < session->shown; i++) {
+        IndexEntry pkg;
+        index_map_entry(session->index, session->top[i], &pkg);
+        format_result(line, sizeof(line), pkg.id, pkg.version, pkg.description);
+        printf("%.*s\033[K\n", width, line);
+    }
+    
+    /* Clear below, then put the cursor back after the query */
+    size_t column = strlen(INTERACTIVE_PROMPT) + 1;
+    for (size_t i = 0; i < session->length; i++) {
+        if (((unsigned char)session->query[i] & 0xc0) != 0x80) column++;
+    }
+    printf("\033[J\033[1;%dH", (int)column);
+    fflush(stdout);
+}
+
+/* Match and rank the current query, then show it; timed per key for --timings */
+static int interactive_update(InteractiveSearch *session) {
+    double start = timing_now_ms();
+    if (interactive_match(session) != 0) {
+        return -1;
+    }
+    
+    const QueryLevel *level = &session->levels[session->depth - 1];
+    session->shown = index_map_rank(session->index, session->query, level->matches, level->count,
+                                    session->rows, session->top);
+    if (session->shown < 0) {
+        return -1;
+    }
+    
+    if (session->live) {
+        interactive_draw(session, timing_now_ms() - start);
+    }
+    
+    TimingPhases phases;
+    memset(&phases, 0, sizeof(phases));
+    phases.total_ms = timing_now_ms() - start;
+    timing_add("key", session->query[0] ? session->query : "(empty)", &phases);
+    return 0;
+}
+
+/* Apply one key; returns 1 when the session is over (*accept if results should print) */
+static int interactive_key(InteractiveSearch *session, int key, int *accept, int *changed) {
+    size_t length = session->length;
+    *changed = 1;
+    
+    switch (key) {
+        case TERM_KEY_EOF:
+        case TERM_KEY_ENTER:
+            *accept = 1;
+            return 1;
+        
+        case TERM_KEY_ESCAPE:
+        case TERM_KEY_CANCEL:
+            return 1;
+        
+        case TERM_KEY_BACKSPACE:
+            /* A whole UTF-8 character: continuation bytes, then its lead byte */
+            while (length > 0 && ((unsigned char)session->query[length - 1] & 0xc0) == 0x80) length--;
+            if (length > 0) length--;
+            interactive_truncate(session, length);
+            return 0;
+        
+        case TERM_KEY_CLEAR:
+            interactive_truncate(session, 0);
+            return 0;
+        
+        case TERM_KEY_DELETE_WORD:
+            while (length > 0 && session->query[length - 1] == ' ') length--;
+            while (length > 0 && session->query[length - 1] != ' ') length--;
+            interactive_truncate(session, length);
+            return 0;
+        
+        case TERM_KEY_NONE:
+            *changed = 0;
+            return 0;
+        
+        default:
+            if (key > 0xff || length >= INTERACTIVE_MAX_QUERY) {
+                *changed = 0;
+                return 0;
+            }
+            session->query[length] = (char)key;
+            session->query[length + 1] = '\0';
+            session->length = length + 1;
+            return 0;
+    }
+}
+
+static int search_interactive(const char *initial, const IndexFilter *filter, int limit) {
+    IndexMap *index = index_map_open(0);
+    if (!index) {
+        return 1;
+    }
+    
+    InteractiveSearch *session = calloc(1, sizeof(InteractiveSearch));
+    if (!session) {
+        print_error("Search failed: out of memory");
+        index_map_close(index);
+        return 1;
+    }
+    session->index = index;
+    session->filter = filter;
+    session->live = terminal_is_tty(stdout);
+    
+    /* As many results as fit below the prompt, status and header lines */
+    session->rows = limit ? limit : SEARCH_DEFAULT_LIMIT;
+    int rows;
+    if (session->live && terminal_size(&rows, &session->cols) == 0 && (!limit || rows - 3 < limit)) {
+        session->rows = rows - 3 > INTERACTIVE_MIN_ROWS ? rows - 3 : INTERACTIVE_MIN_ROWS;
+    }
+    
+    /* The empty query's results: every package the filters allow */
+    QueryLevel *all = &session->levels[0];
+    session->depth = 1;
+    session->top = malloc((size_t)session->rows * sizeof(int));
+    all->count = session->top ? index_map_search(index, "", filter, &all->matches) : -1;
+    
+    snprintf(session->query, sizeof(session->query), "%s", initial);
+    session->length = strlen(session->query);
+    
+    terminal_raw_begin();   /* Keys are read from a pipe just the same */
+    if (session->live) {
+        printf("\033[?1049h");     /* Alternate screen, restored on exit */
+    }
+    
+    int accept = 0;
+    int failed = all->count < 0 || interactive_update(session) != 0;
+    while (!failed) {
+        int changed;
+        if (interactive_key(session, terminal_read_key(), &accept, &changed)) {
+            break;
+        }
+        if (changed && interactive_update(session) != 0) {
+            failed = 1;
+        }
+    }
+    
+    if (session->live) {
+        printf("\033[?1049l");
+        fflush(stdout);
+    }
+    terminal_raw_end();
+    
+    if (failed) {
+        print_error("Search failed: out of memory");
+    } else if (accept) {
+        const QueryLevel *level = &session->levels[session->depth - 1];
+        print_ranked(index, session->query, session->top, session->shown, level->count);
+    }
+    
+    for (int i = 0; i < session->depth; i++) {
+        free(session->levels[i].matches);
+    }
+    free(session->top);
+    free(session);
+    index_map_close(index);
+    return failed ? 1 : 0;
+}
+
+static void print_usage(void) {
+    print_error("Usage: nex search [options] <query>");
+    printf("Options: -i, --remote, --limit N, --sort downloads|rating|updated,\n"
+           "         --category NAME, --tag NAME, --runtime TYPE, --no-deprecated\n");
+    printf("Example: nex search \"python utility\"\n");
+    printf("         nex search --category security --runtime python scanner\n");
+}
+
+int cmd_search(int argc, char *argv[]) {
+    int interactive = 0;
+    int remote = 0;
+    int limit = 0;
+    const char *sort = NULL;
+    IndexFilter filter;
+    memset(&filter, 0, sizeof(filter));
+    
+    /* Combine all non-flag args into search query */
+    char query[MAX_COMMAND_LEN] = {0};
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-i") == 0 || strcmp(argv[i], "--interactive") == 0) {
+            interactive = 1;
+        } else if (strcmp(argv[i], "--remote") == 0) {
+            remote = 1;
+        } else if (strcmp(argv[i], "--limit") == 0) {
+            limit = i + 1 < argc ? atoi(argv[++i]) : 0;
+            if (limit <= 0) {
+                print_error("--limit needs a positive number");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--sort") == 0) {
+            sort = i + 1 < argc ? argv[++i] : "";
+            if (strcmp(sort, "downloads") != 0 && strcmp(sort, "rating") != 0 &&
+                strcmp(sort, "updated") != 0) {
+                print_error("--sort must be one of: downloads, rating, updated");
+                return 1;
+            }
+            remote = 1;
+        } else if (strcmp(argv[i], "--category") == 0 || strcmp(argv[i], "--tag") == 0 ||
+                   strcmp(argv[i], "--runtime") == 0) {
+            if (i + 1 >= argc || !argv[i + 1][0]) {
+                print_error("%s needs a value", argv[i]);
+                return 1;
+            }
+            const char **value = argv[i][2] == 'c' ? &filter.category :
+                                 argv[i][2] == 't' ? &filter.tag : &filter.runtime;
+            *value = argv[++i];
+        } else if (strcmp(argv[i], "--no-deprecated") == 0) {
+            filter.no_deprecated = 1;
+        } else if (strlen(query) + strlen(argv[i]) + 2 < sizeof(query)) {
+            if (query[0]) strcat(query, " ");
+            strcat(query, argv[i]);
+        }
+    }
+    
+    if (interactive) {
+        if (remote) {
+            print_error("Interactive search uses the local index; it can't be combined with --remote or --sort");
+            return 1;
+        }
+        return search_interactive(query, &filter, limit);
+    }
+    
+    int filtered = filter.category || filter.tag || filter.runtime || filter.no_deprecated;
+    if (!query[0] && !filtered) {
+        print_usage();
+        return 1;
+    }
+    
+    if (query[0]) {
+        print_info("Searching for: %s", query);
+    } else {
+        print_info("Listing packages matching the filters");
+    }
+    
+    return remote ? search_remote(query, &filter, sort, limit) : search_local(query, &filter, limit);
+}
@@ -6,10 +6,6 @@
 #include <string.h>
 #include <errno.h>
 
-#ifdef __APPLE__
-#include <mach-o/dyld.h>
-#endif
-
 /* GitHub API URL for latest release */
 #define GITHUB_RELEASES_API "https://api.github.com/repos/nexhq/nex/releases/latest"
 
@@ -130,61 +126,33 @@ static int find_asset_url(const char *json, char *url, size_t url_size) {
     return 0;
 }
 
-/* Get the path to the current executable */
-static int get_executable_path(char *path, size_t size) {
-#ifdef _WIN32
-    DWORD len = GetModuleFileNameA(NULL, path, (DWORD)size);
-    return (len > 0 && len < size) ? 0 : -1;
-#elif __APPLE__
-    uint32_t bufsize = (uint32_t)size;
-    return _NSGetExecutablePath(path, &bufsize) == 0 ? 0 : -1;
-#else
-    ssize_t len = readlink("/proc/self/exe", path, size - 1);
-    if (len > 0) {
-        path[len] = '\0';
-        return 0;
-    }
-    return -1;
-#endif
-}
-
-/* Download file to a path */
+/* Download file to a path, resuming from an earlier interrupted attempt */
 static int download_to_file(const char *url, const char *filepath) {
-    HttpResponse *response = http_get(url);
-    if (!response) {
-        return -1;
-    }
+    errno = 0;
+    long status = http_download_resumable(url, filepath);
     
-    if (response->status_code != 200) {
-        print_error("Download failed with status: %ld", response->status_code);
-        http_response_free(response);
-        return -1;
-    }
-    
-    FILE *fp = fopen(filepath, "wb");
-    if (!fp) {
+    if (status == -2) {
 #ifndef _WIN32
         if (errno == EACCES || errno == EPERM) {
             print_error("Permission denied. Try running with sudo:");
             printf("  sudo nex self-update\n");
         } else {
-            print_error("Failed to create file: %s", filepath);
+            print_error("Failed to write file: %s", filepath);
         }
 #else
-        print_error("Failed to create file: %s", filepath);
+        print_error("Failed to write file: %s", filepath);
         printf("Try running as Administrator.\n");
 #endif
-        http_response_free(response);
         return -1;
     }
     
-    size_t expected_size = response->size;
-    size_t written = fwrite(response->data, 1, response->size, fp);
-    fclose(fp);
-    http_response_free(response);
+    if (status < 0) {
+        print_error("Download did not complete; run 'nex self-update' again to resume");
+        return -1;
+    }
     
-    if (written != expected_size) {
-        print_error("Failed to write complete file");
+    if (status != 200) {
+        print_error("Download failed with status: %ld", status);
         return -1;
     }
     
@@ -33,13 +33,38 @@ int cmd_update(int argc, char *argv[]) {
             return 0;
         }
         
+        /* Fetch all latest manifests in one batch */
+        const char **ids = calloc(count, sizeof(char *));
+        PackageInfo *latest = calloc(count, sizeof(PackageInfo));
+        int *results = calloc(count, sizeof(int));
+        if (!ids || !latest || !results) {
+            print_error("Out of memory");
+            free(ids);
+            free(latest);
+            free(results);
+            free(packages);
+            return 1;
+        }
+        
+        for (int i = 0; i < count; i++) {
+            ids[i] = packages[i].id;
+        }
+        
+        if (package_fetch_manifests(ids, count, latest, results) < 0) {
+            print_error("Failed to fetch package info");
+            free(ids);
+            free(latest);
+            free(results);
+            free(packages);
+            return 1;
+        }
+        
         int updated = 0;
         for (int i = 0; i < count; i++) {
-            PackageInfo info;
-            if (package_fetch_manifest(packages[i].id, &info) == 0) {
-                if (strcmp(info.version, packages[i].version) != 0) {
+            if (results[i] == 0) {
+                if (strcmp(latest[i].version, packages[i].version) != 0) {
                     print_info("Updating %s: %s -> %s", 
-                        packages[i].id, packages[i].version, info.version);
+                        packages[i].id, packages[i].version, latest[i].version);
                     
                     /* Remove old, install new */
                     package_remove(packages[i].id);
@@ -50,6 +75,9 @@ int cmd_update(int argc, char *argv[]) {
             }
         }
         
+        free(ids);
+        free(latest);
+        free(results);
         free(packages);
         
         if (updated > 0) {
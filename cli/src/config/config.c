@@ -8,6 +8,11 @@
 #define CONFIG_FILENAME "config.json"
 #define PACKAGES_DIRNAME "packages"
 #define INSTALLED_FILENAME "installed.json"
+#define CACHE_DIRNAME "cache"
+
+/* Parsed config.json, loaded on first use */
+static cJSON *settings = NULL;
+static int settings_loaded = 0;
 
 int config_get_home_dir(char *buffer, size_t size) {
 #ifdef _WIN32
@@ -39,6 +44,116 @@ int config_get_packages_dir(char *buffer, size_t size) {
     return 0;
 }
 
+int config_get_cache_dir(char *buffer, size_t size) {
+    char home[MAX_PATH_LEN];
+    if (config_get_home_dir(home, sizeof(home)) != 0) {
+        return -1;
+    }
+    snprintf(buffer, size, "%s%c%s", home, PATH_SEPARATOR, CACHE_DIRNAME);
+    return 0;
+}
+
+static cJSON* load_settings(void) {
+    if (settings_loaded) {
+        return settings;
+    }
+    settings_loaded = 1;
+    
+    char home[MAX_PATH_LEN];
+    if (config_get_home_dir(home, sizeof(home)) != 0) {
+        return NULL;
+    }
+    
+    char path[MAX_PATH_LEN];
+    snprintf(path, sizeof(path), "%s%c%s", home, PATH_SEPARATOR, CONFIG_FILENAME);
+    
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return NULL;
+    }
+    
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    
+    char *data = malloc(size + 1);
+    if (!data) {
+        fclose(f);
+        return NULL;
+    }
+    
+    fread(data, 1, size, f);
+    data[size] = '\0';
+    fclose(f);
+    
+    settings = cJSON_Parse(data);
+    free(data);
+    
+    return settings;
+}
+
+/* Values set through 'nex config' are stored as strings, so numbers are parsed here */
+long config_get_long(const char *key, long default_value) {
+    cJSON *item = cJSON_GetObjectItem(load_settings(), key);
+    
+    if (cJSON_IsNumber(item)) {
+        return (long)item->valuedouble;
+    }
+    if (cJSON_IsString(item)) {
+        char *end = NULL;
+        long value = strtol(item->valuestring, &end, 10);
+        if (end != item->valuestring && *end == '\0') {
+            return value;
+        }
+    }
+    
+    return default_value;
+}
+
+/* Returned string is owned by the loaded config and stays valid for the process */
+const char* config_get_string(const char *key) {
+    cJSON *item = cJSON_GetObjectItem(load_settings(), key);
+    return cJSON_IsString(item) ? item->valuestring : NULL;
+}
+
+/* Registry API base: NEX_REGISTRY_URL, then the registry_url setting, then the default */
+const char* config_get_registry_url(void) {
+    static char url[MAX_URL_LEN];
+    
+    if (url[0] == '\0') {
+        const char *value = getenv("NEX_REGISTRY_URL");
+        if (!value || !*value) value = config_get_string("registry_url");
+        if (!value || !*value) value = REGISTRY_BASE_URL;
+        
+        strncpy(url, value, sizeof(url) - 1);
+        size_t len = strlen(url);
+        while (len > 0 && url[len - 1] == '/') {
+            url[--len] = '\0';
+        }
+    }
+    
+    return url;
+}
+
+int config_get_registry_index_url(char *buffer, size_t size) {
+    snprintf(buffer, size, "%s/packages", config_get_registry_url());
+    return 0;
+}
+
+int config_get_bool(const char *key, int default_value) {
+    cJSON *item = cJSON_GetObjectItem(load_settings(), key);
+    
+    if (cJSON_IsBool(item)) {
+        return cJSON_IsTrue(item);
+    }
+    if (cJSON_IsString(item)) {
+        if (strcmp(item->valuestring, "true") == 0 || strcmp(item->valuestring, "1") == 0) return 1;
+        if (strcmp(item->valuestring, "false") == 0 || strcmp(item->valuestring, "0") == 0) return 0;
+    }
+    
+    return default_value;
+}
+
 int config_init(void) {
     return config_ensure_directories();
 }
@@ -3,27 +3,1282 @@
  */
 
 #include "nex.h"
+#include "cJSON.h"
 #include <curl/curl.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#define strncasecmp _strnicmp
+#define write(fd, buf, len) _write(fd, buf, (unsigned int)(len))
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <strings.h>
+#endif
+
+/* Response cache defaults, overridable in config.json */
+#define HTTP_CACHE_DIRNAME "http"
+#define HTTP_CACHE_DEFAULT_TTL 300      /* seconds */
+#define HTTP_CACHE_DEFAULT_MAX_SIZE 50  /* megabytes */
+#define HTTP_CACHE_EVICT_BYTES (8L * 1024 * 1024) /* stored between eviction scans */
+
+/* A download is abandoned when it stalls, not for being long */
+#define HTTP_LOW_SPEED_LIMIT 1024L      /* bytes per second... */
+#define HTTP_LOW_SPEED_TIME 30L         /* ...sustained for this many seconds */
+
+/* Retry policy defaults, overridable in config.json */
+#define HTTP_DEFAULT_RETRIES 3
+#define HTTP_DEFAULT_BACKOFF_MS 250
+#define HTTP_BACKOFF_CAP_MS 8000
+#define HTTP_RETRY_AFTER_CAP_MS 30000
+#define HTTP_DEFAULT_CONNECT_TIMEOUT 15 /* seconds */
+#define HTTP_DEFAULT_TIMEOUT 0          /* seconds, 0 = no total deadline */
+
+/* Hedging: the delay is the p95 of recent request latencies */
+#define HTTP_LATENCY_FILENAME "latency.json"
+#define HTTP_LATENCY_SAMPLES 64
+#define HTTP_HEDGE_MIN_SAMPLES 8
+#define HTTP_HEDGE_DEFAULT_MS 1000
+#define HTTP_HEDGE_FLOOR_MS 100
+
+/* Connection state carried between runs, in ~/.nex/cache/net */
+#define HTTP_NET_DIRNAME "net"
+#define HTTP_HOSTS_FILENAME "hosts.json"
+#define HTTP_SESSIONS_FILENAME "tls_sessions.json"
+#define HTTP_DNS_TTL 300                /* seconds a remembered address is trusted */
+#define HTTP_MAX_HOSTS 32
+
+/* Resumable downloads */
+#define HTTP_DOWNLOAD_ATTEMPTS 5
 
 static CURL *curl_handle = NULL;
+static CURLM *multi_handle = NULL;
+
+/* Retry, timeout and hedging settings */
+typedef struct {
+    long retries;
+    long backoff_ms;
+    long connect_timeout;
+    long timeout;
+    int hedge;
+    long hedge_ms;
+} HttpPolicy;
+
+static HttpPolicy policy;
+
+/* Recent request latencies in ms, persisted across runs for the hedge delay */
+static long latency_samples[HTTP_LATENCY_SAMPLES];
+static int latency_count = 0;
+static int latency_next = 0;
+static int latency_dirty = 0;
+
+/* DNS, TLS session and connection caches shared by every handle */
+static CURLSH *share_handle = NULL;
+
+/* Remembered host addresses, replayed into curl via CURLOPT_RESOLVE */
+typedef struct {
+    char host[256];
+    long port;
+    char ip[64];
+    time_t stored_at;
+} HostEntry;
+
+static HostEntry hosts[HTTP_MAX_HOSTS];
+static int host_count = 0;
+static int hosts_dirty = 0;
+static struct curl_slist *resolve_list = NULL;
+
+static HttpTimings last_timings;
+
+/*
+ * The cache directory is scanned for eviction once per process, and again
+ * only after this process has stored HTTP_CACHE_EVICT_BYTES more
+ */
+static int cache_scanned = 0;
+static long cache_stored = 0;
+
+/* --offline: answer from the cache or fail, never touch the network */
+static int offline = 0;
+
+/* Cached copy of a response, as stored under ~/.nex/cache/http */
+typedef struct {
+    char key[17];
+    char etag[256];
+    char last_modified[64];
+    time_t stored_at;
+    int valid;
+} CacheEntry;
+
+/* State for one in-flight request */
+typedef struct {
+    const char *url;
+    CURL *handle;
+    HttpResponse *response;
+    CacheEntry cached;
+    char etag[256];
+    char last_modified[64];
+    int encoded;
+    long retry_after_ms;
+    int attempts;
+    long long retry_at;
+    struct curl_slist *headers;
+} HttpTransfer;
+
+/*
+ * Make room for at least `needed` bytes plus the terminating NUL. Unless
+ * `exact` is set (the size is known up front), grow geometrically so a body
+ * arriving in many chunks costs O(log n) reallocs.
+ */
+static int response_reserve(HttpResponse *response, size_t needed, int exact) {
+    if (needed + 1 <= response->capacity) {
+        return 0;
+    }
+    
+    size_t capacity = needed + 1;
+    if (!exact) {
+        capacity = response->capacity ? response->capacity : 4096;
+        while (capacity < needed + 1) {
+            capacity *= 2;
+        }
+    }
+    
+    char *ptr = realloc(response->data, capacity);
+    if (!ptr) {
+        return -1;
+    }
+    
+    response->data = ptr;
+    response->capacity = capacity;
+    return 0;
+}
+
+/* Memory write callback for curl */
+static size_t write_callback(void *contents, size_t size, size_t nmemb, void *userp) {
+    size_t realsize = size * nmemb;
+    HttpTransfer *transfer = (HttpTransfer *)userp;
+    HttpResponse *response = transfer->response;
+    
+    /* Pre-size the buffer from Content-Length on the first chunk. For a
+     * compressed body that is only a lower bound on the decoded size */
+    if (response->size == 0) {
+        curl_off_t length = -1;
+        curl_easy_getinfo(transfer->handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+        if (length > 0) {
+            response_reserve(response, (size_t)length, !transfer->encoded);
+        }
+    }
+    
+    if (response_reserve(response, response->size + realsize, 0) != 0) {
+        print_error("Out of memory");
+        return 0;
+    }
+    
+    memcpy(&(response->data[response->size]), contents, realsize);
+    response->size += realsize;
+    response->data[response->size] = '\0';
+    
+    return realsize;
+}
+
+/* Copy a header value without the trailing CRLF */
+static void copy_header_value(const char *value, size_t len, char *out, size_t out_size) {
+    while (len > 0 && (*value == ' ' || *value == '\t')) {
+        value++;
+        len--;
+    }
+    while (len > 0 && (value[len - 1] == '\r' || value[len - 1] == '\n' || value[len - 1] == ' ')) {
+        len--;
+    }
+    if (len >= out_size) len = out_size - 1;
+    memcpy(out, value, len);
+    out[len] = '\0';
+}
+
+/* Capture the validators needed for conditional requests */
+static size_t header_callback(char *buffer, size_t size, size_t nitems, void *userp) {
+    size_t len = size * nitems;
+    HttpTransfer *transfer = (HttpTransfer *)userp;
+    
+    if (len > 5 && strncasecmp(buffer, "ETag:", 5) == 0) {
+        copy_header_value(buffer + 5, len - 5, transfer->etag, sizeof(transfer->etag));
+    } else if (len > 14 && strncasecmp(buffer, "Last-Modified:", 14) == 0) {
+        copy_header_value(buffer + 14, len - 14, transfer->last_modified, sizeof(transfer->last_modified));
+    } else if (len > 17 && strncasecmp(buffer, "Content-Encoding:", 17) == 0) {
+        transfer->encoded = 1;
+    } else if (len > 12 && strncasecmp(buffer, "Retry-After:", 12) == 0) {
+        /* Only the delay-seconds form; an HTTP date falls back to our own backoff */
+        transfer->retry_after_ms = strtol(buffer + 12, NULL, 10) * 1000;
+    }
+    
+    return len;
+}
+
+/* Allocate an empty response buffer */
+static HttpResponse* response_new(void) {
+    HttpResponse *response = calloc(1, sizeof(HttpResponse));
+    if (!response) {
+        return NULL;
+    }
+    
+    if (response_reserve(response, 0, 0) != 0) {
+        free(response);
+        return NULL;
+    }
+    response->data[0] = '\0';
+    
+    return response;
+}
+
+/* ============ Response cache ============ */
+
+static int cache_enabled(void) {
+    return config_get_long("http_cache_max_size", HTTP_CACHE_DEFAULT_MAX_SIZE) > 0;
+}
+
+static int cache_get_dir(char *buffer, size_t size) {
+    char cache_dir[MAX_PATH_LEN];
+    if (config_get_cache_dir(cache_dir, sizeof(cache_dir)) != 0) {
+        return -1;
+    }
+    snprintf(buffer, size, "%s%c%s", cache_dir, PATH_SEPARATOR, HTTP_CACHE_DIRNAME);
+    return 0;
+}
+
+/* Cache files are named by a 64-bit FNV-1a hash of the URL */
+static void cache_key(const char *url, char *key) {
+    unsigned long long hash = 1469598103934665603ULL;
+    for (const unsigned char *p = (const unsigned char *)url; *p; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    snprintf(key, 17, "%016llx", hash);
+}
+
+static int cache_path(const char *key, const char *ext, char *buffer, size_t size) {
+    char dir[MAX_PATH_LEN];
+    if (cache_get_dir(dir, sizeof(dir)) != 0) {
+        return -1;
+    }
+    snprintf(buffer, size, "%s%c%s.%s", dir, PATH_SEPARATOR, key, ext);
+    return 0;
+}
+
+static char* read_file(const char *path, size_t *out_size) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    
+    char *data = size >= 0 ? malloc(size + 1) : NULL;
+    if (!data) {
+        fclose(f);
+        return NULL;
+    }
+    
+    size_t read = fread(data, 1, size, f);
+    fclose(f);
+    data[read] = '\0';
+    
+    if (out_size) *out_size = read;
+    return data;
+}
+
+/* Load the metadata for a URL; the body stays on disk until needed */
+static int cache_lookup(const char *url, CacheEntry *entry) {
+    memset(entry, 0, sizeof(CacheEntry));
+    cache_key(url, entry->key);
+    
+    char path[MAX_PATH_LEN];
+    if (cache_path(entry->key, "json", path, sizeof(path)) != 0) {
+        return -1;
+    }
+    
+    char *data = read_file(path, NULL);
+    if (!data) return -1;
+    
+    cJSON *meta = cJSON_Parse(data);
+    free(data);
+    if (!meta) return -1;
+    
+    /* Guard against hash collisions */
+    cJSON *meta_url = cJSON_GetObjectItemCaseSensitive(meta, "url");
+    if (!cJSON_IsString(meta_url) || strcmp(meta_url->valuestring, url) != 0) {
+        cJSON_Delete(meta);
+        return -1;
+    }
+    
+    cJSON *etag = cJSON_GetObjectItemCaseSensitive(meta, "etag");
+    cJSON *last_modified = cJSON_GetObjectItemCaseSensitive(meta, "last_modified");
+    cJSON *stored_at = cJSON_GetObjectItemCaseSensitive(meta, "stored_at");
+    
+    if (cJSON_IsString(etag)) {
+        strncpy(entry->etag, etag->valuestring, sizeof(entry->etag) - 1);
+    }
+    if (cJSON_IsString(last_modified)) {
+        strncpy(entry->last_modified, last_modified->valuestring, sizeof(entry->last_modified) - 1);
+    }
+    if (cJSON_IsNumber(stored_at)) {
+        entry->stored_at = (time_t)stored_at->valuedouble;
+    }
+    
+    cJSON_Delete(meta);
+    entry->valid = 1;
+    return 0;
+}
+
+static int cache_is_fresh(const CacheEntry *entry) {
+    long ttl = config_get_long("http_cache_ttl", HTTP_CACHE_DEFAULT_TTL);
+    return entry->valid && ttl > 0 && difftime(time(NULL), entry->stored_at) < (double)ttl;
+}
+
+/* Build a 200 response from the cached body */
+static HttpResponse* cache_load(const CacheEntry *entry) {
+    char path[MAX_PATH_LEN];
+    if (cache_path(entry->key, "body", path, sizeof(path)) != 0) {
+        return NULL;
+    }
+    
+    HttpResponse *response = calloc(1, sizeof(HttpResponse));
+    if (!response) return NULL;
+    
+    response->data = read_file(path, &response->size);
+    if (!response->data) {
+        free(response);
+        return NULL;
+    }
+    response->capacity = response->size + 1;
+    
+    response->status_code = 200;
+    return response;
+}
+
+static int cache_write_meta(const char *url, const CacheEntry *entry) {
+    char path[MAX_PATH_LEN];
+    if (cache_path(entry->key, "json", path, sizeof(path)) != 0) {
+        return -1;
+    }
+    
+    cJSON *meta = cJSON_CreateObject();
+    cJSON_AddStringToObject(meta, "url", url);
+    if (entry->etag[0]) cJSON_AddStringToObject(meta, "etag", entry->etag);
+    if (entry->last_modified[0]) cJSON_AddStringToObject(meta, "last_modified", entry->last_modified);
+    cJSON_AddNumberToObject(meta, "stored_at", (double)entry->stored_at);
+    
+    char *str = cJSON_PrintUnformatted(meta);
+    cJSON_Delete(meta);
+    if (!str) return -1;
+    
+    /* Written aside and renamed, so a reader never sees half a file */
+    char tmp_path[MAX_PATH_LEN];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *f = fopen(tmp_path, "w");
+    if (!f) {
+        free(str);
+        return -1;
+    }
+    int written = fputs(str, f) >= 0;
+    written = fclose(f) == 0 && written;
+    free(str);
+    
+    remove(path);
+    if (!written || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+        return -1;
+    }
+    
+    return 0;
+}
+
+/* Remove least recently validated entries until the cache fits max_size */
+static void cache_evict(void) {
+    long max_mb = config_get_long("http_cache_max_size", HTTP_CACHE_DEFAULT_MAX_SIZE);
+    double max_bytes = (double)max_mb * 1024.0 * 1024.0;
+    
+    char dir[MAX_PATH_LEN];
+    if (cache_get_dir(dir, sizeof(dir)) != 0) return;
+    
+    typedef struct { char key[17]; time_t used; double size; } Slot;
+    Slot *slots = NULL;
+    int count = 0, capacity = 0;
+    double total = 0;
+    
+#ifdef _WIN32
+    char pattern[MAX_PATH_LEN];
+    snprintf(pattern, sizeof(pattern), "%s\\*.json", dir);
+    WIN32_FIND_DATAA fd;
+    HANDLE find = FindFirstFileA(pattern, &fd);
+    if (find == INVALID_HANDLE_VALUE) return;
+    do {
+        const char *name = fd.cFileName;
+        if (strlen(name) != 21) continue;
+#else
+    DIR *d = opendir(dir);
+    if (!d) return;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        const char *name = de->d_name;
+        if (strlen(name) != 21 || strcmp(name + 16, ".json") != 0) continue;
+#endif
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            Slot *grown = realloc(slots, capacity * sizeof(Slot));
+            if (!grown) break;
+            slots = grown;
+        }
+        
+        Slot *slot = &slots[count];
+        memcpy(slot->key, name, 16);
+        slot->key[16] = '\0';
+        
+        char path[MAX_PATH_LEN];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s%c%s", dir, PATH_SEPARATOR, name);
+        slot->used = stat(path, &st) == 0 ? st.st_mtime : 0;
+        snprintf(path, sizeof(path), "%s%c%s.body", dir, PATH_SEPARATOR, slot->key);
+        slot->size = stat(path, &st) == 0 ? (double)st.st_size : 0;
+        
+        total += slot->size;
+        count++;
+#ifdef _WIN32
+    } while (FindNextFileA(find, &fd));
+    FindClose(find);
+#else
+    }
+    closedir(d);
+#endif
+    
+    while (total > max_bytes && count > 0) {
+        int oldest = 0;
+        for (int i = 1; i < count; i++) {
+            if (slots[i].used < slots[oldest].used) oldest = i;
+        }
+        
+        char path[MAX_PATH_LEN];
+        cache_path(slots[oldest].key, "body", path, sizeof(path));
+        remove(path);
+        cache_path(slots[oldest].key, "json", path, sizeof(path));
+        remove(path);
+        
+        total -= slots[oldest].size;
+        slots[oldest] = slots[--count];
+    }
+    
+    free(slots);
+}
+
+static void cache_store(const char *url, const HttpTransfer *transfer) {
+    CacheEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    cache_key(url, entry.key);
+    snprintf(entry.etag, sizeof(entry.etag), "%s", transfer->etag);
+    snprintf(entry.last_modified, sizeof(entry.last_modified), "%s", transfer->last_modified);
+    entry.stored_at = time(NULL);
+    
+    char dir[MAX_PATH_LEN];
+    if (cache_get_dir(dir, sizeof(dir)) != 0 || make_directory_recursive(dir) != 0) {
+        return;
+    }
+    
+    char path[MAX_PATH_LEN];
+    char tmp_path[MAX_PATH_LEN];
+    if (cache_path(entry.key, "body", path, sizeof(path)) != 0) {
+        return;
+    }
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    
+    FILE *f = fopen(tmp_path, "wb");
+    if (!f) return;
+    size_t written = fwrite(transfer->response->data, 1, transfer->response->size, f);
+    fclose(f);
+    
+    if (written != transfer->response->size) {
+        remove(tmp_path);
+        return;
+    }
+    
+    remove(path);
+    if (rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+        return;
+    }
+    
+    cache_write_meta(url, &entry);
+    
+    cache_stored += (long)transfer->response->size;
+    if (!cache_scanned || cache_stored >= HTTP_CACHE_EVICT_BYTES) {
+        cache_evict();
+        cache_scanned = 1;
+        cache_stored = 0;
+    }
+}
+
+/* ============ Retry policy ============ */
+
+static long long now_ms(void) {
+#ifdef _WIN32
+    return (long long)GetTickCount64();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+static void sleep_ms(long ms) {
+    if (ms <= 0) return;
+#ifdef _WIN32
+    Sleep((DWORD)ms);
+#else
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+#endif
+}
+
+static void load_policy(void) {
+    policy.retries = config_get_long("http_retries", HTTP_DEFAULT_RETRIES);
+    policy.backoff_ms = config_get_long("http_backoff_ms", HTTP_DEFAULT_BACKOFF_MS);
+    policy.connect_timeout = config_get_long("http_connect_timeout", HTTP_DEFAULT_CONNECT_TIMEOUT);
+    policy.timeout = config_get_long("http_timeout", HTTP_DEFAULT_TIMEOUT);
+    policy.hedge = config_get_bool("http_hedge", 0);
+    policy.hedge_ms = config_get_long("http_hedge_ms", 0);
+    
+    if (policy.retries < 0) policy.retries = 0;
+    if (policy.backoff_ms < 0) policy.backoff_ms = 0;
+}
+
+/* Transient failures worth another attempt; anything else is final */
+static int is_retryable(CURLcode res, long status_code) {
+    switch (res) {
+        case CURLE_OK:
+            return status_code == 408 || status_code == 429 ||
+                   status_code == 500 || status_code == 502 ||
+                   status_code == 503 || status_code == 504;
+        case CURLE_COULDNT_RESOLVE_HOST:
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_OPERATION_TIMEDOUT:
+        case CURLE_SSL_CONNECT_ERROR:
+        case CURLE_SEND_ERROR:
+        case CURLE_RECV_ERROR:
+        case CURLE_GOT_NOTHING:
+        case CURLE_PARTIAL_FILE:
+        case CURLE_HTTP2:
+        case CURLE_HTTP2_STREAM:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/* Full-jitter exponential backoff, stretched to honour Retry-After */
+static long backoff_delay(int attempt, long retry_after_ms) {
+    long ceiling = policy.backoff_ms;
+    for (int i = 1; i < attempt && ceiling < HTTP_BACKOFF_CAP_MS; i++) {
+        ceiling *= 2;
+    }
+    if (ceiling > HTTP_BACKOFF_CAP_MS) ceiling = HTTP_BACKOFF_CAP_MS;
+    
+    long delay = (long)(ceiling * ((double)rand() / ((double)RAND_MAX + 1.0)));
+    
+    if (retry_after_ms > delay) {
+        delay = retry_after_ms < HTTP_RETRY_AFTER_CAP_MS ? retry_after_ms : HTTP_RETRY_AFTER_CAP_MS;
+    }
+    return delay;
+}
+
+static int latency_path(char *buffer, size_t size) {
+    char cache_dir[MAX_PATH_LEN];
+    if (config_get_cache_dir(cache_dir, sizeof(cache_dir)) != 0) {
+        return -1;
+    }
+    snprintf(buffer, size, "%s%c%s", cache_dir, PATH_SEPARATOR, HTTP_LATENCY_FILENAME);
+    return 0;
+}
+
+static void latency_load(void) {
+    char path[MAX_PATH_LEN];
+    if (latency_path(path, sizeof(path)) != 0) return;
+    
+    char *data = read_file(path, NULL);
+    if (!data) return;
+    
+    cJSON *samples = cJSON_Parse(data);
+    free(data);
+    
+    cJSON *item;
+    cJSON_ArrayForEach(item, samples) {
+        if (cJSON_IsNumber(item) && latency_count < HTTP_LATENCY_SAMPLES) {
+            latency_samples[latency_count++] = (long)item->valuedouble;
+        }
+    }
+    latency_next = latency_count % HTTP_LATENCY_SAMPLES;
+    cJSON_Delete(samples);
+}
+
+static void latency_save(void) {
+    if (!latency_dirty) return;
+    
+    char path[MAX_PATH_LEN];
+    char cache_dir[MAX_PATH_LEN];
+    if (latency_path(path, sizeof(path)) != 0 ||
+        config_get_cache_dir(cache_dir, sizeof(cache_dir)) != 0 ||
+        make_directory_recursive(cache_dir) != 0) {
+        return;
+    }
+    
+    /* Oldest first, so a reload keeps the ring in order */
+    cJSON *samples = cJSON_CreateArray();
+    for (int i = 0; i < latency_count; i++) {
+        int slot = (latency_next - latency_count + i + HTTP_LATENCY_SAMPLES) % HTTP_LATENCY_SAMPLES;
+        cJSON_AddItemToArray(samples, cJSON_CreateNumber((double)latency_samples[slot]));
+    }
+    
+    char *str = cJSON_PrintUnformatted(samples);
+    cJSON_Delete(samples);
+    if (!str) return;
+    
+    FILE *f = fopen(path, "w");
+    if (f) {
+        fputs(str, f);
+        fclose(f);
+    }
+    free(str);
+}
+
+static void latency_record(CURL *handle) {
+    curl_off_t total_us = 0;
+    if (curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME_T, &total_us) != CURLE_OK) {
+        return;
+    }
+    
+    latency_samples[latency_next] = (long)(total_us / 1000);
+    latency_next = (latency_next + 1) % HTTP_LATENCY_SAMPLES;
+    if (latency_count < HTTP_LATENCY_SAMPLES) latency_count++;
+    latency_dirty = 1;
+}
+
+static int compare_long(const void *a, const void *b) {
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+/* How long to wait for the first response before sending a duplicate */
+static long hedge_delay(void) {
+    if (!policy.hedge) return 0;
+    if (policy.hedge_ms > 0) return policy.hedge_ms;
+    if (latency_count < HTTP_HEDGE_MIN_SAMPLES) return HTTP_HEDGE_DEFAULT_MS;
+    
+    long sorted[HTTP_LATENCY_SAMPLES];
+    memcpy(sorted, latency_samples, latency_count * sizeof(long));
+    qsort(sorted, latency_count, sizeof(long), compare_long);
+    
+    long p95 = sorted[(latency_count * 95 - 1) / 100];
+    return p95 > HTTP_HEDGE_FLOOR_MS ? p95 : HTTP_HEDGE_FLOOR_MS;
+}
+
+/* ============ Connection reuse ============ */
+
+/*
+ * Each nex invocation is a new process, so without help every command
+ * pays a DNS lookup and a full TLS handshake to the registry. Resolved
+ * addresses are kept in hosts.json and fed back through CURLOPT_RESOLVE;
+ * where libcurl can export TLS sessions (8.12+), they are kept in
+ * tls_sessions.json so the next run can resume instead of renegotiating.
+ * Within a run, a share handle lets every easy handle use the same DNS,
+ * session and connection caches.
+ */
+
+static int net_path(const char *name, char *buffer, size_t size) {
+    char cache_dir[MAX_PATH_LEN];
+    if (config_get_cache_dir(cache_dir, sizeof(cache_dir)) != 0) {
+        return -1;
+    }
+    snprintf(buffer, size, "%s%c%s%c%s", cache_dir, PATH_SEPARATOR, HTTP_NET_DIRNAME,
+             PATH_SEPARATOR, name);
+    return 0;
+}
+
+/* Session tickets are credentials; keep them private to the user */
+static FILE* net_open_for_write(const char *name) {
+    char dir[MAX_PATH_LEN];
+    char path[MAX_PATH_LEN];
+    if (net_path("", dir, sizeof(dir)) != 0 || make_directory_recursive(dir) != 0 ||
+        net_path(name, path, sizeof(path)) != 0) {
+        return NULL;
+    }
+    
+#ifdef _WIN32
+    return fopen(path, "w");
+#else
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) return NULL;
+    FILE *f = fdopen(fd, "w");
+    if (!f) close(fd);
+    return f;
+#endif
+}
+
+static void hosts_rebuild_resolve(void) {
+    curl_slist_free_all(resolve_list);
+    resolve_list = NULL;
+    
+    for (int i = 0; i < host_count; i++) {
+        char entry[352];
+        /* '+' lets the entry expire like a normal lookup instead of pinning it */
+#if LIBCURL_VERSION_NUM >= 0x074b00
+        snprintf(entry, sizeof(entry), "+%s:%ld:%s", hosts[i].host, hosts[i].port, hosts[i].ip);
+#else
+        snprintf(entry, sizeof(entry), "%s:%ld:%s", hosts[i].host, hosts[i].port, hosts[i].ip);
+#endif
+        resolve_list = curl_slist_append(resolve_list, entry);
+    }
+}
+
+static void hosts_load(void) {
+    char path[MAX_PATH_LEN];
+    if (net_path(HTTP_HOSTS_FILENAME, path, sizeof(path)) != 0) return;
+    
+    char *data = read_file(path, NULL);
+    if (!data) return;
+    
+    cJSON *list = cJSON_Parse(data);
+    free(data);
+    
+    time_t now = time(NULL);
+    cJSON *item;
+    cJSON_ArrayForEach(item, list) {
+        cJSON *host = cJSON_GetObjectItemCaseSensitive(item, "host");
+        cJSON *port = cJSON_GetObjectItemCaseSensitive(item, "port");
+        cJSON *ip = cJSON_GetObjectItemCaseSensitive(item, "ip");
+        cJSON *stored_at = cJSON_GetObjectItemCaseSensitive(item, "stored_at");
+        
+        if (!cJSON_IsString(host) || !cJSON_IsNumber(port) || !cJSON_IsString(ip) ||
+            !cJSON_IsNumber(stored_at) || host_count >= HTTP_MAX_HOSTS) {
+            continue;
+        }
+        if (now - (time_t)stored_at->valuedouble > HTTP_DNS_TTL) {
+            hosts_dirty = 1;    /* Expired; dropped on save */
+            continue;
+        }
+        
+        HostEntry *entry = &hosts[host_count++];
+        strncpy(entry->host, host->valuestring, sizeof(entry->host) - 1);
+        entry->host[sizeof(entry->host) - 1] = '\0';
+        strncpy(entry->ip, ip->valuestring, sizeof(entry->ip) - 1);
+        entry->ip[sizeof(entry->ip) - 1] = '\0';
+        entry->port = (long)port->valuedouble;
+        entry->stored_at = (time_t)stored_at->valuedouble;
+    }
+    cJSON_Delete(list);
+    
+    hosts_rebuild_resolve();
+}
+
+static void hosts_save(void) {
+    if (!hosts_dirty) return;
+    
+    cJSON *list = cJSON_CreateArray();
+    for (int i = 0; i < host_count; i++) {
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddStringToObject(item, "host", hosts[i].host);
+        cJSON_AddNumberToObject(item, "port", (double)hosts[i].port);
+        cJSON_AddStringToObject(item, "ip", hosts[i].ip);
+        cJSON_AddNumberToObject(item, "stored_at", (double)hosts[i].stored_at);
+        cJSON_AddItemToArray(list, item);
+    }
+    
+    char *str = cJSON_PrintUnformatted(list);
+    cJSON_Delete(list);
+    if (!str) return;
+    
+    FILE *f = net_open_for_write(HTTP_HOSTS_FILENAME);
+    if (f) {
+        fputs(str, f);
+        fclose(f);
+    }
+    free(str);
+}
+
+/* Host and port a finished transfer actually talked to */
+static int transfer_host(CURL *handle, char *host, size_t size, long *port) {
+    char *url = NULL;
+    if (curl_easy_getinfo(handle, CURLINFO_EFFECTIVE_URL, &url) != CURLE_OK || !url) {
+        return -1;
+    }
+    
+    CURLU *parsed = curl_url();
+    if (!parsed) return -1;
+    
+    char *name = NULL;
+    char *port_str = NULL;
+    int result = -1;
+    if (curl_url_set(parsed, CURLUPART_URL, url, 0) == CURLUE_OK &&
+        curl_url_get(parsed, CURLUPART_HOST, &name, 0) == CURLUE_OK &&
+        curl_url_get(parsed, CURLUPART_PORT, &port_str, CURLU_DEFAULT_PORT) == CURLUE_OK) {
+        snprintf(host, size, "%s", name);
+        *port = strtol(port_str, NULL, 10);
+        result = 0;
+    }
+    
+    curl_free(name);
+    curl_free(port_str);
+    curl_url_cleanup(parsed);
+    return result;
+}
+
+static HostEntry* hosts_find(const char *host, long port) {
+    for (int i = 0; i < host_count; i++) {
+        if (hosts[i].port == port && strcmp(hosts[i].host, host) == 0) {
+            return &hosts[i];
+        }
+    }
+    return NULL;
+}
+
+/* Remember where a successful transfer connected */
+static void hosts_remember(CURL *handle) {
+    char host[256];
+    long port = 0;
+    char *ip = NULL;
+    
+    if (transfer_host(handle, host, sizeof(host), &port) != 0 ||
+        curl_easy_getinfo(handle, CURLINFO_PRIMARY_IP, &ip) != CURLE_OK ||
+        !ip || !ip[0] || strcmp(ip, host) == 0) {
+        return;     /* Literal addresses need no lookup */
+    }
+    
+    time_t now = time(NULL);
+    HostEntry *entry = hosts_find(host, port);
+    if (entry && strcmp(entry->ip, ip) == 0 && now - entry->stored_at < HTTP_DNS_TTL / 2) {
+        return;
+    }
+    
+    if (!entry) {
+        if (host_count >= HTTP_MAX_HOSTS) return;
+        entry = &hosts[host_count++];
+        snprintf(entry->host, sizeof(entry->host), "%s", host);
+        entry->port = port;
+    }
+    snprintf(entry->ip, sizeof(entry->ip), "%s", ip);
+    entry->stored_at = now;
+    hosts_dirty = 1;
+}
+
+/* The remembered address stopped answering: forget it and resolve afresh */
+static void hosts_forget(CURL *handle) {
+    char host[256];
+    long port = 0;
+    if (transfer_host(handle, host, sizeof(host), &port) != 0) return;
+    
+    HostEntry *entry = hosts_find(host, port);
+    if (!entry) return;
+    
+    *entry = hosts[--host_count];
+    hosts_dirty = 1;
+    
+    /* The address is already in the shared DNS cache; evict it there too.
+     * Handles queued on the multi handle still point at resolve_list, so
+     * it is only ever appended to while a run is in progress. */
+    char removal[300];
+    snprintf(removal, sizeof(removal), "-%s:%ld", host, port);
+    struct curl_slist *list = curl_slist_append(resolve_list, removal);
+    if (list) resolve_list = list;
+}
+
+/* Add a finished transfer to the --timings table */
+static void timing_observe(CURL *handle) {
+    curl_off_t dns = 0, connect = 0, appconnect = 0, starttransfer = 0, total = 0, bytes = 0;
+    char *url = NULL;
+    
+    curl_easy_getinfo(handle, CURLINFO_NAMELOOKUP_TIME_T, &dns);
+    curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME_T, &connect);
+    curl_easy_getinfo(handle, CURLINFO_APPCONNECT_TIME_T, &appconnect);
+    curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME_T, &starttransfer);
+    curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME_T, &total);
+    curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD_T, &bytes);
+    curl_easy_getinfo(handle, CURLINFO_EFFECTIVE_URL, &url);
+    
+    /* curl reports cumulative points in time; the table wants durations */
+    curl_off_t ready = appconnect > connect ? appconnect : connect;
+    TimingPhases phases;
+    phases.dns_ms = dns / 1000.0;
+    phases.connect_ms = connect > dns ? (connect - dns) / 1000.0 : 0;
+    phases.tls_ms = appconnect > connect ? (appconnect - connect) / 1000.0 : 0;
+    phases.ttfb_ms = starttransfer > ready ? (starttransfer - ready) / 1000.0 : 0;
+    phases.transfer_ms = total > starttransfer ? (total - starttransfer) / 1000.0 : 0;
+    phases.total_ms = total / 1000.0;
+    phases.bytes = (long long)bytes;
+    
+    timing_add("http", url, &phases);
+}
+
+/* Bookkeeping after every finished transfer, successful or not */
+static void net_observe(CURL *handle, CURLcode res) {
+    if (timing_enabled()) {
+        timing_observe(handle);
+    }
+    
+    if (res == CURLE_COULDNT_CONNECT || res == CURLE_OPERATION_TIMEDOUT) {
+        hosts_forget(handle);
+        return;
+    }
+    if (res != CURLE_OK) return;
+    
+    hosts_remember(handle);
+    
+    curl_off_t dns = 0, connect = 0, appconnect = 0;
+    long connects = 0;
+    curl_easy_getinfo(handle, CURLINFO_NAMELOOKUP_TIME_T, &dns);
+    curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME_T, &connect);
+    curl_easy_getinfo(handle, CURLINFO_APPCONNECT_TIME_T, &appconnect);
+    curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &connects);
+    
+    last_timings.dns_ms = dns / 1000.0;
+    last_timings.connect_ms = connect > dns ? (connect - dns) / 1000.0 : 0;
+    last_timings.tls_ms = appconnect > connect ? (appconnect - connect) / 1000.0 : 0;
+    last_timings.reused = connects == 0;
+}
+
+#if LIBCURL_VERSION_NUM >= 0x080c00
+
+static void hex_encode(const unsigned char *data, size_t len, char *out) {
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < len; i++) {
+        out[i * 2] = digits[data[i] >> 4];
+        out[i * 2 + 1] = digits[data[i] & 0x0f];
+    }
+    out[len * 2] = '\0';
+}
+
+static unsigned char* hex_decode(const char *hex, size_t *out_len) {
+    size_t len = strlen(hex) / 2;
+    unsigned char *data = malloc(len ? len : 1);
+    if (!data) return NULL;
+    
+    for (size_t i = 0; i < len; i++) {
+        unsigned int byte;
+        if (sscanf(hex + i * 2, "%2x", &byte) != 1) {
+            free(data);
+            return NULL;
+        }
+        data[i] = (unsigned char)byte;
+    }
+    *out_len = len;
+    return data;
+}
+
+static CURLcode session_export_cb(CURL *handle, void *userptr, const char *session_key,
+                                  const unsigned char *shmac, size_t shmac_len,
+                                  const unsigned char *sdata, size_t sdata_len,
+                                  curl_off_t valid_until, int ietf_tls_id,
+                                  const char *alpn, size_t earlydata_max) {
+    cJSON *list = (cJSON *)userptr;
+    (void)handle;
+    (void)ietf_tls_id;
+    (void)alpn;
+    (void)earlydata_max;
+    
+    if (valid_until > 0 && valid_until <= (curl_off_t)time(NULL)) {
+        return CURLE_OK;
+    }
+    
+    char *shmac_hex = malloc(shmac_len * 2 + 1);
+    char *sdata_hex = malloc(sdata_len * 2 + 1);
+    if (shmac_hex && sdata_hex) {
+        hex_encode(shmac, shmac_len, shmac_hex);
+        hex_encode(sdata, sdata_len, sdata_hex);
+        
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddStringToObject(item, "key", session_key ? session_key : "");
+        cJSON_AddStringToObject(item, "shmac", shmac_hex);
+        cJSON_AddStringToObject(item, "data", sdata_hex);
+        cJSON_AddNumberToObject(item, "valid_until", (double)valid_until);
+        cJSON_AddItemToArray(list, item);
+    }
+    free(shmac_hex);
+    free(sdata_hex);
+    return CURLE_OK;
+}
+
+static void sessions_load(void) {
+    char path[MAX_PATH_LEN];
+    if (net_path(HTTP_SESSIONS_FILENAME, path, sizeof(path)) != 0) return;
+    
+    char *data = read_file(path, NULL);
+    if (!data) return;
+    
+    cJSON *list = cJSON_Parse(data);
+    free(data);
+    
+    time_t now = time(NULL);
+    cJSON *item;
+    cJSON_ArrayForEach(item, list) {
+        cJSON *key = cJSON_GetObjectItemCaseSensitive(item, "key");
+        cJSON *shmac = cJSON_GetObjectItemCaseSensitive(item, "shmac");
+        cJSON *sdata = cJSON_GetObjectItemCaseSensitive(item, "data");
+        cJSON *valid_until = cJSON_GetObjectItemCaseSensitive(item, "valid_until");
+        
+        if (!cJSON_IsString(key) || !cJSON_IsString(shmac) || !cJSON_IsString(sdata)) continue;
+        if (cJSON_IsNumber(valid_until) && valid_until->valuedouble > 0 &&
+            valid_until->valuedouble <= (double)now) {
+            continue;
+        }
+        
+        size_t shmac_len = 0, sdata_len = 0;
+        unsigned char *shmac_bytes = hex_decode(shmac->valuestring, &shmac_len);
+        unsigned char *sdata_bytes = hex_decode(sdata->valuestring, &sdata_len);
+        if (shmac_bytes && sdata_bytes) {
+            curl_easy_ssls_import(curl_handle, key->valuestring[0] ? key->valuestring : NULL,
+                                  shmac_bytes, shmac_len, sdata_bytes, sdata_len);
+        }
+        free(shmac_bytes);
+        free(sdata_bytes);
+    }
+    cJSON_Delete(list);
+}
+
+static void sessions_save(void) {
+    cJSON *list = cJSON_CreateArray();
+    
+    curl_easy_setopt(curl_handle, CURLOPT_SHARE, share_handle);
+    if (curl_easy_ssls_export(curl_handle, session_export_cb, list) != CURLE_OK ||
+        cJSON_GetArraySize(list) == 0) {
+        cJSON_Delete(list);
+        return;
+    }
+    
+    char *str = cJSON_PrintUnformatted(list);
+    cJSON_Delete(list);
+    if (!str) return;
+    
+    FILE *f = net_open_for_write(HTTP_SESSIONS_FILENAME);
+    if (f) {
+        fputs(str, f);
+        fclose(f);
+    }
+    free(str);
+}
+
+#else
+
+/* This libcurl cannot export TLS sessions; they are shared within a run only */
+static void sessions_load(void) {}
+static void sessions_save(void) {}
+
+#endif
+
+static int net_init(void) {
+    share_handle = curl_share_init();
+    if (!share_handle) {
+        return -1;
+    }
+    
+    curl_share_setopt(share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    curl_easy_setopt(curl_handle, CURLOPT_SHARE, share_handle);
+    
+    if (config_get_bool("http_net_cache", 1)) {
+        hosts_load();
+        sessions_load();
+    }
+    return 0;
+}
+
+static void net_cleanup(void) {
+    if (config_get_bool("http_net_cache", 1)) {
+        hosts_save();
+        sessions_save();
+    }
+    curl_slist_free_all(resolve_list);
+    resolve_list = NULL;
+}
+
+void http_set_offline(int enabled) {
+    offline = enabled;
+}
 
-/* Memory write callback for curl */
-static size_t write_callback(void *contents, size_t size, size_t nmemb, void *userp) {
-    size_t realsize = size * nmemb;
-    HttpResponse *response = (HttpResponse *)userp;
+int http_is_offline(void) {
+    return offline;
+}
+
+void http_get_timings(HttpTimings *timings) {
+    if (timings) {
+        *timings = last_timings;
+    }
+}
+
+/* ============ Transfers ============ */
+
+static void set_timeouts(CURL *handle) {
+    curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT, policy.connect_timeout);
+    curl_easy_setopt(handle, CURLOPT_LOW_SPEED_LIMIT, HTTP_LOW_SPEED_LIMIT);
+    curl_easy_setopt(handle, CURLOPT_LOW_SPEED_TIME, HTTP_LOW_SPEED_TIME);
     
-    char *ptr = realloc(response->data, response->size + realsize + 1);
-    if (!ptr) {
-        print_error("Out of memory");
-        return 0;
+    /* Every transfer goes through here, so this is also where handles
+     * join the shared caches */
+    curl_easy_setopt(handle, CURLOPT_SHARE, share_handle);
+    if (resolve_list) {
+        curl_easy_setopt(handle, CURLOPT_RESOLVE, resolve_list);
     }
+}
+
+/* Advertise only the encodings this libcurl build can decode, best first */
+static const char* accept_encoding(void) {
+    static char value[32];
+    static int initialized = 0;
     
-    response->data = ptr;
-    memcpy(&(response->data[response->size]), contents, realsize);
-    response->size += realsize;
-    response->data[response->size] = '\0';
+    if (!initialized) {
+        curl_version_info_data *info = curl_version_info(CURLVERSION_NOW);
+        value[0] = '\0';
+#ifdef CURL_VERSION_ZSTD
+        if (info->features & CURL_VERSION_ZSTD) strcat(value, "zstd, ");
+#endif
+        if (info->features & CURL_VERSION_BROTLI) strcat(value, "br, ");
+        if (info->features & CURL_VERSION_LIBZ) strcat(value, "gzip, ");
+        
+        size_t len = strlen(value);
+        if (len >= 2) value[len - 2] = '\0';
+        initialized = 1;
+    }
     
-    return realsize;
+    return value[0] ? value : NULL;
+}
+
+/* Options shared by single and batched requests */
+static void setup_handle(CURL *handle, HttpTransfer *transfer) {
+    transfer->handle = handle;
+    curl_easy_setopt(handle, CURLOPT_URL, transfer->url);
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(handle, CURLOPT_WRITEDATA, transfer);
+    curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, header_callback);
+    curl_easy_setopt(handle, CURLOPT_HEADERDATA, transfer);
+    curl_easy_setopt(handle, CURLOPT_USERAGENT, NEX_USER_AGENT);
+    curl_easy_setopt(handle, CURLOPT_ACCEPT_ENCODING, accept_encoding());
+    curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(handle, CURLOPT_SSL_VERIFYPEER, 1L);
+    set_timeouts(handle);
+    if (policy.timeout > 0) {
+        curl_easy_setopt(handle, CURLOPT_TIMEOUT, policy.timeout);
+    }
+    
+    /* Revalidate a stale cache entry instead of downloading it again */
+    if (transfer->cached.valid) {
+        char header[320];
+        if (transfer->cached.etag[0]) {
+            snprintf(header, sizeof(header), "If-None-Match: %s", transfer->cached.etag);
+            transfer->headers = curl_slist_append(transfer->headers, header);
+        }
+        if (transfer->cached.last_modified[0]) {
+            snprintf(header, sizeof(header), "If-Modified-Since: %s", transfer->cached.last_modified);
+            transfer->headers = curl_slist_append(transfer->headers, header);
+        }
+        if (transfer->headers) {
+            curl_easy_setopt(handle, CURLOPT_HTTPHEADER, transfer->headers);
+        }
+    }
+}
+
+/*
+ * Prepare a transfer. Returns 1 when the cache already answered
+ * (transfer->response is filled in), 0 when a network request is needed.
+ */
+static int transfer_begin(HttpTransfer *transfer, const char *url) {
+    memset(transfer, 0, sizeof(HttpTransfer));
+    transfer->url = url;
+    
+    if (offline) {
+        /* However old the cached copy is, it is the only one we can have */
+        if (cache_lookup(url, &transfer->cached) == 0) {
+            transfer->response = cache_load(&transfer->cached);
+            if (transfer->response) {
+                return 1;
+            }
+        }
+        print_error("Not available offline: %s", url);
+        return -1;
+    }
+    
+    if (cache_enabled() && cache_lookup(url, &transfer->cached) == 0) {
+        if (cache_is_fresh(&transfer->cached)) {
+            transfer->response = cache_load(&transfer->cached);
+            if (transfer->response) {
+                if (timing_enabled()) {
+                    TimingPhases phases;
+                    memset(&phases, 0, sizeof(phases));
+                    phases.bytes = (long long)transfer->response->size;
+                    timing_add("cache", url, &phases);
+                }
+                return 1;
+            }
+            transfer->cached.valid = 0;
+        } else if (!transfer->cached.etag[0] && !transfer->cached.last_modified[0]) {
+            transfer->cached.valid = 0;  /* Nothing to revalidate with */
+        }
+    }
+    
+    transfer->response = response_new();
+    return transfer->response ? 0 : -1;
+}
+
+/* Forget what a failed attempt received before trying again */
+static void transfer_rewind(HttpTransfer *transfer) {
+    transfer->response->size = 0;
+    transfer->response->data[0] = '\0';
+    transfer->etag[0] = '\0';
+    transfer->last_modified[0] = '\0';
+    transfer->encoded = 0;
+    transfer->retry_after_ms = 0;
+    curl_slist_free_all(transfer->headers);
+    transfer->headers = NULL;
+}
+
+/* Settle a finished transfer against the cache; returns the final response */
+static HttpResponse* transfer_finish(HttpTransfer *transfer, CURL *handle, CURLcode res) {
+    HttpResponse *response = transfer->response;
+    transfer->response = NULL;
+    
+    curl_slist_free_all(transfer->headers);
+    transfer->headers = NULL;
+    
+    if (res != CURLE_OK) {
+        http_response_free(response);
+        return NULL;
+    }
+    
+    curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &response->status_code);
+    latency_record(handle);
+    
+    if (response->status_code == 304 && transfer->cached.valid) {
+        HttpResponse *cached = cache_load(&transfer->cached);
+        if (cached) {
+            http_response_free(response);
+            transfer->cached.stored_at = time(NULL);
+            cache_write_meta(transfer->url, &transfer->cached);
+            return cached;
+        }
+    }
+    
+    if (response->status_code == 200 && cache_enabled()) {
+        transfer->response = response;
+        cache_store(transfer->url, transfer);
+        transfer->response = NULL;
+    }
+    
+    return response;
+}
+
+static CURLM* get_multi_handle(void) {
+    if (!multi_handle) {
+        multi_handle = curl_multi_init();
+        if (multi_handle) {
+            curl_multi_setopt(multi_handle, CURLMOPT_PIPELINING, (long)CURLPIPE_MULTIPLEX);
+        }
+    }
+    return multi_handle;
 }
 
 int http_init(void) {
@@ -37,51 +1292,697 @@ int http_init(void) {
         return -1;
     }
     
+    srand((unsigned int)time(NULL) ^ (unsigned int)getpid());
+    load_policy();
+    latency_load();
+    
+    if (net_init() != 0) {
+        curl_easy_cleanup(curl_handle);
+        curl_handle = NULL;
+        curl_global_cleanup();
+        return -1;
+    }
+    
     return 0;
 }
 
 void http_cleanup(void) {
+    latency_save();
+    if (curl_handle) {
+        net_cleanup();
+    }
+    
+    if (multi_handle) {
+        curl_multi_cleanup(multi_handle);
+        multi_handle = NULL;
+    }
     if (curl_handle) {
         curl_easy_cleanup(curl_handle);
         curl_handle = NULL;
     }
+    if (share_handle) {
+        curl_share_cleanup(share_handle);
+        share_handle = NULL;
+    }
     curl_global_cleanup();
 }
 
+/*
+ * Run one attempt of a single request. With hedging enabled, a duplicate
+ * is started if no answer arrived within the hedge delay, and whichever
+ * copy finishes first with a usable answer wins; its body ends up in
+ * transfer->response.
+ */
+static CURLcode perform_hedged(HttpTransfer *transfer, CURL **winner) {
+    CURLM *multi = get_multi_handle();
+    if (!multi) {
+        return CURLE_OUT_OF_MEMORY;
+    }
+    
+    HttpTransfer copies[2];
+    CURL *handles[2] = { NULL, NULL };
+    int running[2] = { 0, 0 };
+    CURLcode results[2] = { CURLE_OK, CURLE_OK };
+    int done = -1;
+    
+    copies[0] = *transfer;
+    copies[1] = *transfer;
+    copies[1].response = NULL;
+    copies[1].headers = NULL;
+    
+    long delay = hedge_delay();
+    long long started = now_ms();
+    
+    *winner = NULL;
+    handles[0] = curl_easy_init();
+    if (!handles[0]) {
+        return CURLE_OUT_OF_MEMORY;
+    }
+    setup_handle(handles[0], &copies[0]);
+    curl_multi_add_handle(multi, handles[0]);
+    running[0] = 1;
+    
+    while (done < 0 && (running[0] || running[1])) {
+        int still_running = 0;
+        if (curl_multi_perform(multi, &still_running) != CURLM_OK) {
+            break;
+        }
+        
+        CURLMsg *msg;
+        int pending;
+        while ((msg = curl_multi_info_read(multi, &pending)) != NULL) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            
+            int i = msg->easy_handle == handles[0] ? 0 : 1;
+            long status_code = 0;
+            curl_easy_getinfo(handles[i], CURLINFO_RESPONSE_CODE, &status_code);
+            
+            results[i] = msg->data.result;
+            running[i] = 0;
+            curl_multi_remove_handle(multi, handles[i]);
+            net_observe(handles[i], results[i]);
+            
+            /* A transient failure of one copy still leaves the other in the race */
+            if (!is_retryable(results[i], status_code) || (!running[0] && !running[1])) {
+                done = i;
+                break;
+            }
+        }
+        
+        /* Primary is slow: fire the duplicate */
+        if (done < 0 && delay > 0 && !handles[1] && now_ms() - started >= delay) {
+            copies[1].response = response_new();
+            handles[1] = copies[1].response ? curl_easy_init() : NULL;
+            if (handles[1]) {
+                setup_handle(handles[1], &copies[1]);
+                curl_multi_add_handle(multi, handles[1]);
+                running[1] = 1;
+            }
+        }
+        
+        if (done < 0 && (running[0] || running[1])) {
+            long wait = 1000;
+            if (delay > 0 && !handles[1]) {
+                long remaining = (long)(started + delay - now_ms());
+                wait = remaining < wait ? (remaining > 0 ? remaining : 0) : wait;
+            }
+            curl_multi_poll(multi, NULL, 0, (int)wait, NULL);
+        }
+    }
+    
+    /* The multi loop itself failed; settle on the primary */
+    if (done < 0) {
+        done = 0;
+        if (running[0]) {
+            curl_multi_remove_handle(multi, handles[0]);
+            results[0] = CURLE_RECV_ERROR;
+        }
+    }
+    
+    /* Stop the loser and hand the winner's state back to the caller */
+    int loser = 1 - done;
+    if (handles[loser]) {
+        if (running[loser]) curl_multi_remove_handle(multi, handles[loser]);
+        curl_easy_cleanup(handles[loser]);
+    }
+    curl_slist_free_all(copies[loser].headers);
+    http_response_free(copies[loser].response);
+    
+    *transfer = copies[done];
+    *winner = handles[done];
+    return results[done];
+}
+
 HttpResponse* http_get(const char *url) {
     if (!curl_handle || !url) {
         return NULL;
     }
     
-    HttpResponse *response = calloc(1, sizeof(HttpResponse));
-    if (!response) {
+    HttpTransfer transfer;
+    int cached = transfer_begin(&transfer, url);
+    if (cached != 0) {
+        return cached > 0 ? transfer.response : NULL;
+    }
+    
+    CURL *handle = NULL;
+    CURLcode res;
+    
+    for (int attempt = 1; ; attempt++) {
+        res = perform_hedged(&transfer, &handle);
+        
+        long status_code = 0;
+        if (handle) {
+            curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &status_code);
+        }
+        if (!handle || attempt > policy.retries || !is_retryable(res, status_code)) {
+            break;
+        }
+        
+        sleep_ms(backoff_delay(attempt, transfer.retry_after_ms));
+        curl_easy_cleanup(handle);
+        handle = NULL;
+        transfer_rewind(&transfer);
+    }
+    
+    if (res != CURLE_OK) {
+        print_error("HTTP request failed: %s", curl_easy_strerror(res));
+    }
+    
+    if (!handle) {
+        curl_slist_free_all(transfer.headers);
+        http_response_free(transfer.response);
         return NULL;
     }
     
-    response->data = malloc(1);
-    response->size = 0;
-    response->data[0] = '\0';
+    HttpResponse *response = transfer_finish(&transfer, handle, res);
+    curl_easy_cleanup(handle);
+    return response;
+}
+
+/* Put a transfer of a batch on the multi handle */
+static int add_transfer(HttpTransfer *transfers, int index, CURL **handles) {
+    HttpTransfer *transfer = &transfers[index];
+    
+    CURL *handle = curl_easy_init();
+    if (!handle) {
+        return -1;
+    }
+    
+    setup_handle(handle, transfer);
+    
+    /* Prefer HTTP/2 and wait for an existing connection to multiplex on
+     * rather than opening a new one per request */
+    curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);
+    curl_easy_setopt(handle, CURLOPT_PRIVATE, (char *)(size_t)index);
+    
+    if (curl_multi_add_handle(multi_handle, handle) != CURLM_OK) {
+        curl_easy_cleanup(handle);
+        curl_slist_free_all(transfer->headers);
+        transfer->headers = NULL;
+        return -1;
+    }
+    
+    handles[index] = handle;
+    return 0;
+}
+
+/* Start the next queued transfer of a batch */
+static int start_transfer(HttpTransfer *transfers, int index, HttpResponse **responses, CURL **handles) {
+    HttpTransfer *transfer = &transfers[index];
+    
+    if (!transfer->url) {
+        return -1;  /* Caller left this slot empty */
+    }
     
-    curl_easy_reset(curl_handle);
-    curl_easy_setopt(curl_handle, CURLOPT_URL, url);
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, write_callback);
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, response);
-    curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, NEX_USER_AGENT);
-    curl_easy_setopt(curl_handle, CURLOPT_FOLLOWLOCATION, 1L);
-    curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT, 30L);
-    curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYPEER, 1L);
+    int cached = transfer_begin(transfer, transfer->url);
+    if (cached != 0) {
+        responses[index] = cached > 0 ? transfer->response : NULL;
+        transfer->response = NULL;
+        return 1;
+    }
+    
+    if (add_transfer(transfers, index, handles) != 0) {
+        http_response_free(transfer->response);
+        transfer->response = NULL;
+        return -1;
+    }
+    
+    return 0;
+}
+
+/* Keep the window full; cache hits complete without occupying a slot */
+static void fill_window(HttpTransfer *transfers, int count, int max_parallel,
+                        HttpResponse **responses, CURL **handles, int *next, int *active) {
+    while (*next < count && *active < max_parallel) {
+        if (start_transfer(transfers, *next, responses, handles) == 0) {
+            (*active)++;
+        }
+        (*next)++;
+    }
+}
+
+HttpResponse** http_get_many(const char **urls, int count, int max_parallel) {
+    if (!urls || count <= 0 || !get_multi_handle()) {
+        return NULL;
+    }
+    
+    HttpResponse **responses = calloc(count, sizeof(HttpResponse *));
+    HttpTransfer *transfers = calloc(count, sizeof(HttpTransfer));
+    CURL **handles = calloc(count, sizeof(CURL *));
+    if (!responses || !transfers || !handles) {
+        free(responses);
+        free(transfers);
+        free(handles);
+        return NULL;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        transfers[i].url = urls[i];
+    }
+    
+    if (max_parallel <= 0) max_parallel = HTTP_MAX_PARALLEL;
+    
+    int next = 0;
+    int active = 0;     /* On the multi handle or waiting out a backoff */
+    
+    fill_window(transfers, count, max_parallel, responses, handles, &next, &active);
+    
+    while (active > 0) {
+        int running = 0;
+        if (curl_multi_perform(multi_handle, &running) != CURLM_OK) {
+            break;
+        }
+        
+        CURLMsg *msg;
+        int pending;
+        while ((msg = curl_multi_info_read(multi_handle, &pending)) != NULL) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            
+            CURL *handle = msg->easy_handle;
+            CURLcode res = msg->data.result;
+            char *priv = NULL;
+            curl_easy_getinfo(handle, CURLINFO_PRIVATE, &priv);
+            int index = (int)(size_t)priv;
+            HttpTransfer *transfer = &transfers[index];
+            
+            long status_code = 0;
+            curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &status_code);
+            curl_multi_remove_handle(multi_handle, handle);
+            net_observe(handle, res);
+            
+            /* Park a transient failure until its backoff expires */
+            if (transfer->attempts < policy.retries && is_retryable(res, status_code)) {
+                transfer->attempts++;
+                transfer->retry_at = now_ms() + backoff_delay(transfer->attempts, transfer->retry_after_ms);
+                transfer_rewind(transfer);
+                curl_easy_cleanup(handle);
+                handles[index] = NULL;
+                continue;
+            }
+            
+            if (res != CURLE_OK) {
+                print_error("HTTP request failed: %s (%s)",
+                    curl_easy_strerror(res), urls[index]);
+            }
+            responses[index] = transfer_finish(transfer, handle, res);
+            
+            curl_easy_cleanup(handle);
+            handles[index] = NULL;
+            active--;
+            
+            fill_window(transfers, count, max_parallel, responses, handles, &next, &active);
+        }
+        
+        /* Restart parked transfers whose backoff has expired */
+        long long now = now_ms();
+        long wait = 1000;
+        for (int i = 0; i < next; i++) {
+            if (!transfers[i].retry_at) continue;
+            
+            if (transfers[i].retry_at <= now) {
+                transfers[i].retry_at = 0;
+                if (add_transfer(transfers, i, handles) != 0) {
+                    http_response_free(transfers[i].response);
+                    transfers[i].response = NULL;
+                    active--;
+                }
+            } else if (transfers[i].retry_at - now < wait) {
+                wait = (long)(transfers[i].retry_at - now);
+            }
+        }
+        fill_window(transfers, count, max_parallel, responses, handles, &next, &active);
+        
+        if (active > 0) {
+            curl_multi_poll(multi_handle, NULL, 0, (int)wait, NULL);
+        }
+    }
+    
+    /* Abandon anything still in flight if the multi loop failed */
+    for (int i = 0; i < count; i++) {
+        if (handles[i]) {
+            curl_multi_remove_handle(multi_handle, handles[i]);
+            curl_easy_cleanup(handles[i]);
+        }
+        if (transfers[i].response) {
+            curl_slist_free_all(transfers[i].headers);
+            http_response_free(transfers[i].response);
+        }
+    }
+    free(handles);
+    free(transfers);
     
-    CURLcode res = curl_easy_perform(curl_handle);
+    return responses;
+}
+
+/* ============ Streaming ============ */
+
+typedef struct {
+    CURL *handle;
+    HttpSink sink;
+    void *ctx;
+    long status_code;
+    size_t delivered;       /* Bytes already handed to the sink */
+} HttpStream;
+
+static size_t stream_callback(void *contents, size_t size, size_t nmemb, void *userp) {
+    size_t realsize = size * nmemb;
+    HttpStream *stream = (HttpStream *)userp;
+    
+    /* Error bodies are not handed to the sink */
+    if (stream->status_code == 0) {
+        curl_easy_getinfo(stream->handle, CURLINFO_RESPONSE_CODE, &stream->status_code);
+    }
+    if (stream->status_code < 200 || stream->status_code >= 300) {
+        return realsize;
+    }
+    
+    stream->delivered += realsize;
+    return stream->sink((const char *)contents, realsize, stream->ctx) == 0 ? realsize : 0;
+}
+
+long http_get_stream(const char *url, HttpSink sink, void *ctx) {
+    if (!curl_handle || !url || !sink) {
+        return -1;
+    }
+    if (offline) {
+        print_error("Not available offline: %s", url);
+        return -1;
+    }
+    
+    HttpStream stream = { curl_handle, sink, ctx, 0, 0 };
+    CURLcode res;
+    
+    /* Failures are retried only until the sink has seen a byte */
+    for (int attempt = 1; ; attempt++) {
+        stream.status_code = 0;
+        
+        curl_easy_reset(curl_handle);
+        curl_easy_setopt(curl_handle, CURLOPT_URL, url);
+        curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, stream_callback);
+        curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, &stream);
+        curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, NEX_USER_AGENT);
+        curl_easy_setopt(curl_handle, CURLOPT_ACCEPT_ENCODING, accept_encoding());
+        curl_easy_setopt(curl_handle, CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYPEER, 1L);
+        set_timeouts(curl_handle);
+        
+        res = curl_easy_perform(curl_handle);
+        net_observe(curl_handle, res);
+        curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &stream.status_code);
+        
+        if (stream.delivered > 0 || attempt > policy.retries || !is_retryable(res, stream.status_code)) {
+            break;
+        }
+        sleep_ms(backoff_delay(attempt, 0));
+    }
     
     if (res != CURLE_OK) {
         print_error("HTTP request failed: %s", curl_easy_strerror(res));
-        http_response_free(response);
-        return NULL;
+        return -1;
     }
     
-    curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &response->status_code);
+    return stream.status_code;
+}
+
+/* Sink that writes each chunk straight to a file descriptor */
+static int fd_sink(const char *data, size_t size, void *ctx) {
+    int fd = *(int *)ctx;
+    
+    while (size > 0) {
+        long written = (long)write(fd, data, size);
+        if (written <= 0) {
+            return -1;
+        }
+        data += written;
+        size -= (size_t)written;
+    }
     
-    return response;
+    return 0;
+}
+
+long http_download_to_fd(const char *url, int fd) {
+    return http_get_stream(url, fd_sink, &fd);
+}
+
+/* ============ Resumable downloads ============ */
+
+/*
+ * A download in progress lives in <path>.part, with the URL and the
+ * validator (ETag, else Last-Modified) it was fetched under kept in
+ * <path>.part.json. A retry resumes with Range + If-Range, so the server
+ * either continues the same representation (206) or sends a fresh one (200).
+ * The range goes out as CURLOPT_RANGE: with CURLOPT_RESUME_FROM libcurl
+ * itself rejects a 200 (CURLE_RANGE_ERROR) before the body can replace
+ * the stale .part.
+ */
+typedef struct {
+    CURL *handle;
+    FILE *fp;
+    const char *part_path;
+    const char *meta_path;
+    const char *url;
+    char etag[256];
+    char last_modified[64];
+    long status_code;
+    long retry_after_ms;
+    int failed_write;
+} HttpDownload;
+
+static size_t download_header_callback(char *buffer, size_t size, size_t nitems, void *userp) {
+    size_t len = size * nitems;
+    HttpDownload *download = (HttpDownload *)userp;
+    
+    /* Headers of a redirect are not the ones we want to keep */
+    if (len > 5 && strncasecmp(buffer, "HTTP/", 5) == 0) {
+        download->etag[0] = '\0';
+        download->last_modified[0] = '\0';
+    } else if (len > 5 && strncasecmp(buffer, "ETag:", 5) == 0) {
+        copy_header_value(buffer + 5, len - 5, download->etag, sizeof(download->etag));
+    } else if (len > 14 && strncasecmp(buffer, "Last-Modified:", 14) == 0) {
+        copy_header_value(buffer + 14, len - 14, download->last_modified, sizeof(download->last_modified));
+    } else if (len > 12 && strncasecmp(buffer, "Retry-After:", 12) == 0) {
+        download->retry_after_ms = strtol(buffer + 12, NULL, 10) * 1000;
+    }
+    
+    return len;
+}
+
+static void download_write_meta(const HttpDownload *download) {
+    cJSON *meta = cJSON_CreateObject();
+    cJSON_AddStringToObject(meta, "url", download->url);
+    if (download->etag[0]) cJSON_AddStringToObject(meta, "etag", download->etag);
+    if (download->last_modified[0]) cJSON_AddStringToObject(meta, "last_modified", download->last_modified);
+    
+    char *str = cJSON_PrintUnformatted(meta);
+    cJSON_Delete(meta);
+    if (!str) return;
+    
+    FILE *f = fopen(download->meta_path, "w");
+    if (f) {
+        fputs(str, f);
+        fclose(f);
+    }
+    free(str);
+}
+
+static size_t download_write_callback(void *contents, size_t size, size_t nmemb, void *userp) {
+    size_t realsize = size * nmemb;
+    HttpDownload *download = (HttpDownload *)userp;
+    
+    if (download->status_code == 0) {
+        curl_easy_getinfo(download->handle, CURLINFO_RESPONSE_CODE, &download->status_code);
+        
+        if (download->status_code == 200) {
+            /* Full body: the range was ignored or the file changed, start over */
+            FILE *fp = freopen(download->part_path, "wb", download->fp);
+            download->fp = fp;
+            if (!fp) {
+                download->failed_write = 1;
+                return 0;
+            }
+        }
+        if (download->status_code == 200 || download->status_code == 206) {
+            download_write_meta(download);
+        }
+    }
+    
+    if (download->status_code != 200 && download->status_code != 206) {
+        return realsize;  /* Discard error bodies */
+    }
+    
+    if (fwrite(contents, 1, realsize, download->fp) != realsize) {
+        download->failed_write = 1;
+        return 0;
+    }
+    
+    return realsize;
+}
+
+/* Bytes already downloaded for url, or 0 if the partial file can't be resumed */
+static long long download_resume_offset(HttpDownload *download) {
+    char *data = read_file(download->meta_path, NULL);
+    if (!data) return 0;
+    
+    cJSON *meta = cJSON_Parse(data);
+    free(data);
+    if (!meta) return 0;
+    
+    cJSON *url = cJSON_GetObjectItemCaseSensitive(meta, "url");
+    cJSON *etag = cJSON_GetObjectItemCaseSensitive(meta, "etag");
+    cJSON *last_modified = cJSON_GetObjectItemCaseSensitive(meta, "last_modified");
+    
+    if (cJSON_IsString(url) && strcmp(url->valuestring, download->url) == 0) {
+        if (cJSON_IsString(etag)) {
+            strncpy(download->etag, etag->valuestring, sizeof(download->etag) - 1);
+        }
+        if (cJSON_IsString(last_modified)) {
+            strncpy(download->last_modified, last_modified->valuestring, sizeof(download->last_modified) - 1);
+        }
+    }
+    cJSON_Delete(meta);
+    
+    if (!download->etag[0] && !download->last_modified[0]) {
+        return 0;
+    }
+    
+    struct stat st;
+    if (stat(download->part_path, &st) != 0) {
+        return 0;
+    }
+    
+    return (long long)st.st_size;
+}
+
+long http_download_resumable(const char *url, const char *path) {
+    if (!curl_handle || !url || !path) {
+        return -1;
+    }
+    if (offline) {
+        print_error("Not available offline: %s", url);
+        return -1;
+    }
+    
+    char part_path[MAX_PATH_LEN];
+    char meta_path[MAX_PATH_LEN];
+    snprintf(part_path, sizeof(part_path), "%s.part", path);
+    snprintf(meta_path, sizeof(meta_path), "%s.part.json", path);
+    
+    for (int attempt = 1; attempt <= HTTP_DOWNLOAD_ATTEMPTS; attempt++) {
+        HttpDownload download;
+        memset(&download, 0, sizeof(download));
+        download.handle = curl_handle;
+        download.part_path = part_path;
+        download.meta_path = meta_path;
+        download.url = url;
+        
+        long long offset = download_resume_offset(&download);
+        
+        download.fp = fopen(part_path, offset > 0 ? "ab" : "wb");
+        if (!download.fp) {
+            return -2;
+        }
+        
+        struct curl_slist *headers = NULL;
+        
+        curl_easy_reset(curl_handle);
+        curl_easy_setopt(curl_handle, CURLOPT_URL, url);
+        curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, download_write_callback);
+        curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, &download);
+        curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, download_header_callback);
+        curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, &download);
+        curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, NEX_USER_AGENT);
+        curl_easy_setopt(curl_handle, CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYPEER, 1L);
+        set_timeouts(curl_handle);
+        
+        char range[32];
+        if (offset > 0) {
+            char header[320];
+            snprintf(header, sizeof(header), "If-Range: %s",
+                download.etag[0] ? download.etag : download.last_modified);
+            headers = curl_slist_append(headers, header);
+            curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headers);
+            snprintf(range, sizeof(range), "%lld-", offset);
+            curl_easy_setopt(curl_handle, CURLOPT_RANGE, range);
+            print_info("Resuming download at %lld bytes", offset);
+        }
+        
+        CURLcode res = curl_easy_perform(curl_handle);
+        curl_slist_free_all(headers);
+        net_observe(curl_handle, res);
+        
+        if (download.status_code == 0) {
+            curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &download.status_code);
+        }
+        
+        int closed = download.fp ? fclose(download.fp) : 0;
+        
+        if (download.failed_write || closed != 0) {
+            return -2;
+        }
+        
+        if (res == CURLE_OK && (download.status_code == 200 || download.status_code == 206)) {
+            remove(path);
+            if (rename(part_path, path) != 0) {
+                return -2;
+            }
+            remove(meta_path);
+            return 200;
+        }
+        
+        if (res == CURLE_RANGE_ERROR) {
+            /* The server could not continue the .part; start again from 0 */
+            remove(part_path);
+            remove(meta_path);
+            continue;
+        }
+        
+        if (res == CURLE_OK || res == CURLE_HTTP_RETURNED_ERROR) {
+            if (download.status_code == 416) {
+                /* Our partial file no longer lines up with the server's; drop it */
+                remove(part_path);
+                remove(meta_path);
+                continue;
+            }
+            if (is_retryable(res, download.status_code) && attempt < HTTP_DOWNLOAD_ATTEMPTS) {
+                /* Server is overloaded; the .part is still good once it recovers */
+                sleep_ms(backoff_delay(attempt, download.retry_after_ms));
+                continue;
+            }
+            remove(part_path);
+            remove(meta_path);
+            return download.status_code;
+        }
+        
+        /* Transfer died part way: keep the .part and resume from it */
+        print_error("Download interrupted: %s", curl_easy_strerror(res));
+        if (attempt < HTTP_DOWNLOAD_ATTEMPTS) {
+            sleep_ms(backoff_delay(attempt, 0));
+        }
+    }
+    
+    return -1;
 }
 
 void http_response_free(HttpResponse *response) {
@@ -92,3 +1993,12 @@ void http_response_free(HttpResponse *response) {
         free(response);
     }
 }
+
+void http_responses_free(HttpResponse **responses, int count) {
+    if (!responses) return;
+    
+    for (int i = 0; i < count; i++) {
+        http_response_free(responses[i]);
+    }
+    free(responses);
+}
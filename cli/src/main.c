@@ -31,85 +31,42 @@ static void print_banner(void) {
     printf("\n");
 }
 
-/* Get version string from a command */
-static int get_version_string(const char *cmd, char *version, size_t size) {
-    FILE *fp;
-    char full_cmd[256];
-    
-#ifdef _WIN32
-    snprintf(full_cmd, sizeof(full_cmd), "%s 2>nul", cmd);
-    fp = _popen(full_cmd, "r");
-#else
-    snprintf(full_cmd, sizeof(full_cmd), "%s 2>/dev/null", cmd);
-    fp = popen(full_cmd, "r");
-#endif
-    
-    if (!fp) return -1;
-    
-    if (fgets(version, (int)size, fp) == NULL) {
-#ifdef _WIN32
-        _pclose(fp);
-#else
-        pclose(fp);
-#endif
-        return -1;
-    }
-    
-#ifdef _WIN32
-    _pclose(fp);
-#else
-    pclose(fp);
-#endif
-    
-    /* Remove trailing newline */
-    size_t len = strlen(version);
-    while (len > 0 && (version[len-1] == '\n' || version[len-1] == '\r')) {
-        version[--len] = '\0';
+/* One runtime line: its version, or why there is none */
+static void print_runtime(const char *label, const RuntimeProbe *probe, const char *version) {
+    if (probe->timed_out) {
+        printf("  \033[31m✗\033[0m %-10s \033[90mnot responding\033[0m\n", label);
+    } else if (probe->found) {
+        printf("  \033[32m✓\033[0m %-10s %s\n", label,
+               probe->version[0] ? version : "\033[90mversion unknown\033[0m");
+    } else {
+        printf("  \033[31m✗\033[0m %-10s \033[90mnot installed\033[0m\n", label);
     }
-    
-    return 0;
 }
 
 static void print_runtimes(void) {
-    char version[128];
-    int found_any = 0;
+    RuntimeProbe probes[3];
+    memset(probes, 0, sizeof(probes));
     
-    printf("\033[33mInstalled Runtimes:\033[0m\n");
-    
-    /* Python */
+    /* All three are asked at once; answers mostly come from the cache */
 #ifdef _WIN32
-    if (get_version_string("python --version", version, sizeof(version)) == 0) {
+    probes[0].program = "python";
 #else
-    if (get_version_string("python3 --version", version, sizeof(version)) == 0 ||
-        get_version_string("python --version", version, sizeof(version)) == 0) {
+    probes[0].program = process_find_program("python3", NULL, 0) == 0 ? "python3" : "python";
 #endif
-        printf("  \033[32m✓\033[0m Python     %s\n", version);
-        found_any = 1;
-    } else {
-        printf("  \033[31m✗\033[0m Python     \033[90mnot installed\033[0m\n");
-    }
+    probes[1].program = "node";
+    probes[2].program = "git";
+    runtime_probe_all(probes, 3, 1);
     
-    /* Node.js */
-    if (get_version_string("node --version", version, sizeof(version)) == 0) {
-        printf("  \033[32m✓\033[0m Node.js    %s\n", version);
-        found_any = 1;
-    } else {
-        printf("  \033[31m✗\033[0m Node.js    \033[90mnot installed\033[0m\n");
-    }
+    printf("\033[33mInstalled Runtimes:\033[0m\n");
     
-    /* Git */
-    if (get_version_string("git --version", version, sizeof(version)) == 0) {
-        /* Extract just version number */
-        char *ver = strstr(version, "version ");
-        if (ver) ver += 8; else ver = version;
-        printf("  \033[32m✓\033[0m Git        %s\n", ver);
-        found_any = 1;
-    } else {
-        printf("  \033[31m✗\033[0m Git        \033[90mnot installed\033[0m\n");
-    }
+    print_runtime("Python", &probes[0], probes[0].version);
+    print_runtime("Node.js", &probes[1], probes[1].version);
+    
+    /* Extract just version number */
+    char *ver = strstr(probes[2].version, "version ");
+    print_runtime("Git", &probes[2], ver ? ver + 8 : probes[2].version);
     
     printf("\n");
-    (void)found_any;  /* Suppress unused warning */
 }
 
 static void print_help(void) {
@@ -138,6 +95,8 @@ static void print_help(void) {
     printf("\n\033[33mOptions:\033[0m\n");
     printf("  -v, --version          Show version\n");
     printf("  -h, --help             Show this help message\n");
+    printf("  --offline              Use only cached registry data, no network\n");
+    printf("  --timings              Print a network/command timing breakdown\n");
     printf("\n\033[33mExamples:\033[0m\n");
     printf("  nex install pagepull\n");
     printf("  nex run pagepull --url https://example.com\n");
@@ -150,8 +109,48 @@ static void print_version(void) {
     printf("nex %s\n", NEX_VERSION);
 }
 
+/*
+ * Remove global flags from argv so commands never see them. Arguments
+ * after 'nex run' belong to the package, so only flags before the
+ * command are taken there.
+ */
+static int strip_global_flags(int argc, char *argv[], int *timings, int *offline) {
+    int out = 1;
+    const char *command = NULL;
+    
+    for (int i = 1; i < argc; i++) {
+        int global = !command || strcmp(command, "run") != 0;
+        
+        if (global && strcmp(argv[i], "--timings") == 0) {
+            *timings = 1;
+            continue;
+        }
+        if (global && strcmp(argv[i], "--offline") == 0) {
+            *offline = 1;
+            continue;
+        }
+        if (!command) {
+            command = argv[i];
+        }
+        argv[out++] = argv[i];
+    }
+    argv[out] = NULL;
+    
+    return out;
+}
+
 int main(int argc, char *argv[]) {
     int result = 0;
+    int timings = 0;
+    int offline = 0;
+    
+    argc = strip_global_flags(argc, argv, &timings, &offline);
+    timing_init(timings);
+    
+    const char *offline_env = getenv("NEX_OFFLINE");
+    if (offline_env && offline_env[0] && strcmp(offline_env, "0") != 0) {
+        offline = 1;
+    }
     
     /* No arguments - show banner only */
     if (argc < 2) {
@@ -173,11 +172,18 @@ int main(int argc, char *argv[]) {
         return 0;
     }
     
+    /* A package with a current run plan needs none of the setup below */
+    if (strcmp(command, "run") == 0 && cmd_run_planned(argc - 2, argv + 2, &result) == 0) {
+        timing_print();
+        return result;
+    }
+    
     /* Initialize HTTP client */
     if (http_init() != 0) {
         print_error("Failed to initialize HTTP client");
         return 1;
     }
+    http_set_offline(offline);
     
     /* Ensure config directories exist */
     if (config_ensure_directories() != 0) {
@@ -235,6 +241,10 @@ int main(int argc, char *argv[]) {
     else if (strcmp(command, "self-update") == 0) {
         result = cmd_self_update(argc - 2, argv + 2);
     }
+    else if (strcmp(command, "__index-refresh") == 0) {
+        /* Internal: background index refresh started by index_ensure() */
+        result = index_refresh_detached();
+    }
     else {
         print_error("Unknown command: %s", command);
         printf("\nRun 'nex --help' for usage information.\n");
@@ -243,6 +253,7 @@ int main(int argc, char *argv[]) {
     
     /* Cleanup */
     http_cleanup();
+    timing_print();
     
     return result;
 }
@@ -0,0 +1,717 @@
+/*
+ * Registry Index - Local copy of the registry package index
+ *
+ * The index lives in ~/.nex/index.json. Once it is older than index_ttl
+ * it is still used as-is, and a detached `nex __index-refresh` process
+ * fetches a new copy for the next command (stale-while-revalidate).
+ * A full copy is read a page at a time, following the registry's
+ * nextCursor to the end of the listing. Refreshes ask only for what
+ * changed since the copy's timestamp and merge it in (upserted packages
+ * and tombstones of deleted ones).
+ * Lookups go through the compiled form in index_map.c. A name missing
+ * from a copy synced moments ago, or one the registry just answered 404
+ * for, is reported missing without asking again (not_found_ttl).
+ */
+
+#include "nex.h"
+#include "cJSON.h"
+#include <stdint.h>
+#include <ctype.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/wait.h>
+#endif
+
+#define INDEX_FILENAME "index.json"
+#define INDEX_DEFAULT_TTL 3600      /* seconds before a background refresh */
+#define INDEX_LOCK_STALE 120        /* seconds after which a refresh lock is abandoned */
+#define INDEX_NOT_FOUND_TTL 60      /* seconds a "no such package" answer is trusted */
+#define INDEX_NOT_FOUND_FILENAME "not_found.json"
+#define INDEX_NOT_FOUND_MAX 256
+#define INDEX_PAGE_SIZE 5000        /* packages per page of a full listing */
+
+/* Set once this process has fetched the index itself */
+static int refreshed = 0;
+
+/* Set once the refresh policy has been applied in this process */
+static int ensured = 0;
+
+static int index_path(char *buffer, size_t size, const char *suffix) {
+    char home[MAX_PATH_LEN];
+    if (config_get_home_dir(home, sizeof(home)) != 0) {
+        return -1;
+    }
+    snprintf(buffer, size, "%s%c%s%s", home, PATH_SEPARATOR, INDEX_FILENAME, suffix);
+    return 0;
+}
+
+typedef struct {
+    char *buffer;
+    size_t size;
+    int found;
+} IndexStamp;
+
+static int stamp_value(const char *member, const char *json, size_t len, void *ctx) {
+    IndexStamp *stamp = ctx;
+    if (!json || strcmp(member, "timestamp") != 0) {
+        return 0;
+    }
+    
+    /* ISO 8601 as sent by the registry; anything else would need escaping */
+    if (len >= 2 && json[0] == '"' && json[len - 1] == '"' && len - 2 < stamp->size &&
+        strspn(json + 1, "0123456789-:.TZ") == len - 2) {
+        memcpy(stamp->buffer, json + 1, len - 2);
+        stamp->buffer[len - 2] = '\0';
+        stamp->found = 1;
+    }
+    return 1;  /* Nothing else is needed; stop reading */
+}
+
+/* The registry's timestamp of the local copy, usable in a `since=` query */
+static int index_since(char *buffer, size_t size) {
+    char path[MAX_PATH_LEN];
+    if (index_path(path, sizeof(path), "") != 0) {
+        return -1;
+    }
+    
+    IndexStamp stamp = { buffer, size, 0 };
+    json_stream_file(path, stamp_value, NULL, &stamp);
+    return stamp.found && buffer[0] ? 0 : -1;
+}
+
+/*
+ * One refresh download. Each page is parsed by the write callback, one
+ * package at a time, so parsing overlaps the transfer and no
+ * whole-document tree is ever built. The packages of a full listing are
+ * compiled and written to index.json.tmp as they arrive, all pages into
+ * one document; the few records of a delta are kept for index_merge.
+ */
+typedef struct {
+    FILE *out;
+    JsonStream json;
+    IndexBuilder *builder;
+    int want_delta;             /* `since` was asked for */
+    int delta;                  /* ...and the answer named it before its packages */
+    int has_packages;           /* The current page had a package list */
+    int failed;                 /* Out of memory or a write error */
+    int count;                  /* Packages written to index.json.tmp */
+    char timestamp[64];         /* Of the first page, as JSON text, quotes included */
+    char cursor[512];           /* nextCursor of the current page, if any */
+    cJSON **upserts;
+    size_t upsert_count;
+    size_t upsert_capacity;
+    cJSON **deleted;
+    size_t deleted_count;
+    size_t deleted_capacity;
+} IndexFetch;
+
+static int fetch_keep(cJSON ***items, size_t *count, size_t *capacity, cJSON *item) {
+    if (*count == *capacity) {
+        size_t grown = *capacity ? *capacity * 2 : 64;
+        cJSON **resized = realloc(*items, grown * sizeof(cJSON*));
+        if (!resized) return -1;
+        *items = resized;
+        *capacity = grown;
+    }
+    (*items)[(*count)++] = item;
+    return 0;
+}
+
+static int fetch_value(const char *member, const char *json, size_t len, void *ctx) {
+    IndexFetch *fetch = ctx;
+    if (!json) {
+        if (strcmp(member, "packages") == 0) fetch->has_packages = 1;
+        return 0;
+    }
+    
+    /* Never replace a good copy with something unparseable */
+    cJSON *value = cJSON_Parse(json);
+    if (!value) return -1;
+    
+    if (strcmp(member, "since") == 0 && fetch->want_delta && !fetch->has_packages) {
+        fetch->delta = 1;
+    } else if (strcmp(member, "timestamp") == 0 && cJSON_IsString(value) &&
+               len < sizeof(fetch->timestamp) && !fetch->timestamp[0]) {
+        /* Later pages are newer; deltas must start from the oldest */
+        memcpy(fetch->timestamp, json, len + 1);
+    } else if (strcmp(member, "nextCursor") == 0 && cJSON_IsString(value)) {
+        snprintf(fetch->cursor, sizeof(fetch->cursor), "%s", value->valuestring);
+    }
+    cJSON_Delete(value);
+    return 0;
+}
+
+/* Start index.json.tmp, once the first page's timestamp is known */
+static int fetch_begin(IndexFetch *fetch) {
+    if (ftell(fetch->out) > 0) {
+        return 0;
+    }
+    int written = fetch->timestamp[0] ?
+        fprintf(fetch->out, "{\"timestamp\":%s,\"packages\":[", fetch->timestamp) :
+        fprintf(fetch->out, "{\"packages\":[");
+    return written > 0 ? 0 : -1;
+}
+
+static int fetch_item(const char *member, const char *json, size_t len, void *ctx) {
+    IndexFetch *fetch = ctx;
+    int packages = strcmp(member, "packages") == 0;
+    if (!packages && !(fetch->delta && strcmp(member, "deleted") == 0)) {
+        return 0;
+    }
+    
+    cJSON *item = cJSON_Parse(json);
+    if (!item) return -1;
+    
+    int result;
+    if (packages && !fetch->delta) {
+        result = index_builder_add(fetch->builder, item);
+        cJSON_Delete(item);
+        if (result == 0 && (fetch_begin(fetch) != 0 ||
+                            (fetch->count > 0 && fputc(',', fetch->out) == EOF) ||
+                            fwrite(json, 1, len, fetch->out) != len)) {
+            fetch->failed = 1;
+            result = -1;
+        }
+        fetch->count++;
+    } else {
+        result = packages ?
+            fetch_keep(&fetch->upserts, &fetch->upsert_count, &fetch->upsert_capacity, item) :
+            fetch_keep(&fetch->deleted, &fetch->deleted_count, &fetch->deleted_capacity, item);
+        if (result != 0) cJSON_Delete(item);
+    }
+    return result;
+}
+
+static int fetch_sink(const char *data, size_t size, void *ctx) {
+    IndexFetch *fetch = ctx;
+    return json_stream_feed(&fetch->json, data, size);
+}
+
+static void fetch_free(IndexFetch *fetch) {
+    if (fetch->out) fclose(fetch->out);
+    json_stream_free(&fetch->json);
+    index_builder_free(fetch->builder);
+    for (size_t i = 0; i < fetch->upsert_count; i++) cJSON_Delete(fetch->upserts[i]);
+    for (size_t i = 0; i < fetch->deleted_count; i++) cJSON_Delete(fetch->deleted[i]);
+    free(fetch->upserts);
+    free(fetch->deleted);
+    memset(fetch, 0, sizeof(IndexFetch));
+}
+
+/*
+ * Download url, and for a full listing every page after it, into
+ * index.json.tmp; 0 once a complete listing arrived. url carries its own
+ * query; later pages add limit and cursor to base_url.
+ */
+static int index_fetch(IndexFetch *fetch, const char *base_url, const char *url,
+                       const char *tmp_path, int want_delta, long *status) {
+    memset(fetch, 0, sizeof(IndexFetch));
+    fetch->want_delta = want_delta;
+    fetch->out = fopen(tmp_path, "wb");
+    fetch->builder = index_builder_new();
+    if (!fetch->out || !fetch->builder) {
+        *status = -1;
+        return -1;
+    }
+    
+    char page_url[MAX_URL_LEN + sizeof(fetch->cursor) * 3];
+    snprintf(page_url, sizeof(page_url), "%s", url);
+    
+    int complete = 0;
+    for (;;) {
+        fetch->has_packages = 0;
+        fetch->cursor[0] = '\0';
+        json_stream_init(&fetch->json, fetch_value, fetch_item, fetch);
+        *status = http_get_stream(page_url, fetch_sink, fetch);
+        complete = *status == 200 && !fetch->failed &&
+                   json_stream_finish(&fetch->json) == 0 && fetch->has_packages;
+        json_stream_free(&fetch->json);
+        if (!complete || fetch->delta || !fetch->cursor[0]) {
+            break;
+        }
+        
+        char cursor[sizeof(fetch->cursor) * 3];
+        url_encode(fetch->cursor, cursor, sizeof(cursor));
+        snprintf(page_url, sizeof(page_url), "%s?limit=%d&cursor=%s",
+                 base_url, INDEX_PAGE_SIZE, cursor);
+    }
+    
+    if (complete && !fetch->delta &&
+        (fetch_begin(fetch) != 0 || fprintf(fetch->out, "],\"count\":%d}", fetch->count) <= 0)) {
+        complete = 0;
+    }
+    int closed = fclose(fetch->out);
+    fetch->out = NULL;
+    return complete && closed == 0 ? 0 : -1;
+}
+
+typedef struct {
+    const char *id;
+    cJSON *package;     /* New record, or NULL when the package was deleted */
+    int placed;
+} IndexChange;
+
+static IndexChange* change_slot(IndexChange *table, size_t mask, const char *id) {
+    uint32_t hash = 2166136261u;
+    for (const char *p = id; *p; p++) {
+        hash ^= (unsigned char)*p;
+        hash *= 16777619u;
+    }
+    
+    size_t i = hash & mask;
+    while (table[i].id && strcmp(table[i].id, id) != 0) {
+        i = (i + 1) & mask;
+    }
+    return &table[i];
+}
+
+typedef struct {
+    FILE *out;
+    IndexBuilder *builder;
+    IndexChange *table;
+    size_t mask;
+    int count;
+    int failed;
+} IndexMerge;
+
+/* Write one package of the merged listing and compile it */
+static int merge_emit(IndexMerge *merge, const char *json, cJSON *pkg) {
+    char *printed = json ? NULL : cJSON_PrintUnformatted(pkg);
+    const char *text = json ? json : printed;
+    
+    int ok = text && (merge->count == 0 || fputc(',', merge->out) != EOF) &&
+             fputs(text, merge->out) != EOF &&
+             index_builder_add(merge->builder, pkg) == 0;
+    free(printed);
+    
+    if (!ok) {
+        merge->failed = 1;
+        return -1;
+    }
+    merge->count++;
+    return 0;
+}
+
+/* Copy a record of the local copy, or put its replacement in its place */
+static int merge_item(const char *member, const char *json, size_t len, void *ctx) {
+    (void)len;
+    IndexMerge *merge = ctx;
+    if (strcmp(member, "packages") != 0) {
+        return 0;
+    }
+    
+    cJSON *pkg = cJSON_Parse(json);
+    if (!pkg) return -1;
+    
+    cJSON *id = cJSON_GetObjectItemCaseSensitive(pkg, "id");
+    IndexChange *change = cJSON_IsString(id) ? change_slot(merge->table, merge->mask, id->valuestring) : NULL;
+    int result = 0;
+    if (!change || !change->id) {
+        result = merge_emit(merge, json, pkg);
+    } else if (change->package && !change->placed) {
+        change->placed = 1;
+        result = merge_emit(merge, NULL, change->package);
+    }
+    
+    cJSON_Delete(pkg);
+    return result;
+}
+
+/*
+ * Apply a delta (upserted packages plus ids of deleted ones) by streaming
+ * the local copy into index.json.tmp. Changed records are swapped in
+ * place; new ones are appended in the order received.
+ */
+static int index_merge(IndexFetch *fetch, const char *path, const char *tmp_path) {
+    if (!fetch->timestamp[0]) {
+        return -1;
+    }
+    
+    size_t changes = fetch->upsert_count + fetch->deleted_count;
+    size_t size = 16;
+    while (size < changes * 2) size <<= 1;
+    
+    IndexMerge merge;
+    memset(&merge, 0, sizeof(merge));
+    merge.table = calloc(size, sizeof(IndexChange));
+    merge.mask = size - 1;
+    merge.builder = fetch->builder;
+    if (!merge.table) {
+        return -1;
+    }
+    
+    for (size_t i = 0; i < fetch->deleted_count; i++) {
+        cJSON *item = fetch->deleted[i];
+        if (!cJSON_IsString(item)) continue;
+        IndexChange *change = change_slot(merge.table, merge.mask, item->valuestring);
+        change->id = item->valuestring;
+    }
+    
+    /* A later upsert beats a tombstone; only the first of repeated ones counts */
+    for (size_t i = 0; i < fetch->upsert_count; i++) {
+        cJSON *id = cJSON_GetObjectItemCaseSensitive(fetch->upserts[i], "id");
+        IndexChange *change = cJSON_IsString(id) ? change_slot(merge.table, merge.mask, id->valuestring) : NULL;
+        if (!change || change->package) continue;
+        change->id = id->valuestring;
+        change->package = fetch->upserts[i];
+    }
+    
+    merge.out = fopen(tmp_path, "wb");
+    int result = -1;
+    if (merge.out && fprintf(merge.out, "{\"timestamp\":%s,\"packages\":[", fetch->timestamp) > 0 &&
+        json_stream_file(path, NULL, merge_item, &merge) == 0) {
+        for (size_t i = 0; i < fetch->upsert_count && !merge.failed; i++) {
+            cJSON *id = cJSON_GetObjectItemCaseSensitive(fetch->upserts[i], "id");
+            IndexChange *change = cJSON_IsString(id) ? change_slot(merge.table, merge.mask, id->valuestring) : NULL;
+            if (!change || change->package != fetch->upserts[i] || change->placed) continue;
+            change->placed = 1;
+            merge_emit(&merge, NULL, fetch->upserts[i]);
+        }
+        if (!merge.failed && fprintf(merge.out, "],\"count\":%d}", merge.count) > 0) {
+            result = 0;
+        }
+    }
+    if (merge.out && fclose(merge.out) != 0) {
+        result = -1;
+    }
+    
+    free(merge.table);
+    return result;
+}
+
+/*
+ * Bring the local copy up to date. With a copy on disk only the changes
+ * since its timestamp are requested; a registry that cannot serve them
+ * (or ignores `since`) gets the full list instead.
+ */
+int index_refresh(void) {
+    if (http_is_offline()) {
+        return -1;
+    }
+    
+    char index_url[MAX_URL_LEN];
+    char url[MAX_URL_LEN];
+    char since[64];
+    char path[MAX_PATH_LEN];
+    char tmp_path[MAX_PATH_LEN];
+    if (index_path(path, sizeof(path), "") != 0 ||
+        index_path(tmp_path, sizeof(tmp_path), ".tmp") != 0) {
+        return -1;
+    }
+    config_get_registry_index_url(index_url, sizeof(index_url));
+    
+    char full_url[MAX_URL_LEN];
+    snprintf(full_url, sizeof(full_url), "%s?limit=%d", index_url, INDEX_PAGE_SIZE);
+    
+    int want_delta = index_since(since, sizeof(since)) == 0;
+    if (want_delta) {
+        snprintf(url, sizeof(url), "%s?since=%s", index_url, since);
+    } else {
+        snprintf(url, sizeof(url), "%s", full_url);
+    }
+    
+    IndexFetch fetch;
+    long status;
+    int result = index_fetch(&fetch, index_url, url, tmp_path, want_delta, &status);
+    if (result != 0 && want_delta && status > 0 && status != 200) {
+        /* Too old for a delta, or a registry without delta support */
+        fetch_free(&fetch);
+        result = index_fetch(&fetch, index_url, full_url, tmp_path, 0, &status);
+    }
+    if (result == 0 && fetch.delta) {
+        result = index_merge(&fetch, path, tmp_path);
+    }
+    
+    if (result == 0) {
+#ifdef _WIN32
+        remove(path);
+#endif
+        result = rename(tmp_path, path);
+    }
+    
+    struct stat st;
+    if (result == 0) {
+        refreshed = 1;
+        
+        /* Compiled while reading, so index.bin only needs writing out */
+        if (stat(path, &st) == 0) {
+            index_builder_write(fetch.builder, (long long)st.st_mtime, (long long)st.st_size);
+        }
+    } else {
+        remove(tmp_path);
+        result = -1;
+    }
+    
+    fetch_free(&fetch);
+    return result;
+}
+
+/* Claim the right to refresh; fails while another process holds it */
+static int index_lock(void) {
+    char lock_path[MAX_PATH_LEN];
+    if (index_path(lock_path, sizeof(lock_path), ".lock") != 0) {
+        return -1;
+    }
+    
+    struct stat st;
+    if (stat(lock_path, &st) == 0 && time(NULL) - st.st_mtime > INDEX_LOCK_STALE) {
+        remove(lock_path);  /* Its owner died without cleaning up */
+    }
+
+#ifdef _WIN32
+    HANDLE h = CreateFileA(lock_path, GENERIC_WRITE, 0, NULL, CREATE_NEW,
+                           FILE_ATTRIBUTE_NORMAL, NULL);
+    if (h == INVALID_HANDLE_VALUE) return -1;
+    CloseHandle(h);
+#else
+    int fd = open(lock_path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) return -1;
+    close(fd);
+#endif
+    return 0;
+}
+
+static void index_unlock(void) {
+    char lock_path[MAX_PATH_LEN];
+    if (index_path(lock_path, sizeof(lock_path), ".lock") == 0) {
+        remove(lock_path);
+    }
+}
+
+/* Entry point of the detached refresher started by index_refresh_async */
+int index_refresh_detached(void) {
+    int result = index_refresh();
+    index_unlock();
+    return result == 0 ? 0 : 1;
+}
+
+/* Start `nex __index-refresh` in the background without waiting for it */
+static void index_refresh_async(void) {
+    char exe[MAX_PATH_LEN];
+    if (get_executable_path(exe, sizeof(exe)) != 0 || index_lock() != 0) {
+        return;
+    }
+
+#ifdef _WIN32
+    char cmdline[MAX_PATH_LEN + 32];
+    snprintf(cmdline, sizeof(cmdline), "\"%s\" __index-refresh", exe);
+    
+    STARTUPINFOA si;
+    PROCESS_INFORMATION pi;
+    memset(&si, 0, sizeof(si));
+    si.cb = sizeof(si);
+    
+    if (CreateProcessA(NULL, cmdline, NULL, NULL, FALSE,
+                       DETACHED_PROCESS | CREATE_NO_WINDOW, NULL, NULL, &si, &pi)) {
+        CloseHandle(pi.hThread);
+        CloseHandle(pi.hProcess);
+    } else {
+        index_unlock();
+    }
+#else
+    fflush(stdout);
+    fflush(stderr);
+    
+    /* Fork twice so the refresher is reparented and never becomes a zombie */
+    pid_t pid = fork();
+    if (pid < 0) {
+        index_unlock();
+        return;
+    }
+    if (pid == 0) {
+        if (fork() == 0) {
+            setsid();
+            int devnull = open("/dev/null", O_RDWR);
+            if (devnull >= 0) {
+                dup2(devnull, STDIN_FILENO);
+                dup2(devnull, STDOUT_FILENO);
+                dup2(devnull, STDERR_FILENO);
+                if (devnull > STDERR_FILENO) close(devnull);
+            }
+            execl(exe, exe, "__index-refresh", (char *)NULL);
+            index_unlock();
+        }
+        _exit(0);
+    }
+    waitpid(pid, NULL, 0);
+#endif
+}
+
+/*
+ * Make sure ~/.nex/index.json exists, applying the refresh policy once
+ * per process. With force_refresh the registry is asked for a new copy
+ * first, unless this process already fetched one.
+ */
+int index_ensure(int force_refresh) {
+    if (force_refresh && !refreshed && !http_is_offline()) {
+        index_refresh();
+    }
+    if (ensured) {
+        return 0;
+    }
+    
+    char path[MAX_PATH_LEN];
+    struct stat st;
+    if (index_path(path, sizeof(path), "") == 0 && stat(path, &st) == 0) {
+        long ttl = config_get_long("index_ttl", INDEX_DEFAULT_TTL);
+        if (!refreshed && !http_is_offline() && time(NULL) - st.st_mtime > ttl) {
+            index_refresh_async();
+        }
+        ensured = 1;
+        return 0;
+    }
+    
+    if (http_is_offline()) {
+        print_error("No cached registry index. Run a command without --offline first");
+        return -1;
+    }
+    
+    /* First use: nothing to serve while revalidating, so fetch now */
+    if (refreshed || index_refresh() != 0) {
+        print_error("Failed to fetch registry index");
+        return -1;
+    }
+    
+    ensured = 1;
+    return 0;
+}
+
+/* Whether a local copy of the index exists, however old */
+int index_available(void) {
+    char path[MAX_PATH_LEN];
+    struct stat st;
+    return index_path(path, sizeof(path), "") == 0 && stat(path, &st) == 0;
+}
+
+/* ============ Negative lookups ============ */
+
+/*
+ * Whether index.json was synced with the registry within not_found_ttl
+ * seconds, recently enough that a name missing from it can be reported
+ * missing without asking again
+ */
+int index_recently_synced(void) {
+    long ttl = config_get_long("not_found_ttl", INDEX_NOT_FOUND_TTL);
+    char path[MAX_PATH_LEN];
+    struct stat st;
+    if (ttl <= 0 || index_path(path, sizeof(path), "") != 0 || stat(path, &st) != 0) {
+        return 0;
+    }
+    
+    long age = (long)(time(NULL) - st.st_mtime);
+    return age >= 0 && age <= ttl;
+}
+
+static int not_found_path(char *buffer, size_t size) {
+    char cache_dir[MAX_PATH_LEN];
+    if (config_get_cache_dir(cache_dir, sizeof(cache_dir)) != 0) {
+        return -1;
+    }
+    snprintf(buffer, size, "%s%c%s", cache_dir, PATH_SEPARATOR, INDEX_NOT_FOUND_FILENAME);
+    return 0;
+}
+
+/* Names the registry recently did not have, each with when it said so */
+static cJSON* not_found_load(void) {
+    char path[MAX_PATH_LEN];
+    if (not_found_path(path, sizeof(path)) != 0) return NULL;
+    
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    
+    char data[INDEX_NOT_FOUND_MAX * (MAX_NAME_LEN + 16)];
+    size_t got = fread(data, 1, sizeof(data) - 1, f);
+    data[got] = '\0';
+    fclose(f);
+    
+    cJSON *names = cJSON_Parse(data);
+    if (names && !cJSON_IsObject(names)) {
+        cJSON_Delete(names);
+        names = NULL;
+    }
+    return names;
+}
+
+/* Lowercased, as names compare case-insensitively */
+static void not_found_key(const char *name, char *key, size_t size) {
+    size_t i = 0;
+    for (; name[i] && i + 1 < size; i++) {
+        key[i] = (char)tolower((unsigned char)name[i]);
+    }
+    key[i] = '\0';
+}
+
+/* Whether the registry answered within not_found_ttl seconds that name does not exist */
+int index_not_found_has(const char *name) {
+    long ttl = config_get_long("not_found_ttl", INDEX_NOT_FOUND_TTL);
+    if (ttl <= 0) {
+        return 0;
+    }
+    
+    cJSON *names = not_found_load();
+    if (!names) {
+        return 0;
+    }
+    
+    char key[MAX_NAME_LEN];
+    not_found_key(name, key, sizeof(key));
+    cJSON *when = cJSON_GetObjectItemCaseSensitive(names, key);
+    long age = cJSON_IsNumber(when) ? (long)(time(NULL) - (time_t)when->valuedouble) : -1;
+    cJSON_Delete(names);
+    return age >= 0 && age <= ttl;
+}
+
+/* Whether an entry of not_found.json is unexpired and for another name than key */
+static int not_found_keep(const cJSON *item, const char *key, time_t now, long ttl) {
+    return cJSON_IsNumber(item) && now - (time_t)item->valuedouble <= ttl &&
+           strcmp(item->string, key) != 0;
+}
+
+/* Remember that the registry does not have name, dropping expired entries */
+void index_not_found_add(const char *name) {
+    long ttl = config_get_long("not_found_ttl", INDEX_NOT_FOUND_TTL);
+    char path[MAX_PATH_LEN];
+    char cache_dir[MAX_PATH_LEN];
+    if (ttl <= 0 || not_found_path(path, sizeof(path)) != 0 ||
+        config_get_cache_dir(cache_dir, sizeof(cache_dir)) != 0 ||
+        make_directory_recursive(cache_dir) != 0) {
+        return;
+    }
+    
+    char key[MAX_NAME_LEN];
+    not_found_key(name, key, sizeof(key));
+    time_t now = time(NULL);
+    
+    /* Unexpired entries stay, oldest first; when full the oldest make room */
+    cJSON *old = not_found_load();
+    cJSON *item;
+    int live = 0;
+    cJSON_ArrayForEach(item, old) {
+        if (not_found_keep(item, key, now, ttl)) live++;
+    }
+    
+    cJSON *names = cJSON_CreateObject();
+    int skip = live - (INDEX_NOT_FOUND_MAX - 1);
+    cJSON_ArrayForEach(item, old) {
+        if (names && not_found_keep(item, key, now, ttl) && skip-- <= 0) {
+            cJSON_AddNumberToObject(names, item->string, item->valuedouble);
+        }
+    }
+    cJSON_Delete(old);
+    if (!names) return;
+    cJSON_AddNumberToObject(names, key, (double)now);
+    
+    char *str = cJSON_PrintUnformatted(names);
+    cJSON_Delete(names);
+    if (!str) return;
+    
+    FILE *f = fopen(path, "w");
+    if (f) {
+        fputs(str, f);
+        fclose(f);
+    }
+    free(str);
+}
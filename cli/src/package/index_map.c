@@ -0,0 +1,1904 @@
+/*
+ * Index Map - Compiled, memory-mapped form of the registry index
+ *
+ * ~/.nex/index.bin is built from index.json whenever that changes, so
+ * name lookups and search scan fixed-size records instead of parsing
+ * JSON. Layout (native byte order, all offsets from the file start):
+ *
+ *   IndexHeader
+ *   IndexRecord[record_count]     string fields are string pool offsets
+ *   IndexSlot[id_slots]           open-addressed table keyed by id
+ *   IndexSlot[name_slots]         ...keyed by shortName and id name part
+ *   uint32_t[bloom_words]         Bloom filter of ids, shortNames and id name parts
+ *   IndexTrigram[trigram_count]   sorted by key, each owning a postings run
+ *   uint32_t[posting_count]       ascending record numbers per trigram
+ *   IndexFacet[facet_count]       sorted by key hash, each owning containers
+ *   IndexContainer[container_count]
+ *   uint16_t[facet_data_size]     container contents
+ *   string pool                   NUL-terminated strings
+ *
+ * The trigram section is an inverted index over the lowercased id, name,
+ * description and keywords. Search intersects the posting lists of the
+ * query's trigrams and only verifies the records left over. Records also
+ * carry downloads and rating, and the header the average field lengths,
+ * for ranking the matches.
+ *
+ * Facets (a category, tag or runtime value, or being deprecated) are
+ * roaring-style bitmaps of record numbers for search filters. Records are
+ * split into chunks of 65536; each chunk a facet has records in becomes
+ * a container holding either the sorted low 16 bits of its records or,
+ * when there are more than 4096 of them, a 65536-bit bitmap.
+ *
+ * The Bloom filter answers "is there a package called this?" from a few
+ * bits, so a mistyped name is rejected without probing the slots.
+ */
+
+#include "nex.h"
+#include "cJSON.h"
+#include <stdint.h>
+#include <ctype.h>
+#include <math.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define strcasecmp _stricmp
+#else
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/mman.h>
+#endif
+
+#define INDEX_BIN_FILENAME "index.bin"
+#define INDEX_JSON_FILENAME "index.json"
+#define INDEX_BIN_MAGIC "NEXIDX\r\n"
+#define INDEX_BIN_VERSION 6
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_count;
+    int64_t source_mtime;       /* index.json this was built from */
+    int64_t source_size;
+    uint32_t records_offset;
+    uint32_t id_slots_offset;
+    uint32_t id_slot_count;     /* Power of two */
+    uint32_t name_slots_offset;
+    uint32_t name_slot_count;   /* Power of two */
+    uint32_t strings_offset;
+    uint32_t strings_size;
+    uint32_t trigrams_offset;
+    uint32_t trigram_count;
+    uint32_t postings_offset;
+    uint32_t posting_count;
+    uint32_t max_downloads;
+    uint32_t average_length[4]; /* Of id, name, description and keywords, for ranking */
+    uint32_t facets_offset;
+    uint32_t facet_count;
+    uint32_t containers_offset;
+    uint32_t container_count;
+    uint32_t facet_data_offset;
+    uint32_t facet_data_size;   /* In 16-bit words */
+    uint32_t bloom_offset;
+    uint32_t bloom_words;       /* Power of two */
+    uint32_t bloom_hashes;      /* Bits set per key */
+} IndexHeader;
+
+typedef struct {
+    uint32_t id;
+    uint32_t short_name;
+    uint32_t name;
+    uint32_t version;
+    uint32_t description;
+    uint32_t keywords;
+    uint32_t downloads;
+    uint32_t rating;            /* averageRating in hundredths */
+} IndexRecord;
+
+typedef struct {
+    uint32_t hash;
+    uint32_t record;            /* Record number + 1 (| SLOT_ID_NAME); 0 is empty */
+} IndexSlot;
+
+typedef struct {
+    uint32_t key;               /* Three lowercased bytes, first one highest */
+    uint32_t first;             /* Index of its first posting */
+    uint32_t count;
+} IndexTrigram;
+
+/* A trigram's state while the postings are built */
+typedef struct {
+    uint32_t key;               /* TRIGRAM_EMPTY for a free slot */
+    uint32_t count;             /* Postings, then its list's write cursor */
+    uint32_t seen;              /* Tag of the last record that produced it */
+} TrigramSlot;
+
+/* Open addressing over the distinct trigrams only, so it grows with the index */
+typedef struct {
+    TrigramSlot *slots;
+    uint32_t capacity;          /* Power of two */
+    uint32_t used;
+} TrigramTable;
+
+#define TRIGRAM_EMPTY 0xFFFFFFFFu
+#define TRIGRAM_TABLE_MIN 4096
+
+typedef struct {
+    uint32_t hash;              /* hash_name of the key */
+    uint32_t key;               /* "category:<name>", "tag:<name>", "runtime:<type>" or "deprecated" */
+    uint32_t first;             /* Index of its first container */
+    uint32_t container_count;
+    uint32_t cardinality;       /* Records it holds */
+} IndexFacet;
+
+typedef struct {
+    uint16_t high;              /* Record number >> 16 */
+    uint16_t type;              /* CONTAINER_ARRAY or CONTAINER_BITMAP */
+    uint32_t cardinality;
+    uint32_t offset;            /* Into the facet data, in 16-bit words */
+} IndexContainer;
+
+#define CONTAINER_ARRAY 0       /* cardinality ascending low halves */
+#define CONTAINER_BITMAP 1      /* FACET_BITMAP_WORDS words, bit n for low half n */
+#define FACET_ARRAY_MAX 4096    /* Past this a bitmap is smaller */
+#define FACET_BITMAP_WORDS 4096
+
+#define FACET_CATEGORY "category:"
+#define FACET_TAG "tag:"
+#define FACET_RUNTIME "runtime:"
+#define FACET_DEPRECATED "deprecated"
+#define FACET_KEY_MAX (MAX_NAME_LEN + 16)
+
+#define BLOOM_BITS_PER_KEY 10   /* With 7 hashes, about 1% false positives */
+#define BLOOM_HASHES 7
+
+struct IndexMap {
+    const unsigned char *base;
+    size_t size;
+    const IndexHeader *header;
+    const IndexRecord *records;
+    const IndexSlot *id_slots;
+    const IndexSlot *name_slots;
+    const uint32_t *bloom;
+    const IndexTrigram *trigrams;
+    const uint32_t *postings;
+    const IndexFacet *facets;
+    const IndexContainer *containers;
+    const uint16_t *facet_data;
+    const char *strings;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+static int index_map_path(const char *filename, char *buffer, size_t size) {
+    char home[MAX_PATH_LEN];
+    if (config_get_home_dir(home, sizeof(home)) != 0) {
+        return -1;
+    }
+    snprintf(buffer, size, "%s%c%s", home, PATH_SEPARATOR, filename);
+    return 0;
+}
+
+/* Case-insensitive FNV-1a; names compare case-insensitively */
+static uint32_t hash_name(const char *s, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)tolower((unsigned char)s[i]);
+        hash *= 16777619u;
+    }
+    return hash ? hash : 1;
+}
+
+/* Case-insensitive 64-bit FNV-1a; its halves drive the Bloom filter's double hashing */
+static uint64_t hash_bloom(const char *s, size_t len) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)tolower((unsigned char)s[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+/* ============ Building ============ */
+
+typedef struct {
+    char *data;
+    size_t size;
+    size_t capacity;
+} StringPool;
+
+static uint32_t pool_add(StringPool *pool, const char *s, size_t len) {
+    if (pool->size + len + 1 > pool->capacity) {
+        size_t capacity = pool->capacity ? pool->capacity : 65536;
+        while (capacity < pool->size + len + 1) capacity *= 2;
+        char *data = realloc(pool->data, capacity);
+        if (!data) return UINT32_MAX;
+        pool->data = data;
+        pool->capacity = capacity;
+    }
+    
+    uint32_t offset = (uint32_t)pool->size;
+    memcpy(pool->data + pool->size, s, len);
+    pool->data[pool->size + len] = '\0';
+    pool->size += len + 1;
+    return offset;
+}
+
+static uint32_t pool_add_item(StringPool *pool, cJSON *item) {
+    const char *s = cJSON_IsString(item) ? item->valuestring : "";
+    return pool_add(pool, s, strlen(s));
+}
+
+/* Slots keyed by the part of an id after the dot carry this flag */
+#define SLOT_ID_NAME 0x80000000u
+
+static void slot_insert(IndexSlot *slots, uint32_t count, uint32_t hash, uint32_t value) {
+    uint32_t mask = count - 1;
+    uint32_t i = hash & mask;
+    while (slots[i].record) {
+        i = (i + 1) & mask;
+    }
+    slots[i].hash = hash;
+    slots[i].record = value;
+}
+
+static uint32_t table_size(uint32_t keys) {
+    uint32_t size = 16;
+    while (size < keys * 2) size *= 2;    /* Load factor at most 0.5 */
+    return size;
+}
+
+/* A facet's records as they are added, ascending */
+typedef struct {
+    uint32_t hash;
+    uint32_t key;               /* Offset in the builder's facet_keys */
+    uint32_t *records;
+    uint32_t count;
+    uint32_t capacity;
+} FacetBuild;
+
+struct IndexBuilder {
+    IndexHeader header;
+    IndexRecord *records;
+    uint32_t record_capacity;
+    IndexSlot *id_slots;
+    IndexSlot *name_slots;
+    uint32_t *bloom;
+    IndexTrigram *trigrams;
+    uint32_t *postings;
+    StringPool pool;
+    uint64_t total_length[4];   /* Summed lengths of the ranked fields */
+    FacetBuild *facets;
+    StringPool facet_keys;      /* Moved after the last record when written */
+    uint32_t facet_capacity;
+    uint32_t *facet_slots;      /* Open-addressed by key hash, facet number + 1 */
+    uint32_t facet_slot_count;
+    IndexFacet *facet_table;
+    IndexContainer *containers;
+    uint16_t *facet_data;
+    int failed;                 /* Out of memory while adding */
+};
+
+/* Start an empty index; packages are added one at a time as they are parsed */
+IndexBuilder* index_builder_new(void) {
+    IndexBuilder *builder = calloc(1, sizeof(IndexBuilder));
+    if (!builder) return NULL;
+    
+    memcpy(builder->header.magic, INDEX_BIN_MAGIC, sizeof(builder->header.magic));
+    builder->header.version = INDEX_BIN_VERSION;
+    
+    if (pool_add(&builder->pool, "", 0) == UINT32_MAX) {  /* Offset 0 is the empty string */
+        free(builder);
+        return NULL;
+    }
+    return builder;
+}
+
+static uint32_t clamp_number(cJSON *item, double scale, double max) {
+    if (!cJSON_IsNumber(item) || !(item->valuedouble > 0)) return 0;
+    double value = item->valuedouble * scale;
+    return value >= max ? (uint32_t)max : (uint32_t)(value + 0.5);
+}
+
+/* Rehash the facet table once it is half full */
+static int facet_grow(IndexBuilder *builder) {
+    uint32_t count = builder->header.facet_count;
+    if (builder->facet_slot_count && (count + 1) * 2 <= builder->facet_slot_count) {
+        return 0;
+    }
+    
+    uint32_t slot_count = table_size(count + 1);
+    uint32_t *slots = calloc(slot_count, sizeof(uint32_t));
+    if (!slots) return -1;
+    for (uint32_t f = 0; f < count; f++) {
+        uint32_t i = builder->facets[f].hash & (slot_count - 1);
+        while (slots[i]) i = (i + 1) & (slot_count - 1);
+        slots[i] = f + 1;
+    }
+    free(builder->facet_slots);
+    builder->facet_slots = slots;
+    builder->facet_slot_count = slot_count;
+    return 0;
+}
+
+/* Add record n to the facet with this key, creating it on first use */
+static int facet_add_key(IndexBuilder *builder, const char *key, uint32_t n) {
+    if (facet_grow(builder) != 0) return -1;
+    
+    uint32_t hash = hash_name(key, strlen(key));
+    uint32_t mask = builder->facet_slot_count - 1;
+    uint32_t i = hash & mask;
+    FacetBuild *facet = NULL;
+    while (builder->facet_slots[i]) {
+        FacetBuild *f = &builder->facets[builder->facet_slots[i] - 1];
+        if (f->hash == hash && strcmp(builder->facet_keys.data + f->key, key) == 0) {
+            facet = f;
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    
+    if (!facet) {
+        uint32_t count = builder->header.facet_count;
+        if (count == builder->facet_capacity) {
+            uint32_t capacity = count ? count * 2 : 64;
+            FacetBuild *facets = realloc(builder->facets, (size_t)capacity * sizeof(FacetBuild));
+            if (!facets) return -1;
+            builder->facets = facets;
+            builder->facet_capacity = capacity;
+        }
+        
+        facet = &builder->facets[count];
+        memset(facet, 0, sizeof(FacetBuild));
+        facet->hash = hash;
+        facet->key = pool_add(&builder->facet_keys, key, strlen(key));
+        if (facet->key == UINT32_MAX) return -1;
+        builder->facet_slots[i] = count + 1;
+        builder->header.facet_count = count + 1;
+    }
+    
+    /* A tag listed twice */
+    if (facet->count && facet->records[facet->count - 1] == n) {
+        return 0;
+    }
+    if (facet->count == facet->capacity) {
+        uint32_t capacity = facet->capacity ? facet->capacity * 2 : 16;
+        uint32_t *records = realloc(facet->records, (size_t)capacity * sizeof(uint32_t));
+        if (!records) return -1;
+        facet->records = records;
+        facet->capacity = capacity;
+    }
+    facet->records[facet->count++] = n;
+    return 0;
+}
+
+/* Facet for a string field: prefix plus the lowercased value, if any */
+static int facet_add(IndexBuilder *builder, const char *prefix, cJSON *value, uint32_t n) {
+    char key[FACET_KEY_MAX];
+    if (!cJSON_IsString(value) || !value->valuestring[0] ||
+        snprintf(key, sizeof(key), "%s%s", prefix, value->valuestring) >= (int)sizeof(key)) {
+        return 0;
+    }
+    for (char *c = key; *c; c++) {
+        *c = (char)tolower((unsigned char)*c);
+    }
+    return facet_add_key(builder, key, n);
+}
+
+/* Append one package object; the caller keeps ownership of it */
+int index_builder_add(IndexBuilder *builder, cJSON *pkg) {
+    cJSON *id = cJSON_GetObjectItemCaseSensitive(pkg, "id");
+    if (builder->failed || !cJSON_IsString(id)) {
+        return builder->failed ? -1 : 0;
+    }
+    
+    uint32_t n = builder->header.record_count;
+    if (n == builder->record_capacity) {
+        uint32_t capacity = builder->record_capacity ? builder->record_capacity * 2 : 1024;
+        IndexRecord *records = capacity < builder->record_capacity ? NULL :
+            realloc(builder->records, (size_t)capacity * sizeof(IndexRecord));
+        if (!records) {
+            builder->failed = 1;
+            return -1;
+        }
+        builder->records = records;
+        builder->record_capacity = capacity;
+    }
+    
+    cJSON *keywords = cJSON_GetObjectItemCaseSensitive(pkg, "keywords");
+    IndexRecord *record = &builder->records[n];
+    StringPool *pool = &builder->pool;
+    
+    record->id = pool_add_item(pool, id);
+    record->short_name = pool_add_item(pool, cJSON_GetObjectItemCaseSensitive(pkg, "shortName"));
+    record->name = pool_add_item(pool, cJSON_GetObjectItemCaseSensitive(pkg, "name"));
+    record->version = pool_add_item(pool, cJSON_GetObjectItemCaseSensitive(pkg, "version"));
+    record->description = pool_add_item(pool, cJSON_GetObjectItemCaseSensitive(pkg, "description"));
+    
+    /* Keywords joined by newlines: a query never spans two of them */
+    char joined[MAX_KEYWORDS * MAX_NAME_LEN];
+    size_t len = 0;
+    cJSON *keyword;
+    cJSON_ArrayForEach(keyword, keywords) {
+        if (!cJSON_IsString(keyword)) continue;
+        size_t klen = strlen(keyword->valuestring);
+        if (len + klen + 1 >= sizeof(joined)) break;
+        if (len > 0) joined[len++] = '\n';
+        memcpy(joined + len, keyword->valuestring, klen);
+        len += klen;
+    }
+    record->keywords = pool_add(pool, joined, len);
+    
+    if (record->id == UINT32_MAX || record->short_name == UINT32_MAX ||
+        record->name == UINT32_MAX || record->version == UINT32_MAX ||
+        record->description == UINT32_MAX || record->keywords == UINT32_MAX) {
+        builder->failed = 1;
+        return -1;
+    }
+    
+    /* Popularity for ranking, clamped into the record's fields */
+    record->downloads = clamp_number(cJSON_GetObjectItemCaseSensitive(pkg, "downloads"), 1, UINT32_MAX);
+    record->rating = clamp_number(cJSON_GetObjectItemCaseSensitive(pkg, "averageRating"), 100, 500);
+    if (record->downloads > builder->header.max_downloads) {
+        builder->header.max_downloads = record->downloads;
+    }
+    
+    const uint32_t fields[4] = { record->id, record->name, record->description, record->keywords };
+    for (int f = 0; f < 4; f++) {
+        builder->total_length[f] += strlen(pool->data + fields[f]);
+    }
+    
+    /* Facets for search filters; runtime is { "type": ... } in the registry */
+    cJSON *runtime = cJSON_GetObjectItemCaseSensitive(pkg, "runtime");
+    cJSON *tags = cJSON_GetObjectItemCaseSensitive(pkg, "tags");
+    if (cJSON_IsObject(runtime)) {
+        runtime = cJSON_GetObjectItemCaseSensitive(runtime, "type");
+    }
+    
+    int failed = facet_add(builder, FACET_CATEGORY, cJSON_GetObjectItemCaseSensitive(pkg, "category"), n) ||
+                 facet_add(builder, FACET_RUNTIME, runtime, n);
+    cJSON *tag;
+    cJSON_ArrayForEach(tag, tags) {
+        failed = failed || facet_add(builder, FACET_TAG, tag, n);
+    }
+    if (!failed && cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(pkg, "deprecated"))) {
+        failed = facet_add_key(builder, FACET_DEPRECATED, n);
+    }
+    if (failed) {
+        builder->failed = 1;
+        return -1;
+    }
+    
+    builder->header.record_count = n + 1;
+    return 0;
+}
+
+/* Fill the lookup tables once every record is in */
+static int build_slots(IndexBuilder *builder) {
+    IndexHeader *h = &builder->header;
+    h->id_slot_count = table_size(h->record_count);
+    h->name_slot_count = table_size(h->record_count * 2);
+    builder->id_slots = calloc(h->id_slot_count, sizeof(IndexSlot));
+    builder->name_slots = calloc(h->name_slot_count, sizeof(IndexSlot));
+    if (!builder->id_slots || !builder->name_slots) {
+        return -1;
+    }
+    
+    for (uint32_t n = 0; n < h->record_count; n++) {
+        const char *id = builder->pool.data + builder->records[n].id;
+        const char *sn = builder->pool.data + builder->records[n].short_name;
+        slot_insert(builder->id_slots, h->id_slot_count, hash_name(id, strlen(id)), n + 1);
+        
+        /* Same matching rule as the registry: shortName, or the part after the dot */
+        const char *dot = strchr(id, '.');
+        if (sn[0]) {
+            slot_insert(builder->name_slots, h->name_slot_count, hash_name(sn, strlen(sn)), n + 1);
+        }
+        if (dot && strcasecmp(dot + 1, sn) != 0) {
+            slot_insert(builder->name_slots, h->name_slot_count,
+                        hash_name(dot + 1, strlen(dot + 1)), (n + 1) | SLOT_ID_NAME);
+        }
+    }
+    return 0;
+}
+
+static void bloom_insert(uint32_t *bloom, uint32_t words, const char *key) {
+    uint64_t hash = hash_bloom(key, strlen(key));
+    uint32_t step = (uint32_t)(hash >> 32) | 1;
+    uint32_t mask = words * 32 - 1;
+    for (uint32_t i = 0, bit = (uint32_t)hash; i < BLOOM_HASHES; i++, bit += step) {
+        bloom[(bit & mask) >> 5] |= 1u << (bit & 31);
+    }
+}
+
+/* Every key a lookup can use: ids, shortNames and the part of ids after the dot */
+static int build_bloom(IndexBuilder *builder) {
+    IndexHeader *h = &builder->header;
+    uint64_t bits = (uint64_t)h->record_count * 3 * BLOOM_BITS_PER_KEY;
+    h->bloom_words = 2;
+    while ((uint64_t)h->bloom_words * 32 < bits) h->bloom_words *= 2;
+    h->bloom_hashes = BLOOM_HASHES;
+    builder->bloom = calloc(h->bloom_words, sizeof(uint32_t));
+    if (!builder->bloom) {
+        return -1;
+    }
+    
+    for (uint32_t n = 0; n < h->record_count; n++) {
+        const char *id = builder->pool.data + builder->records[n].id;
+        const char *sn = builder->pool.data + builder->records[n].short_name;
+        const char *dot = strchr(id, '.');
+        bloom_insert(builder->bloom, h->bloom_words, id);
+        if (sn[0]) bloom_insert(builder->bloom, h->bloom_words, sn);
+        if (dot) bloom_insert(builder->bloom, h->bloom_words, dot + 1);
+    }
+    return 0;
+}
+
+static uint32_t trigram_key(const char *s) {
+    return (uint32_t)(unsigned char)tolower((unsigned char)s[0]) << 16 |
+           (uint32_t)(unsigned char)tolower((unsigned char)s[1]) << 8 |
+           (uint32_t)(unsigned char)tolower((unsigned char)s[2]);
+}
+
+static TrigramSlot* trigram_probe(TrigramSlot *slots, uint32_t capacity, uint32_t key) {
+    uint32_t hash = key * 0x9E3779B1u;
+    uint32_t i = (hash ^ hash >> 16) & (capacity - 1);
+    while (slots[i].key != key && slots[i].key != TRIGRAM_EMPTY) {
+        i = (i + 1) & (capacity - 1);
+    }
+    return &slots[i];
+}
+
+static int trigram_table_init(TrigramTable *table, uint32_t capacity) {
+    table->slots = malloc(capacity * sizeof(TrigramSlot));
+    if (!table->slots) {
+        return -1;
+    }
+    memset(table->slots, 0xFF, capacity * sizeof(TrigramSlot));
+    table->capacity = capacity;
+    table->used = 0;
+    return 0;
+}
+
+/* The slot of key, added (count 0, never seen) when absent; NULL when out of memory */
+static TrigramSlot* trigram_slot(TrigramTable *table, uint32_t key) {
+    TrigramSlot *slot = trigram_probe(table->slots, table->capacity, key);
+    if (slot->key == key) {
+        return slot;
+    }
+    
+    if ((table->used + 1) * 2 > table->capacity) {
+        TrigramTable grown;
+        if (table->capacity > 0x40000000u || trigram_table_init(&grown, table->capacity * 2) != 0) {
+            return NULL;
+        }
+        for (uint32_t i = 0; i < table->capacity; i++) {
+            if (table->slots[i].key != TRIGRAM_EMPTY) {
+                *trigram_probe(grown.slots, grown.capacity, table->slots[i].key) = table->slots[i];
+            }
+        }
+        grown.used = table->used;
+        free(table->slots);
+        *table = grown;
+        slot = trigram_probe(table->slots, table->capacity, key);
+    }
+    
+    slot->key = key;
+    slot->count = 0;
+    slot->seen = 0;
+    table->used++;
+    return slot;
+}
+
+/*
+ * Visit each distinct trigram of a record once. A slot's seen holds the
+ * tag of the last record that produced it, so no per-record set is needed.
+ */
+static int record_trigrams(const IndexBuilder *build, uint32_t n, uint32_t tag, TrigramTable *table,
+                           uint32_t *postings) {
+    const IndexRecord *record = &build->records[n];
+    const uint32_t fields[4] = { record->id, record->name, record->description, record->keywords };
+    
+    for (int f = 0; f < 4; f++) {
+        const char *s = build->pool.data + fields[f];
+        for (; s[0] && s[1] && s[2]; s++) {
+            if (s[0] == '\n' || s[1] == '\n' || s[2] == '\n') continue;
+            
+            TrigramSlot *slot = trigram_slot(table, trigram_key(s));
+            if (!slot) return -1;
+            if (slot->seen == tag) continue;
+            slot->seen = tag;
+            
+            if (postings) {
+                postings[slot->count++] = n;
+            } else {
+                slot->count++;
+            }
+        }
+    }
+    return 0;
+}
+
+static int trigram_order(const void *a, const void *b) {
+    uint32_t x = ((const IndexTrigram *)a)->key;
+    uint32_t y = ((const IndexTrigram *)b)->key;
+    return x < y ? -1 : x > y;
+}
+
+/* Build the trigram directory and posting lists from the finished records */
+static int build_trigrams(IndexBuilder *build) {
+    uint32_t records = build->header.record_count;
+    TrigramTable table;
+    if (records >= 0x80000000u || trigram_table_init(&table, TRIGRAM_TABLE_MIN) != 0) {
+        return -1;
+    }
+    
+    /* Pass 1: posting list lengths */
+    for (uint32_t n = 0; n < records; n++) {
+        if (record_trigrams(build, n, n + 1, &table, NULL) != 0) {
+            free(table.slots);
+            return -1;
+        }
+    }
+    
+    uint64_t total = 0;
+    uint32_t distinct = table.used;
+    build->trigrams = malloc((distinct ? distinct : 1) * sizeof(IndexTrigram));
+    if (!build->trigrams) {
+        free(table.slots);
+        return -1;
+    }
+    uint32_t t = 0;
+    for (uint32_t i = 0; i < table.capacity; i++) {
+        if (table.slots[i].key == TRIGRAM_EMPTY) continue;
+        build->trigrams[t].key = table.slots[i].key;
+        build->trigrams[t].count = table.slots[i].count;
+        total += table.slots[i].count;
+        t++;
+    }
+    
+    build->postings = malloc((size_t)(total ? total : 1) * sizeof(uint32_t));
+    if (!build->postings || total > UINT32_MAX / sizeof(uint32_t)) {
+        free(table.slots);
+        return -1;
+    }
+    
+    /* Directory in key order; each slot's count becomes its list's write cursor */
+    qsort(build->trigrams, distinct, sizeof(IndexTrigram), trigram_order);
+    uint32_t first = 0;
+    for (t = 0; t < distinct; t++) {
+        build->trigrams[t].first = first;
+        trigram_probe(table.slots, table.capacity, build->trigrams[t].key)->count = first;
+        first += build->trigrams[t].count;
+    }
+    
+    /* Pass 2: records in order, so every list comes out sorted */
+    for (uint32_t n = 0; n < records; n++) {
+        record_trigrams(build, n, (n + 1) | 0x80000000u, &table, build->postings);
+    }
+    
+    build->header.trigram_count = distinct;
+    build->header.posting_count = (uint32_t)total;
+    free(table.slots);
+    return 0;
+}
+
+static int facet_order(const void *a, const void *b) {
+    uint32_t x = ((const IndexFacet *)a)->hash;
+    uint32_t y = ((const IndexFacet *)b)->hash;
+    return x < y ? -1 : x > y;
+}
+
+/* Number of records in list[0..count) that share the chunk of list[0] */
+static uint32_t chunk_length(const uint32_t *list, uint32_t count) {
+    uint32_t len = 1;
+    while (len < count && list[len] >> 16 == list[0] >> 16) len++;
+    return len;
+}
+
+/* Encode each facet's record list as containers, one per chunk it touches */
+static int build_facets(IndexBuilder *build) {
+    IndexHeader *h = &build->header;
+    
+    /* Pass 1: sizes */
+    uint64_t containers = 0;
+    uint64_t words = 0;
+    for (uint32_t f = 0; f < h->facet_count; f++) {
+        const FacetBuild *facet = &build->facets[f];
+        for (uint32_t i = 0; i < facet->count; ) {
+            uint32_t len = chunk_length(facet->records + i, facet->count - i);
+            containers++;
+            words += len > FACET_ARRAY_MAX ? FACET_BITMAP_WORDS : len;
+            i += len;
+        }
+    }
+    if (containers > UINT32_MAX || words > UINT32_MAX / sizeof(uint16_t)) {
+        return -1;
+    }
+    
+    build->facet_table = malloc((h->facet_count ? h->facet_count : 1) * sizeof(IndexFacet));
+    build->containers = malloc((size_t)(containers ? containers : 1) * sizeof(IndexContainer));
+    build->facet_data = calloc((size_t)(words ? words : 1), sizeof(uint16_t));
+    if (!build->facet_table || !build->containers || !build->facet_data) {
+        return -1;
+    }
+    
+    /* Pass 2: contents */
+    uint32_t c = 0;
+    uint32_t offset = 0;
+    for (uint32_t f = 0; f < h->facet_count; f++) {
+        const FacetBuild *facet = &build->facets[f];
+        IndexFacet *entry = &build->facet_table[f];
+        const char *key = build->facet_keys.data + facet->key;
+        entry->hash = facet->hash;
+        entry->key = pool_add(&build->pool, key, strlen(key));
+        if (entry->key == UINT32_MAX) return -1;
+        entry->first = c;
+        entry->cardinality = facet->count;
+        
+        for (uint32_t i = 0; i < facet->count; ) {
+            uint32_t len = chunk_length(facet->records + i, facet->count - i);
+            IndexContainer *container = &build->containers[c++];
+            uint16_t *data = build->facet_data + offset;
+            container->high = (uint16_t)(facet->records[i] >> 16);
+            container->cardinality = len;
+            container->offset = offset;
+            
+            if (len > FACET_ARRAY_MAX) {
+                container->type = CONTAINER_BITMAP;
+                for (uint32_t j = 0; j < len; j++) {
+                    uint32_t low = facet->records[i + j] & 0xffff;
+                    data[low >> 4] |= (uint16_t)(1u << (low & 15));
+                }
+                offset += FACET_BITMAP_WORDS;
+            } else {
+                container->type = CONTAINER_ARRAY;
+                for (uint32_t j = 0; j < len; j++) {
+                    data[j] = (uint16_t)(facet->records[i + j] & 0xffff);
+                }
+                offset += len;
+            }
+            i += len;
+        }
+        entry->container_count = c - entry->first;
+    }
+    
+    qsort(build->facet_table, h->facet_count, sizeof(IndexFacet), facet_order);
+    h->container_count = c;
+    h->facet_data_size = offset;
+    return 0;
+}
+
+static int write_index_bin(const IndexBuilder *build, const char *tmp_path, const char *bin_path) {
+    const IndexHeader *h = &build->header;
+    
+    FILE *f = fopen(tmp_path, "wb");
+    if (!f) return -1;
+    
+    int ok = fwrite(h, sizeof(IndexHeader), 1, f) == 1 &&
+             fwrite(build->records, sizeof(IndexRecord), h->record_count, f) == h->record_count &&
+             fwrite(build->id_slots, sizeof(IndexSlot), h->id_slot_count, f) == h->id_slot_count &&
+             fwrite(build->name_slots, sizeof(IndexSlot), h->name_slot_count, f) == h->name_slot_count &&
+             fwrite(build->bloom, sizeof(uint32_t), h->bloom_words, f) == h->bloom_words &&
+             fwrite(build->trigrams, sizeof(IndexTrigram), h->trigram_count, f) == h->trigram_count &&
+             fwrite(build->postings, sizeof(uint32_t), h->posting_count, f) == h->posting_count &&
+             fwrite(build->facet_table, sizeof(IndexFacet), h->facet_count, f) == h->facet_count &&
+             fwrite(build->containers, sizeof(IndexContainer), h->container_count, f) == h->container_count &&
+             fwrite(build->facet_data, sizeof(uint16_t), h->facet_data_size, f) == h->facet_data_size &&
+             fwrite(build->pool.data, 1, build->pool.size, f) == build->pool.size;
+    ok = fclose(f) == 0 && ok;
+    
+    if (ok) {
+#ifdef _WIN32
+        remove(bin_path);
+#endif
+        ok = rename(tmp_path, bin_path) == 0;
+    }
+    if (!ok) {
+        remove(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Write index.bin for the packages added so far, stamped with the size
+ * and mtime of the index.json they were read from
+ */
+int index_builder_write(IndexBuilder *builder, long long source_mtime, long long source_size) {
+    char bin_path[MAX_PATH_LEN];
+    char tmp_path[MAX_PATH_LEN];
+    if (builder->failed || index_map_path(INDEX_BIN_FILENAME, bin_path, sizeof(bin_path)) != 0) {
+        return -1;
+    }
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", bin_path);
+    
+    IndexHeader *h = &builder->header;
+    h->source_mtime = (int64_t)source_mtime;
+    h->source_size = (int64_t)source_size;
+    
+    if (build_slots(builder) != 0 || build_bloom(builder) != 0 || build_trigrams(builder) != 0 ||
+        build_facets(builder) != 0) {
+        return -1;
+    }
+    
+    for (int f = 0; f < 4; f++) {
+        uint64_t average = h->record_count ? builder->total_length[f] / h->record_count : 0;
+        h->average_length[f] = average ? (uint32_t)average : 1;
+    }
+    
+    uint64_t offset = sizeof(IndexHeader);
+    h->records_offset = (uint32_t)offset;
+    offset += (uint64_t)h->record_count * sizeof(IndexRecord);
+    h->id_slots_offset = (uint32_t)offset;
+    offset += (uint64_t)h->id_slot_count * sizeof(IndexSlot);
+    h->name_slots_offset = (uint32_t)offset;
+    offset += (uint64_t)h->name_slot_count * sizeof(IndexSlot);
+    h->bloom_offset = (uint32_t)offset;
+    offset += (uint64_t)h->bloom_words * sizeof(uint32_t);
+    h->trigrams_offset = (uint32_t)offset;
+    offset += (uint64_t)h->trigram_count * sizeof(IndexTrigram);
+    h->postings_offset = (uint32_t)offset;
+    offset += (uint64_t)h->posting_count * sizeof(uint32_t);
+    h->facets_offset = (uint32_t)offset;
+    offset += (uint64_t)h->facet_count * sizeof(IndexFacet);
+    h->containers_offset = (uint32_t)offset;
+    offset += (uint64_t)h->container_count * sizeof(IndexContainer);
+    h->facet_data_offset = (uint32_t)offset;
+    offset += (uint64_t)h->facet_data_size * sizeof(uint16_t);
+    h->strings_offset = (uint32_t)offset;
+    h->strings_size = (uint32_t)builder->pool.size;
+    
+    /* Offsets are 32-bit */
+    if (offset + builder->pool.size > UINT32_MAX) {
+        return -1;
+    }
+    return write_index_bin(builder, tmp_path, bin_path);
+}
+
+void index_builder_free(IndexBuilder *builder) {
+    if (!builder) return;
+    free(builder->records);
+    free(builder->id_slots);
+    free(builder->name_slots);
+    free(builder->bloom);
+    free(builder->trigrams);
+    free(builder->postings);
+    for (uint32_t f = 0; f < builder->header.facet_count; f++) {
+        free(builder->facets[f].records);
+    }
+    free(builder->facets);
+    free(builder->facet_keys.data);
+    free(builder->facet_slots);
+    free(builder->facet_table);
+    free(builder->containers);
+    free(builder->facet_data);
+    free(builder->pool.data);
+    free(builder);
+}
+
+typedef struct {
+    IndexBuilder *builder;
+    int has_packages;
+} IndexSource;
+
+static int source_value(const char *member, const char *json, size_t len, void *ctx) {
+    (void)len;
+    IndexSource *source = ctx;
+    if (!json && strcmp(member, "packages") == 0) {
+        source->has_packages = 1;
+    }
+    return 0;
+}
+
+static int source_item(const char *member, const char *json, size_t len, void *ctx) {
+    (void)len;
+    IndexSource *source = ctx;
+    if (strcmp(member, "packages") != 0) {
+        return 0;
+    }
+    
+    cJSON *pkg = cJSON_Parse(json);
+    int result = pkg ? index_builder_add(source->builder, pkg) : -1;
+    cJSON_Delete(pkg);
+    return result;
+}
+
+/* Compile index.json into index.bin, reading one package at a time */
+int index_map_build(void) {
+    char json_path[MAX_PATH_LEN];
+    struct stat st;
+    if (index_map_path(INDEX_JSON_FILENAME, json_path, sizeof(json_path)) != 0 ||
+        stat(json_path, &st) != 0) {
+        return -1;
+    }
+    
+    /* Stamped before reading: if the file is replaced meanwhile, the result is stale and rebuilt */
+    IndexSource source;
+    source.builder = index_builder_new();
+    source.has_packages = 0;
+    if (!source.builder) {
+        return -1;
+    }
+    
+    int result = -1;
+    if (json_stream_file(json_path, source_value, source_item, &source) == 0 && source.has_packages) {
+        result = index_builder_write(source.builder, (long long)st.st_mtime, (long long)st.st_size);
+    }
+    index_builder_free(source.builder);
+    return result;
+}
+
+/* ============ Mapping ============ */
+
+static void unmap(IndexMap *map) {
+#ifdef _WIN32
+    if (map->base) UnmapViewOfFile(map->base);
+    if (map->mapping) CloseHandle(map->mapping);
+    if (map->file && map->file != INVALID_HANDLE_VALUE) CloseHandle(map->file);
+#else
+    if (map->base) munmap((void *)map->base, map->size);
+#endif
+    memset(map, 0, sizeof(IndexMap));
+}
+
+static int map_file(const char *path, IndexMap *map) {
+    memset(map, 0, sizeof(IndexMap));
+
+#ifdef _WIN32
+    map->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (map->file == INVALID_HANDLE_VALUE) return -1;
+    
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(map->file, &size) || size.QuadPart < (LONGLONG)sizeof(IndexHeader)) {
+        unmap(map);
+        return -1;
+    }
+    map->size = (size_t)size.QuadPart;
+    
+    map->mapping = CreateFileMappingA(map->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!map->mapping) {
+        unmap(map);
+        return -1;
+    }
+    map->base = MapViewOfFile(map->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!map->base) {
+        unmap(map);
+        return -1;
+    }
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(IndexHeader)) {
+        close(fd);
+        return -1;
+    }
+    
+    void *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return -1;
+    
+    map->base = base;
+    map->size = (size_t)st.st_size;
+#endif
+    return 0;
+}
+
+/* Check the header against the file size and the JSON it came from */
+static int map_validate(IndexMap *map, const struct stat *source) {
+    const IndexHeader *h = (const IndexHeader *)map->base;
+    
+    if (memcmp(h->magic, INDEX_BIN_MAGIC, sizeof(h->magic)) != 0 ||
+        h->version != INDEX_BIN_VERSION ||
+        h->source_mtime != (int64_t)source->st_mtime ||
+        h->source_size != (int64_t)source->st_size) {
+        return -1;
+    }
+    
+    /* Each section must lie inside the file */
+    uint64_t records_end = (uint64_t)h->records_offset + (uint64_t)h->record_count * sizeof(IndexRecord);
+    uint64_t ids_end = (uint64_t)h->id_slots_offset + (uint64_t)h->id_slot_count * sizeof(IndexSlot);
+    uint64_t names_end = (uint64_t)h->name_slots_offset + (uint64_t)h->name_slot_count * sizeof(IndexSlot);
+    uint64_t bloom_end = (uint64_t)h->bloom_offset + (uint64_t)h->bloom_words * sizeof(uint32_t);
+    uint64_t trigrams_end = (uint64_t)h->trigrams_offset + (uint64_t)h->trigram_count * sizeof(IndexTrigram);
+    uint64_t postings_end = (uint64_t)h->postings_offset + (uint64_t)h->posting_count * sizeof(uint32_t);
+    uint64_t facets_end = (uint64_t)h->facets_offset + (uint64_t)h->facet_count * sizeof(IndexFacet);
+    uint64_t containers_end = (uint64_t)h->containers_offset + (uint64_t)h->container_count * sizeof(IndexContainer);
+    uint64_t facet_data_end = (uint64_t)h->facet_data_offset + (uint64_t)h->facet_data_size * sizeof(uint16_t);
+    uint64_t strings_end = (uint64_t)h->strings_offset + h->strings_size;
+    
+    if (records_end > map->size || ids_end > map->size || names_end > map->size || bloom_end > map->size ||
+        trigrams_end > map->size || postings_end > map->size ||
+        facets_end > map->size || containers_end > map->size || facet_data_end > map->size ||
+        strings_end > map->size || h->strings_size == 0 ||
+        h->id_slot_count == 0 || (h->id_slot_count & (h->id_slot_count - 1)) != 0 ||
+        h->name_slot_count == 0 || (h->name_slot_count & (h->name_slot_count - 1)) != 0 ||
+        h->bloom_words < 2 || (h->bloom_words & (h->bloom_words - 1)) != 0 ||
+        h->bloom_hashes == 0 || h->bloom_hashes > 32 ||
+        (h->records_offset | h->id_slots_offset | h->name_slots_offset | h->bloom_offset |
+         h->trigrams_offset | h->postings_offset | h->facets_offset |
+         h->containers_offset) % 4 != 0 || h->facet_data_offset % 2 != 0) {
+        return -1;
+    }
+    
+    map->header = h;
+    map->records = (const IndexRecord *)(map->base + h->records_offset);
+    map->id_slots = (const IndexSlot *)(map->base + h->id_slots_offset);
+    map->name_slots = (const IndexSlot *)(map->base + h->name_slots_offset);
+    map->bloom = (const uint32_t *)(map->base + h->bloom_offset);
+    map->trigrams = (const IndexTrigram *)(map->base + h->trigrams_offset);
+    map->postings = (const uint32_t *)(map->base + h->postings_offset);
+    map->facets = (const IndexFacet *)(map->base + h->facets_offset);
+    map->containers = (const IndexContainer *)(map->base + h->containers_offset);
+    map->facet_data = (const uint16_t *)(map->base + h->facet_data_offset);
+    map->strings = (const char *)(map->base + h->strings_offset);
+    
+    /* The pool ends in a NUL, so any in-range offset is a valid string */
+    if (map->strings[h->strings_size - 1] != '\0') {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Map the compiled index, rebuilding it first if index.json changed
+ * since it was made. Returns NULL if no index is available.
+ */
+IndexMap* index_map_open(int force_refresh) {
+    if (index_ensure(force_refresh) != 0) {
+        return NULL;
+    }
+    
+    char json_path[MAX_PATH_LEN];
+    char bin_path[MAX_PATH_LEN];
+    struct stat source;
+    if (index_map_path(INDEX_JSON_FILENAME, json_path, sizeof(json_path)) != 0 ||
+        index_map_path(INDEX_BIN_FILENAME, bin_path, sizeof(bin_path)) != 0 ||
+        stat(json_path, &source) != 0) {
+        return NULL;
+    }
+    
+    IndexMap *map = malloc(sizeof(IndexMap));
+    if (!map) return NULL;
+    
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (map_file(bin_path, map) == 0) {
+            if (map_validate(map, &source) == 0) {
+                return map;
+            }
+            unmap(map);
+        }
+        
+        if (attempt == 0 && index_map_build() != 0) {
+            break;
+        }
+    }
+    
+    print_error("Failed to load registry index");
+    free(map);
+    return NULL;
+}
+
+void index_map_close(IndexMap *map) {
+    if (map) {
+        unmap(map);
+        free(map);
+    }
+}
+
+int index_map_count(const IndexMap *map) {
+    return (int)map->header->record_count;
+}
+
+static const char* map_string(const IndexMap *map, uint32_t offset) {
+    return offset < map->header->strings_size ? map->strings + offset : "";
+}
+
+void index_map_entry(const IndexMap *map, int index, IndexEntry *entry) {
+    const IndexRecord *record = &map->records[index];
+    entry->id = map_string(map, record->id);
+    entry->short_name = map_string(map, record->short_name);
+    entry->name = map_string(map, record->name);
+    entry->version = map_string(map, record->version);
+    entry->description = map_string(map, record->description);
+    entry->keywords = map_string(map, record->keywords);
+}
+
+/* Record number a slot points at, or -1 for a corrupt slot */
+static int slot_record(const IndexMap *map, const IndexSlot *slot) {
+    uint32_t record = slot->record & ~SLOT_ID_NAME;
+    return record >= 1 && record <= map->header->record_count ? (int)record - 1 : -1;
+}
+
+/* Record number of the package with this exact id, or -1 */
+int index_map_find_id(const IndexMap *map, const char *id) {
+    uint32_t hash = hash_name(id, strlen(id));
+    uint32_t mask = map->header->id_slot_count - 1;
+    
+    for (uint32_t i = hash & mask, probes = 0; probes <= mask; i = (i + 1) & mask, probes++) {
+        const IndexSlot *slot = &map->id_slots[i];
+        if (!slot->record) break;
+        if (slot->hash != hash) continue;
+        
+        int record = slot_record(map, slot);
+        if (record >= 0 && strcasecmp(map_string(map, map->records[record].id), id) == 0) {
+            return record;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Whether name may be a package id, shortName or the part of an id after
+ * the dot. 0 means it is certainly none of them; 1 is right about 99% of
+ * the time, so a lookup must still confirm it.
+ */
+int index_map_may_contain(const IndexMap *map, const char *name) {
+    const IndexHeader *h = map->header;
+    uint64_t hash = hash_bloom(name, strlen(name));
+    uint32_t step = (uint32_t)(hash >> 32) | 1;
+    uint32_t mask = h->bloom_words * 32 - 1;
+    for (uint32_t i = 0, bit = (uint32_t)hash; i < h->bloom_hashes; i++, bit += step) {
+        if (!(map->bloom[(bit & mask) >> 5] & (1u << (bit & 31)))) return 0;
+    }
+    return 1;
+}
+
+/* Records whose shortName, or id after the dot, equals name; the first max go in out[] */
+static int find_named(const IndexMap *map, const char *name, int *out, int max) {
+    uint32_t hash = hash_name(name, strlen(name));
+    uint32_t mask = map->header->name_slot_count - 1;
+    int matches = 0;
+    
+    for (uint32_t i = hash & mask, probes = 0; probes <= mask; i = (i + 1) & mask, probes++) {
+        const IndexSlot *slot = &map->name_slots[i];
+        if (!slot->record) break;
+        if (slot->hash != hash) continue;
+        
+        int record = slot_record(map, slot);
+        if (record < 0) continue;
+        
+        const char *key;
+        if (slot->record & SLOT_ID_NAME) {
+            key = strchr(map_string(map, map->records[record].id), '.');
+            key = key ? key + 1 : "";
+        } else {
+            key = map_string(map, map->records[record].short_name);
+        }
+        
+        if (strcasecmp(key, name) == 0) {
+            if (matches < max) out[matches] = record;
+            matches++;
+        }
+    }
+    return matches;
+}
+
+/*
+ * Packages whose shortName, or id after the dot, equals name. Returns
+ * how many there are; *found is set to one of them.
+ */
+int index_map_find_name(const IndexMap *map, const char *name, int *found) {
+    return find_named(map, name, found, 1);
+}
+
+/* ============ Search ============ */
+
+/*
+ * A record's strings sit back to back in the pool (id, short_name, name,
+ * version, description, keywords), so one pass over its span covers all
+ * fields. Facet keys follow the last record and belong to no span.
+ * Whether a hit counts depends on the field it starts in; a hit never
+ * crosses into the next field since the query holds no NUL.
+ */
+static uint32_t record_end(const IndexMap *map, uint32_t n) {
+    uint32_t end;
+    if (n + 1 < map->header->record_count) {
+        end = map->records[n + 1].id;
+    } else {
+        uint32_t keywords = map->records[n].keywords;
+        end = keywords + (uint32_t)strlen(map_string(map, keywords)) + 1;
+    }
+    return end < map->header->strings_size ? end : map->header->strings_size;
+}
+
+static int searchable_at(const IndexRecord *record, uint32_t offset) {
+    if (offset >= record->description) return 1;    /* description, keywords */
+    if (offset >= record->version) return 0;
+    if (offset >= record->name) return 1;
+    if (offset >= record->short_name) return 0;
+    return offset >= record->id;
+}
+
+static int record_matches(const IndexMap *map, uint32_t n, const char *query_lower, size_t qlen) {
+    const IndexRecord *record = &map->records[n];
+    uint32_t end = record_end(map, n);
+    
+    for (uint32_t pos = record->id; pos < end; ) {
+        const char *hit = match_find(map->strings + pos, end - pos, query_lower, qlen);
+        if (!hit) return 0;
+        
+        uint32_t offset = (uint32_t)(hit - map->strings);
+        if (searchable_at(record, offset)) return 1;
+        pos = offset + 1;
+    }
+    return 0;
+}
+
+/*
+ * Without trigrams to narrow things down, search the whole string pool
+ * in one pass and map each hit back to its record. Records own rising
+ * stretches of the pool, so the record cursor only moves forward.
+ */
+static int scan_pool(const IndexMap *map, const char *query_lower, size_t qlen, int *out) {
+    uint32_t records = map->header->record_count;
+    uint32_t size = records ? record_end(map, records - 1) : 0;
+    uint32_t n = 0;
+    uint32_t pos = records ? map->records[0].id : size;
+    int found = 0;
+    
+    while (n < records && pos < size) {
+        const char *hit = match_find(map->strings + pos, size - pos, query_lower, qlen);
+        if (!hit) break;
+        
+        uint32_t offset = (uint32_t)(hit - map->strings);
+        while (n + 1 < records && map->records[n + 1].id <= offset) n++;
+        
+        if (searchable_at(&map->records[n], offset)) {
+            out[found++] = (int)n;
+            pos = record_end(map, n);
+            n++;
+        } else {
+            pos = offset + 1;
+        }
+    }
+    return found;
+}
+
+static const IndexTrigram* trigram_find(const IndexMap *map, uint32_t key) {
+    uint32_t lo = 0;
+    uint32_t hi = map->header->trigram_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (map->trigrams[mid].key < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    
+    if (lo == map->header->trigram_count || map->trigrams[lo].key != key) return NULL;
+    
+    /* A run reaching past the postings section means a corrupt file */
+    const IndexTrigram *t = &map->trigrams[lo];
+    if ((uint64_t)t->first + t->count > map->header->posting_count) return NULL;
+    return t;
+}
+
+/*
+ * Whether a posting list holds record n. Candidates arrive in ascending
+ * order, so *cursor only moves forward and each list is walked once.
+ */
+static int posting_contains(const uint32_t *list, uint32_t count, uint32_t *cursor, uint32_t n) {
+    uint32_t lo = *cursor;
+    uint32_t step = 1;
+    uint32_t hi = lo;
+    
+    /* Gallop to a window that brackets n, then binary search it */
+    while (hi < count && list[hi] < n) {
+        lo = hi + 1;
+        hi += step;
+        step *= 2;
+    }
+    if (hi > count) hi = count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (list[mid] < n) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    
+    *cursor = lo;
+    return lo < count && list[lo] == n;
+}
+
+/* The facet with this key (any case), or NULL */
+static const IndexFacet* facet_find(const IndexMap *map, const char *key) {
+    uint32_t hash = hash_name(key, strlen(key));
+    uint32_t lo = 0;
+    uint32_t hi = map->header->facet_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (map->facets[mid].hash < hash) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    
+    for (; lo < map->header->facet_count && map->facets[lo].hash == hash; lo++) {
+        const IndexFacet *facet = &map->facets[lo];
+        if ((uint64_t)facet->first + facet->container_count > map->header->container_count) {
+            continue;   /* Corrupt */
+        }
+        if (strcasecmp(map_string(map, facet->key), key) == 0) {
+            return facet;
+        }
+    }
+    return NULL;
+}
+
+/* A container's words, or NULL if they run past the facet data */
+static const uint16_t* container_data(const IndexMap *map, const IndexContainer *container) {
+    uint64_t words = container->type == CONTAINER_BITMAP ? FACET_BITMAP_WORDS : container->cardinality;
+    if (container->offset + words > map->header->facet_data_size ||
+        (container->type == CONTAINER_ARRAY && container->cardinality > FACET_ARRAY_MAX)) {
+        return NULL;
+    }
+    return map->facet_data + container->offset;
+}
+
+/*
+ * Whether a facet holds record n. Candidates arrive in ascending order,
+ * so *cursor (a container of the facet) only moves forward.
+ */
+static int facet_contains(const IndexMap *map, const IndexFacet *facet, uint32_t *cursor, uint32_t n) {
+    const IndexContainer *containers = map->containers + facet->first;
+    uint32_t high = n >> 16;
+    while (*cursor < facet->container_count && containers[*cursor].high < high) {
+        (*cursor)++;
+    }
+    if (*cursor == facet->container_count || containers[*cursor].high != high) {
+        return 0;
+    }
+    
+    const IndexContainer *container = &containers[*cursor];
+    const uint16_t *data = container_data(map, container);
+    uint16_t low = (uint16_t)(n & 0xffff);
+    if (!data) return 0;
+    if (container->type == CONTAINER_BITMAP) {
+        return data[low >> 4] >> (low & 15) & 1;
+    }
+    
+    uint32_t lo = 0;
+    uint32_t hi = container->cardinality;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (data[mid] < low) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < container->cardinality && data[lo] == low;
+}
+
+/* Decode up to facet->cardinality record numbers, ascending, into out */
+static uint32_t facet_records(const IndexMap *map, const IndexFacet *facet, uint32_t *out) {
+    uint32_t count = 0;
+    for (uint32_t c = 0; c < facet->container_count; c++) {
+        const IndexContainer *container = &map->containers[facet->first + c];
+        const uint16_t *data = container_data(map, container);
+        uint32_t high = (uint32_t)container->high << 16;
+        if (!data) continue;
+        
+        if (container->type == CONTAINER_ARRAY) {
+            for (uint32_t i = 0; i < container->cardinality && count < facet->cardinality; i++) {
+                out[count++] = high | data[i];
+            }
+            continue;
+        }
+        for (uint32_t w = 0; w < FACET_BITMAP_WORDS; w++) {
+            for (uint32_t bits = data[w]; bits && count < facet->cardinality; bits &= bits - 1) {
+                uint32_t bit = 0;
+                while (!(bits >> bit & 1)) bit++;
+                out[count++] = high | w << 4 | bit;
+            }
+        }
+    }
+    return count;
+}
+
+/*
+ * Look up the facets a filter requires, narrowest first, and the one it
+ * excludes. Returns -1 if a required facet has no packages at all.
+ */
+static int filter_facets(const IndexMap *map, const IndexFilter *filter, const IndexFacet **facets,
+                         size_t *count, const IndexFacet **excluded) {
+    const char *prefixes[3] = { FACET_CATEGORY, FACET_TAG, FACET_RUNTIME };
+    const char *values[3] = { filter->category, filter->tag, filter->runtime };
+    
+    for (int i = 0; i < 3; i++) {
+        if (!values[i] || !values[i][0]) continue;
+        
+        char key[FACET_KEY_MAX];
+        snprintf(key, sizeof(key), "%s%s", prefixes[i], values[i]);
+        const IndexFacet *facet = facet_find(map, key);
+        if (!facet) return -1;
+        
+        size_t j = (*count)++;
+        while (j > 0 && facets[j - 1]->cardinality > facet->cardinality) {
+            facets[j] = facets[j - 1];
+            j--;
+        }
+        facets[j] = facet;
+    }
+    
+    *excluded = filter->no_deprecated ? facet_find(map, FACET_DEPRECATED) : NULL;
+    return 0;
+}
+
+/* Whether record n is in every facet and not the excluded one; cursors[count] is the latter's */
+static int facets_pass(const IndexMap *map, const IndexFacet **facets, size_t count,
+                       const IndexFacet *excluded, uint32_t *cursors, uint32_t n) {
+    for (size_t i = 0; i < count; i++) {
+        if (!facet_contains(map, facets[i], &cursors[i], n)) return 0;
+    }
+    return !excluded || !facet_contains(map, excluded, &cursors[count], n);
+}
+
+/*
+ * Records whose id, name, description or keywords contain query, any
+ * case, and that pass filter (may be NULL), in index order. An empty
+ * query matches every record. Returns how many; *matches is a malloc'd
+ * array the caller frees. Only the shortest candidate list is walked:
+ * the records of the narrowest facet, or of the query's rarest trigram
+ * (queries of three or more bytes). The rest are checked against it.
+ */
+int index_map_search(const IndexMap *map, const char *query, const IndexFilter *filter, int **matches) {
+    return index_map_search_within(map, query, filter, NULL, 0, matches);
+}
+
+/*
+ * index_map_search limited to within[0..within_count), ascending record
+ * numbers, unless within is NULL. Refining the results of a query that
+ * the new one contains only has to look at those results again.
+ */
+int index_map_search_within(const IndexMap *map, const char *query, const IndexFilter *filter,
+                            const int *within, int within_count, int **matches) {
+    size_t qlen = strlen(query);
+    uint32_t records = map->header->record_count;
+    *matches = NULL;
+    
+    char *query_lower = malloc(qlen + 1);
+    const IndexTrigram **lists = malloc((qlen > 2 ? qlen - 2 : 1) * sizeof(IndexTrigram*));
+    if (!query_lower || !lists) {
+        free(query_lower);
+        free(lists);
+        return -1;
+    }
+    for (size_t i = 0; i <= qlen; i++) {
+        query_lower[i] = (char)tolower((unsigned char)query[i]);
+    }
+    
+    const IndexFacet *facets[3];
+    size_t facet_count = 0;
+    const IndexFacet *excluded = NULL;
+    int empty = filter && filter_facets(map, filter, facets, &facet_count, &excluded) != 0;
+    
+    size_t list_count = 0;
+    for (size_t i = 0; !empty && i + 2 < qlen; i++) {
+        const IndexTrigram *t = trigram_find(map, trigram_key(query_lower + i));
+        if (!t) {
+            /* A trigram no package has: nothing can match */
+            empty = 1;
+            break;
+        }
+        
+        size_t j = 0;
+        while (j < list_count && lists[j] != t) j++;
+        if (j < list_count) continue;
+        
+        /* Keep the lists ordered shortest first */
+        j = list_count++;
+        while (j > 0 && lists[j - 1]->count > t->count) {
+            lists[j] = lists[j - 1];
+            j--;
+        }
+        lists[j] = t;
+    }
+    if (empty) {
+        free(lists);
+        free(query_lower);
+        return 0;
+    }
+    
+    /* A common trigram narrows little; one pass over the pool is cheaper */
+    if (list_count && lists[0]->count > records / 8) {
+        list_count = 0;
+    }
+    
+    /* Pick the candidates to walk; with none narrow enough, a query scans the pool */
+    uint32_t *facet_list = NULL;
+    const uint32_t *driver = NULL;
+    uint32_t candidates = records;
+    size_t first_list = 0;
+    size_t first_facet = 0;
+    int within_drives = within && (uint32_t)within_count <= (list_count ? lists[0]->count : records) &&
+                        (!facet_count || (uint32_t)within_count <= facets[0]->cardinality);
+    if (within_drives) {
+        /* Record numbers are never negative, so they read the same as uint32_t */
+        driver = (const uint32_t *)within;
+        candidates = (uint32_t)within_count;
+    } else if (facet_count && (list_count ? facets[0]->cardinality < lists[0]->count :
+                                     qlen == 0 || facets[0]->cardinality <= records / 8)) {
+        facet_list = malloc((facets[0]->cardinality ? facets[0]->cardinality : 1) * sizeof(uint32_t));
+        if (!facet_list) {
+            free(lists);
+            free(query_lower);
+            return -1;
+        }
+        candidates = facet_records(map, facets[0], facet_list);
+        driver = facet_list;
+        first_facet = 1;
+    } else if (list_count) {
+        driver = map->postings + lists[0]->first;
+        candidates = lists[0]->count;
+        first_list = 1;
+    }
+    
+    int *out = malloc((candidates ? candidates : 1) * sizeof(int));
+    uint32_t *cursors = calloc(list_count + facet_count + 1, sizeof(uint32_t));
+    if (!out || !cursors) {
+        free(out);
+        free(cursors);
+        free(facet_list);
+        free(lists);
+        free(query_lower);
+        return -1;
+    }
+    
+    /* When the caller's candidates are not walked, each hit is checked against them */
+    const uint32_t *within_list = within && !within_drives ? (const uint32_t *)within : NULL;
+    uint32_t within_cursor = 0;
+    
+    int found = 0;
+    if (!driver && qlen > 0) {
+        found = scan_pool(map, query_lower, qlen, out);
+        
+        int kept = 0;
+        for (int i = 0; i < found; i++) {
+            uint32_t n = (uint32_t)out[i];
+            if (facets_pass(map, facets, facet_count, excluded, cursors, n) &&
+                (!within_list || posting_contains(within_list, (uint32_t)within_count, &within_cursor, n))) {
+                out[kept++] = out[i];
+            }
+        }
+        found = kept;
+    } else {
+        uint32_t *facet_cursors = cursors + list_count;
+        for (uint32_t c = 0; c < candidates; c++) {
+            uint32_t n = driver ? driver[c] : c;
+            if (n >= records) continue;
+            
+            size_t j = first_list;
+            while (j < list_count &&
+                   posting_contains(map->postings + lists[j]->first, lists[j]->count, &cursors[j], n)) {
+                j++;
+            }
+            if (j < list_count) continue;
+            
+            if (!facets_pass(map, facets + first_facet, facet_count - first_facet, excluded,
+                             facet_cursors, n) ||
+                (within_list && !posting_contains(within_list, (uint32_t)within_count, &within_cursor, n))) {
+                continue;
+            }
+            
+            /* Trigrams can match out of order or across fields, so check for real */
+            if (qlen == 0 || record_matches(map, n, query_lower, qlen)) {
+                out[found++] = (int)n;
+            }
+        }
+    }
+    
+    free(cursors);
+    free(facet_list);
+    free(lists);
+    free(query_lower);
+    *matches = out;
+    return found;
+}
+
+/* ============ Ranking ============ */
+
+/*
+ * Matches are ordered by a BM25F score over id, name, description and
+ * keywords, scaled up by popularity (downloads and rating). Only the best
+ * k are kept, in a min-heap, so ranking n matches costs O(n log k) time
+ * and O(k) memory.
+ */
+
+#define RANK_MAX_TERMS 8
+#define RANK_K1 1.2
+#define RANK_B 0.75
+#define RANK_POPULARITY 1.0     /* A most-downloaded, 5-star package scores up to double */
+#define RANK_EXACT_NAME 10.0    /* Added when the query is the package's name */
+#define RANK_MAX_NAMED 16       /* Packages sharing one name that get the bonus */
+#define RANK_BUCKETS 64
+
+/* Weights of id, name, description and keywords, in header field order */
+static const double rank_weights[4] = { 3.0, 3.0, 1.0, 2.0 };
+
+typedef struct {
+    const char *text;       /* Lowercased, inside the query copy */
+    size_t len;
+    double idf;
+} RankTerm;
+
+typedef struct {
+    double score;
+    int record;
+} RankHit;
+
+/* Whether a ranks below b; ties go to the later record */
+static int hit_less(const RankHit *a, const RankHit *b) {
+    return a->score < b->score || (a->score == b->score && a->record > b->record);
+}
+
+static void heap_sift_down(RankHit *heap, int size, int i) {
+    for (;;) {
+        int low = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < size && hit_less(&heap[left], &heap[low])) low = left;
+        if (right < size && hit_less(&heap[right], &heap[low])) low = right;
+        if (low == i) return;
+        
+        RankHit tmp = heap[i];
+        heap[i] = heap[low];
+        heap[low] = tmp;
+        i = low;
+    }
+}
+
+static void heap_sift_up(RankHit *heap, int i) {
+    while (i > 0 && hit_less(&heap[i], &heap[(i - 1) / 2])) {
+        RankHit tmp = heap[i];
+        heap[i] = heap[(i - 1) / 2];
+        heap[(i - 1) / 2] = tmp;
+        i = (i - 1) / 2;
+    }
+}
+
+/*
+ * How many packages hold a term, estimated from the rarest of its
+ * trigrams (an upper bound). Terms shorter than a trigram count as common.
+ */
+static uint32_t term_frequency(const IndexMap *map, const RankTerm *term) {
+    uint32_t df = map->header->record_count;
+    for (size_t i = 0; i + 2 < term->len; i++) {
+        const IndexTrigram *t = trigram_find(map, trigram_key(term->text + i));
+        uint32_t count = t ? t->count : 0;
+        if (count < df) df = count;
+    }
+    return df;
+}
+
+/* What every record is scored against */
+typedef struct {
+    RankTerm terms[RANK_MAX_TERMS];
+    int term_count;
+    double relevance_max;       /* More than any record's text score */
+    double log_max_downloads;
+    int named[RANK_MAX_NAMED];  /* Records named exactly as the query */
+    int named_count;
+} RankQuery;
+
+/* What a match can score at most, known before its text is read */
+typedef struct {
+    double bound;
+    double popularity;
+    double bonus;
+} RankBound;
+
+/* Ranked field (index into rank_weights) at a pool offset inside record, or -1 */
+static int ranked_field(const IndexRecord *record, uint32_t offset) {
+    if (offset >= record->keywords) return 3;
+    if (offset >= record->description) return 2;
+    if (offset >= record->version) return -1;
+    if (offset >= record->name) return 1;
+    if (offset >= record->short_name) return -1;
+    return 0;
+}
+
+/* Length of the string at start, given where the next one begins */
+static double span_length(uint32_t start, uint32_t next) {
+    return next > start ? (double)(next - start - 1) : 0;
+}
+
+/* Popularity and name bonus of record n; neither needs its strings */
+static void record_bound(const IndexMap *map, const RankQuery *query, int n, RankBound *out) {
+    const IndexRecord *record = &map->records[n];
+    
+    out->popularity = 0.3 * (record->rating > 500 ? 500 : record->rating) / 500.0;
+    if (map->header->max_downloads) {
+        out->popularity += 0.7 * log1p((double)record->downloads) / query->log_max_downloads;
+    }
+    
+    out->bonus = 0;
+    for (int i = 0; i < query->named_count; i++) {
+        if (query->named[i] == n) out->bonus = RANK_EXACT_NAME;
+    }
+    
+    double scale = 1.0 + RANK_POPULARITY * out->popularity;
+    out->bound = (query->relevance_max + out->bonus) * scale + out->popularity * 1e-3;
+}
+
+/* Score of record n: its BM25F text score plus bonus, scaled by popularity */
+static double record_score(const IndexMap *map, const RankQuery *query, int n, const RankBound *bound) {
+    const IndexHeader *h = map->header;
+    const IndexRecord *record = &map->records[n];
+    
+    /* Fields lie back to back in the pool, so offsets give their lengths */
+    uint32_t end = record_end(map, (uint32_t)n);
+    const double lengths[4] = {
+        span_length(record->id, record->short_name), span_length(record->name, record->version),
+        span_length(record->description, record->keywords), span_length(record->keywords, end)
+    };
+    double length_norm[4];
+    for (int f = 0; f < 4; f++) {
+        double average = h->average_length[f] ? h->average_length[f] : 1;
+        length_norm[f] = 1.0 - RANK_B + RANK_B * lengths[f] / average;
+    }
+    
+    /* BM25F: field-weighted term frequencies, saturated once per term */
+    double score = 0;
+    for (int t = 0; t < query->term_count; t++) {
+        const RankTerm *term = &query->terms[t];
+        int counts[4] = { 0, 0, 0, 0 };
+        
+        /* One pass over the record's span; each hit counts for the field it is in */
+        for (uint32_t pos = record->id; pos < end; ) {
+            const char *hit = match_find(map->strings + pos, end - pos, term->text, term->len);
+            if (!hit) break;
+            
+            uint32_t offset = (uint32_t)(hit - map->strings);
+            int field = ranked_field(record, offset);
+            if (field >= 0) counts[field]++;
+            pos = offset + (uint32_t)term->len;
+        }
+        
+        double tf = 0;
+        for (int f = 0; f < 4; f++) {
+            if (counts[f]) tf += rank_weights[f] * counts[f] / length_norm[f];
+        }
+        score += term->idf * tf * (RANK_K1 + 1) / (tf + RANK_K1);
+    }
+    
+    /* Popularity alone still orders matches that score the same */
+    double scale = 1.0 + RANK_POPULARITY * bound->popularity;
+    return (score + bound->bonus) * scale + bound->popularity * 1e-3;
+}
+
+/*
+ * Order the records in matches[0..count) by relevance to query and put
+ * the best k of them in top[], best first. Returns how many were placed.
+ *
+ * Matches are first sorted into buckets by bound, and buckets are scored
+ * from the highest down. Once the heap is full, a bucket whose highest
+ * bound is below the heap's worst score ends the search, so usually only
+ * the popular part of a large result set has its text read.
+ */
+int index_map_rank(const IndexMap *map, const char *query, const int *matches, int count,
+                   int k, int *top) {
+    if (k <= 0 || count <= 0) {
+        return 0;
+    }
+    
+    size_t qlen = strlen(query);
+    char *words = malloc(qlen + 1);
+    RankHit *heap = malloc((size_t)(k < count ? k : count) * sizeof(RankHit));
+    RankBound *bounds = malloc((size_t)count * sizeof(RankBound));
+    int *order = malloc((size_t)count * sizeof(int));
+    if (!words || !heap || !bounds || !order) {
+        free(words);
+        free(heap);
+        free(bounds);
+        free(order);
+        return -1;
+    }
+    for (size_t i = 0; i <= qlen; i++) {
+        words[i] = (char)tolower((unsigned char)query[i]);
+    }
+    
+    RankQuery ranked;
+    ranked.term_count = 0;
+    ranked.relevance_max = 0;
+    ranked.log_max_downloads = log1p((double)map->header->max_downloads);
+    ranked.named_count = 0;
+    if (qlen > 0) {
+        ranked.named_count = find_named(map, words, ranked.named, RANK_MAX_NAMED);
+        if (ranked.named_count > RANK_MAX_NAMED) ranked.named_count = RANK_MAX_NAMED;
+    }
+    
+    /* Terms are the query's words; a repeated word counts once */
+    double records = map->header->record_count;
+    for (char *word = strtok(words, " \t"); word && ranked.term_count < RANK_MAX_TERMS;
+         word = strtok(NULL, " \t")) {
+        int seen = 0;
+        for (int t = 0; t < ranked.term_count; t++) {
+            if (strcmp(ranked.terms[t].text, word) == 0) seen = 1;
+        }
+        if (seen) continue;
+        
+        RankTerm *term = &ranked.terms[ranked.term_count++];
+        term->text = word;
+        term->len = strlen(word);
+        double df = term_frequency(map, term);
+        term->idf = log(1.0 + (records - df + 0.5) / (df + 0.5));
+        
+        /* A term adds less than idf * (k1 + 1), however often it occurs */
+        ranked.relevance_max += term->idf * (RANK_K1 + 1);
+    }
+    
+    /* Bound every match, then counting-sort them into buckets by bound */
+    double highest = 0;
+    for (int i = 0; i < count; i++) {
+        record_bound(map, &ranked, matches[i], &bounds[i]);
+        if (bounds[i].bound > highest) highest = bounds[i].bound;
+    }
+    
+    int starts[RANK_BUCKETS + 1];
+    double bucket_max[RANK_BUCKETS];
+    memset(starts, 0, sizeof(starts));
+    for (int b = 0; b < RANK_BUCKETS; b++) {
+        bucket_max[b] = -1;
+    }
+    double per_bucket = highest > 0 ? RANK_BUCKETS / highest : 0;
+    for (int i = 0; i < count; i++) {
+        int b = (int)(bounds[i].bound * per_bucket);
+        if (b >= RANK_BUCKETS) b = RANK_BUCKETS - 1;
+        starts[b + 1]++;
+        if (bounds[i].bound > bucket_max[b]) bucket_max[b] = bounds[i].bound;
+    }
+    for (int b = 0; b < RANK_BUCKETS; b++) {
+        starts[b + 1] += starts[b];
+    }
+    int fill[RANK_BUCKETS];
+    memcpy(fill, starts, sizeof(fill));
+    for (int i = 0; i < count; i++) {
+        int b = (int)(bounds[i].bound * per_bucket);
+        if (b >= RANK_BUCKETS) b = RANK_BUCKETS - 1;
+        order[fill[b]++] = i;
+    }
+    
+    /* Once the heap is full, matches that cannot beat its worst are skipped */
+    int size = 0;
+    for (int b = RANK_BUCKETS - 1; b >= 0; b--) {
+        if (size == k && bucket_max[b] < heap[0].score) break;
+        
+        for (int j = starts[b]; j < starts[b + 1]; j++) {
+            const RankBound *bound = &bounds[order[j]];
+            if (size == k && bound->bound < heap[0].score) continue;
+            
+            int n = matches[order[j]];
+            RankHit hit = { record_score(map, &ranked, n, bound), n };
+            if (size < k) {
+                heap[size] = hit;
+                heap_sift_up(heap, size++);
+            } else if (hit_less(&heap[0], &hit)) {
+                heap[0] = hit;
+                heap_sift_down(heap, size, 0);
+            }
+        }
+    }
+    
+    /* Pop the worst to the back until the heap is empty: best first */
+    for (int end = size - 1; end >= 0; end--) {
+        top[end] = heap[0].record;
+        heap[0] = heap[end];
+        heap_sift_down(heap, end, 0);
+    }
+    
+    free(words);
+    free(heap);
+    free(bounds);
+    free(order);
+    return size;
+}
@@ -37,11 +37,142 @@ static int build_manifest_url(const char *package_id, char *url, size_t url_size
     }
     
     snprintf(url, url_size, "%s/packages/%c/%s/%s/nex.json",
-        REGISTRY_BASE_URL, first_letter, author, name);
+        config_get_registry_url(), first_letter, author, name);
     
     return 0;
 }
 
+static cJSON* load_links_json(void) {
+    char home[MAX_PATH_LEN];
+    if (config_get_home_dir(home, sizeof(home)) != 0) return NULL;
+    
+    char links_file[MAX_PATH_LEN];
+    snprintf(links_file, sizeof(links_file), "%s%clinks.json", home, PATH_SEPARATOR);
+    
+    FILE *f = fopen(links_file, "r");
+    if (!f) return NULL;
+    
+    fseek(f, 0, SEEK_END);
+    long fsize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    
+    char *data = malloc(fsize + 1);
+    if (!data) {
+        fclose(f);
+        return NULL;
+    }
+    size_t got = fread(data, 1, fsize, f);
+    data[got] = '\0';
+    fclose(f);
+    
+    cJSON *json = cJSON_Parse(data);
+    free(data);
+    return json;
+}
+
+/* Does the package name part of an ID (after the dot) equal name? */
+static int id_has_name(const char *id, const char *name) {
+    const char *dot = strchr(id, '.');
+    return dot && strcasecmp(dot + 1, name) == 0;
+}
+
+/*
+ * Resolve a short name against installed and linked packages only, so
+ * running something already on disk never needs the registry. Returns
+ * the number of distinct matches; resolved_id holds the last one.
+ */
+static int resolve_local_name(const char *name, char *resolved_id, size_t resolved_size) {
+    int match_count = 0;
+    
+    LocalPackage *installed = NULL;
+    int installed_count = 0;
+    if (config_list_installed(&installed, &installed_count) == 0) {
+        for (int i = 0; i < installed_count; i++) {
+            if (id_has_name(installed[i].id, name)) {
+                strncpy(resolved_id, installed[i].id, resolved_size - 1);
+                resolved_id[resolved_size - 1] = '\0';
+                match_count++;
+            }
+        }
+        free(installed);
+    }
+    
+    cJSON *links = load_links_json();
+    cJSON *link;
+    cJSON_ArrayForEach(link, links) {
+        if (!link->string || !id_has_name(link->string, name)) continue;
+        
+        /* A linked package may also be in installed.json */
+        if (match_count > 0 && strcmp(resolved_id, link->string) == 0) continue;
+        
+        strncpy(resolved_id, link->string, resolved_size - 1);
+        resolved_id[resolved_size - 1] = '\0';
+        match_count++;
+    }
+    cJSON_Delete(links);
+    
+    return match_count;
+}
+
+/* How many installed and linked packages go by a short name */
+int package_count_local(const char *name) {
+    char resolved_id[MAX_NAME_LEN];
+    return resolve_local_name(name, resolved_id, sizeof(resolved_id));
+}
+
+/*
+ * Whether the registry is known not to have name (an id or short name),
+ * so asking it again is pointless: it said so moments ago, or an index
+ * synced moments ago rules the name out with its Bloom filter
+ */
+static int package_known_missing(const char *name) {
+    if (index_not_found_has(name)) {
+        return 1;
+    }
+    if (!index_recently_synced()) {
+        return 0;
+    }
+    
+    IndexMap *index = index_map_open(0);
+    if (!index) {
+        return 0;
+    }
+    int missing = !index_map_may_contain(index, name);
+    index_map_close(index);
+    return missing;
+}
+
+/* Resolve a short name from the full index. Returns the match count or -1 */
+static int resolve_index_name(const char *name, char *resolved_id, size_t resolved_size) {
+    IndexMap *index = index_map_open(0);
+    if (!index) {
+        return -1;
+    }
+    
+    int found = -1;
+    int match_count = index_map_find_name(index, name, &found);
+    
+    /* The cached index may predate the package; ask the registry once */
+    if (match_count == 0 && !http_is_offline() && !index_recently_synced()) {
+        index_map_close(index);
+        index = index_map_open(1);
+        if (!index) {
+            return -1;
+        }
+        match_count = index_map_find_name(index, name, &found);
+    }
+    
+    if (match_count > 0) {
+        IndexEntry entry;
+        index_map_entry(index, found, &entry);
+        strncpy(resolved_id, entry.id, resolved_size - 1);
+        resolved_id[resolved_size - 1] = '\0';
+    }
+    
+    index_map_close(index);
+    return match_count;
+}
+
 /* Resolve short name or full ID to full package ID */
 int package_resolve_name(const char *name_or_id, char *resolved_id, size_t resolved_size) {
     /* If it already contains a dot, assume it's a full ID */
@@ -51,63 +182,34 @@ int package_resolve_name(const char *name_or_id, char *resolved_id, size_t resol
         return 0;
     }
     
-    /* Fetch registry index to find the package */
-    HttpResponse *response = http_get(REGISTRY_INDEX_URL);
-    if (!response) {
-        print_error("Failed to fetch registry");
-        return -1;
+    /* Installed packages resolve without the registry */
+    if (resolve_local_name(name_or_id, resolved_id, resolved_size) == 1) {
+        return 0;
     }
     
-    if (response->status_code != 200) {
-        print_error("Failed to fetch registry (HTTP %ld)", response->status_code);
-        http_response_free(response);
+    /* Typos (and agents probing names) fail here without the network */
+    if (package_known_missing(name_or_id)) {
+        print_error("Package '%s' not found in registry", name_or_id);
         return -1;
     }
     
-    /* Parse JSON and search for matching shortName or name */
-    cJSON *json = cJSON_Parse(response->data);
-    http_response_free(response);
-    
-    if (!json) {
-        print_error("Failed to parse registry");
-        return -1;
+    /*
+     * Without a local index, the one shard that can hold the name is far
+     * cheaper than the whole index; registries without shards get the latter
+     */
+    int match_count = -1;
+    if (!index_available()) {
+        match_count = shard_resolve_name(name_or_id, resolved_id, resolved_size);
     }
-    
-    cJSON *packages = cJSON_GetObjectItemCaseSensitive(json, "packages");
-    if (!cJSON_IsArray(packages)) {
-        cJSON_Delete(json);
-        print_error("Invalid registry format");
-        return -1;
+    if (match_count < 0) {
+        match_count = resolve_index_name(name_or_id, resolved_id, resolved_size);
     }
-    
-    char found_id[MAX_NAME_LEN] = {0};
-    int match_count = 0;
-    
-    cJSON *pkg;
-    cJSON_ArrayForEach(pkg, packages) {
-        cJSON *id = cJSON_GetObjectItemCaseSensitive(pkg, "id");
-        cJSON *shortName = cJSON_GetObjectItemCaseSensitive(pkg, "shortName");
-        
-        /* Check shortName first (preferred) */
-        if (cJSON_IsString(shortName) && strcasecmp(shortName->valuestring, name_or_id) == 0) {
-            if (cJSON_IsString(id)) {
-                strncpy(found_id, id->valuestring, MAX_NAME_LEN - 1);
-                match_count++;
-            }
-        }
-        /* Also check the package name part of the ID (after the dot) */
-        else if (cJSON_IsString(id)) {
-            const char *dot = strchr(id->valuestring, '.');
-            if (dot && strcasecmp(dot + 1, name_or_id) == 0) {
-                strncpy(found_id, id->valuestring, MAX_NAME_LEN - 1);
-                match_count++;
-            }
-        }
+    if (match_count < 0) {
+        return -1;
     }
     
-    cJSON_Delete(json);
-    
     if (match_count == 0) {
+        if (!http_is_offline()) index_not_found_add(name_or_id);
         print_error("Package '%s' not found in registry", name_or_id);
         return -1;
     }
@@ -117,9 +219,6 @@ int package_resolve_name(const char *name_or_id, char *resolved_id, size_t resol
         return -1;
     }
     
-    strncpy(resolved_id, found_id, resolved_size - 1);
-    resolved_id[resolved_size - 1] = '\0';
-    
     return 0;
 }
 
@@ -227,12 +326,18 @@ int package_fetch_manifest(const char *package_id, PackageInfo *info) {
         return -1;
     }
     
+    if (package_known_missing(package_id)) {
+        print_error("Package not found (registry checked moments ago)");
+        return -1;
+    }
+    
     HttpResponse *response = http_get(url);
     if (!response) {
         return -1;
     }
     
     if (response->status_code != 200) {
+        if (response->status_code == 404) index_not_found_add(package_id);
         print_error("Package not found (HTTP %ld)", response->status_code);
         http_response_free(response);
         return -1;
@@ -244,11 +349,63 @@ int package_fetch_manifest(const char *package_id, PackageInfo *info) {
     return result;
 }
 
+/*
+ * Fetch several manifests concurrently. results[i] is 0 when infos[i] is
+ * valid. Returns how many were fetched, or -1 when the batch could not
+ * be sent at all
+ */
+int package_fetch_manifests(const char **package_ids, int count, PackageInfo *infos, int *results) {
+    if (count <= 0) return 0;
+    
+    /* Every entry is settled, even when nothing could be fetched */
+    for (int i = 0; i < count; i++) {
+        results[i] = -1;
+    }
+    
+    char (*urls)[MAX_URL_LEN] = calloc(count, MAX_URL_LEN);
+    const char **url_list = calloc(count, sizeof(char *));
+    if (!urls || !url_list) {
+        free(urls);
+        free(url_list);
+        return -1;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        if (!index_not_found_has(package_ids[i]) &&
+            build_manifest_url(package_ids[i], urls[i], MAX_URL_LEN) == 0) {
+            url_list[i] = urls[i];
+        }
+    }
+    
+    HttpResponse **responses = http_get_many(url_list, count, HTTP_MAX_PARALLEL);
+    free(url_list);
+    free(urls);
+    
+    if (!responses) {
+        return -1;
+    }
+    
+    int fetched = 0;
+    for (int i = 0; i < count; i++) {
+        if (responses[i] && responses[i]->status_code == 404) {
+            index_not_found_add(package_ids[i]);
+        }
+        if (responses[i] && responses[i]->status_code == 200 &&
+            package_parse_manifest(responses[i]->data, &infos[i]) == 0) {
+            results[i] = 0;
+            fetched++;
+        }
+    }
+    
+    http_responses_free(responses, count);
+    return fetched;
+}
+
 /* Fetch manifest and return raw JSON (caller must free) */
 static char* package_fetch_manifest_raw(const char *package_id) {
     char url[MAX_URL_LEN];
     
-    if (build_manifest_url(package_id, url, sizeof(url)) != 0) {
+    if (build_manifest_url(package_id, url, sizeof(url)) != 0 || package_known_missing(package_id)) {
         return NULL;
     }
     
@@ -258,6 +415,7 @@ static char* package_fetch_manifest_raw(const char *package_id) {
     }
     
     if (response->status_code != 200) {
+        if (response->status_code == 404) index_not_found_add(package_id);
         http_response_free(response);
         return NULL;
     }
@@ -275,6 +433,11 @@ static char* package_fetch_manifest_raw(const char *package_id) {
 int package_install(const char *package_id) {
     PackageInfo info;
     
+    if (http_is_offline()) {
+        print_error("Cannot install '%s' while offline", package_id);
+        return -1;
+    }
+    
     /* Fetch manifest and keep raw JSON */
     char *manifest_json = package_fetch_manifest_raw(package_id);
     if (!manifest_json) {
@@ -348,6 +511,7 @@ int package_install(const char *package_id) {
     local.is_installed = 1;
     
     config_save_local_package(&local);
+    plan_write(package_id, install_path);
     
     return 0;
 }
@@ -375,33 +539,14 @@ int package_remove(const char *package_id) {
     
     /* Remove from config */
     config_remove_local_package(package_id);
+    plan_remove(package_id);
     
     return 0;
 }
 
 /* Helper to check if a package is linked */
 static int check_package_link(const char *package_id, char *linked_path, size_t size) {
-    char home[MAX_PATH_LEN];
-    if (config_get_home_dir(home, sizeof(home)) != 0) return 0;
-    
-    char links_file[MAX_PATH_LEN];
-    snprintf(links_file, sizeof(links_file), "%s%clinks.json", home, PATH_SEPARATOR);
-    
-    FILE *f = fopen(links_file, "r");
-    if (!f) return 0;
-    
-    fseek(f, 0, SEEK_END);
-    long fsize = ftell(f);
-    fseek(f, 0, SEEK_SET);
-    
-    char *data = malloc(fsize + 1);
-    fread(data, 1, fsize, f);
-    data[fsize] = '\0';
-    fclose(f);
-    
-    cJSON *json = cJSON_Parse(data);
-    free(data);
-    
+    cJSON *json = load_links_json();
     if (!json) return 0;
     
     cJSON *item = cJSON_GetObjectItem(json, package_id);
@@ -465,126 +610,160 @@ int package_is_installed(const char *package_id, LocalPackage *local) {
     return 1;
 }
 
-int package_execute(const char *package_id, const char *command, int argc, char *argv[]) {
-    LocalPackage local;
+/*
+ * Read the manifest an installed package keeps in its directory
+ * (manifest.json, else nex.json). Returns 0 and fills info, and
+ * manifest_path when given, or -1 if there is none.
+ */
+int package_load_local(const char *install_path, PackageInfo *info, char *manifest_path, size_t size) {
+    char path[MAX_PATH_LEN];
+    snprintf(path, sizeof(path), "%s%cmanifest.json", install_path, PATH_SEPARATOR);
     
-    if (!package_is_installed(package_id, &local)) {
-        print_error("Package not installed");
-        return -1;
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        /* Try nex.json as alternative */
+        snprintf(path, sizeof(path), "%s%cnex.json", install_path, PATH_SEPARATOR);
+        f = fopen(path, "r");
     }
     
-    /* Read local manifest */
-    char manifest_path[MAX_PATH_LEN];
-    snprintf(manifest_path, sizeof(manifest_path), "%s%cmanifest.json",
-        local.install_path, PATH_SEPARATOR);
-    
-    FILE *f = fopen(manifest_path, "r");
+    memset(info, 0, sizeof(*info));
     if (!f) {
-        /* Try nex.json as alternative */
-        snprintf(manifest_path, sizeof(manifest_path), "%s%cnex.json",
-            local.install_path, PATH_SEPARATOR);
-        f = fopen(manifest_path, "r");
+        return -1;
     }
     
-    PackageInfo info;
-    memset(&info, 0, sizeof(info));
+    fseek(f, 0, SEEK_END);
+    long length = ftell(f);
+    fseek(f, 0, SEEK_SET);
     
-    if (f) {
-        fseek(f, 0, SEEK_END);
-        long size = ftell(f);
-        fseek(f, 0, SEEK_SET);
-        
-        char *json = malloc(size + 1);
-        if (json) {
-            fread(json, 1, size, f);
-            json[size] = '\0';
-            package_parse_manifest(json, &info);
-            free(json);
-        }
-        fclose(f);
+    char *json = malloc(length + 1);
+    if (json) {
+        fread(json, 1, length, f);
+        json[length] = '\0';
+        package_parse_manifest(json, info);
+        free(json);
     }
+    fclose(f);
     
-    /* Check if required runtime is available */
-    if (info.runtime != RUNTIME_UNKNOWN && info.runtime != RUNTIME_BINARY) {
-        if (runtime_ensure_available(info.runtime) != 0) {
-            print_error("Cannot run package without required runtime");
-            return -1;
-        }
+    if (manifest_path) {
+        snprintf(manifest_path, size, "%s", path);
     }
+    return 0;
+}
+
+/*
+ * The command line a package command runs: the manifest's command of that
+ * name, else the runtime started on the entrypoint. Returns -1 if neither.
+ */
+int package_command_line(const PackageInfo *info, const char *command, char *exec_cmd, size_t size) {
+    exec_cmd[0] = '\0';
     
-    /* Find command to execute */
-    char exec_cmd[MAX_COMMAND_LEN] = {0};
-    
-    for (int i = 0; i < info.command_count; i++) {
-        if (strcmp(info.commands[i].name, command) == 0) {
-            strncpy(exec_cmd, info.commands[i].command, MAX_COMMAND_LEN - 1);
+    for (int i = 0; i < info->command_count; i++) {
+        if (strcmp(info->commands[i].name, command) == 0) {
+            snprintf(exec_cmd, size, "%s", info->commands[i].command);
             break;
         }
     }
     
     /* Fallback to default entrypoint */
-    if (strlen(exec_cmd) == 0 && strlen(info.entrypoint) > 0) {
-        switch (info.runtime) {
+    if (strlen(exec_cmd) == 0 && strlen(info->entrypoint) > 0) {
+        switch (info->runtime) {
             case RUNTIME_PYTHON:
-                snprintf(exec_cmd, sizeof(exec_cmd), "python \"%s\"", info.entrypoint);
+                snprintf(exec_cmd, size, "python \"%s\"", info->entrypoint);
                 break;
             case RUNTIME_NODE:
-                snprintf(exec_cmd, sizeof(exec_cmd), "node \"%s\"", info.entrypoint);
+                snprintf(exec_cmd, size, "node \"%s\"", info->entrypoint);
                 break;
             case RUNTIME_POWERSHELL:
-                snprintf(exec_cmd, sizeof(exec_cmd), "powershell -File \"%s\"", info.entrypoint);
+                snprintf(exec_cmd, size, "powershell -File \"%s\"", info->entrypoint);
                 break;
             case RUNTIME_BASH:
-                snprintf(exec_cmd, sizeof(exec_cmd), "bash \"%s\"", info.entrypoint);
+                snprintf(exec_cmd, size, "bash \"%s\"", info->entrypoint);
                 break;
             default:
-                snprintf(exec_cmd, sizeof(exec_cmd), "\"%s\"", info.entrypoint);
+                snprintf(exec_cmd, size, "\"%s\"", info->entrypoint);
                 break;
         }
     }
     
     if (strlen(exec_cmd) == 0) {
-        print_error("No command '%s' found for package", command);
         return -1;
     }
     
     /* Normalize python command - use python3 if python doesn't exist */
 #ifndef _WIN32
-    if (info.runtime == RUNTIME_PYTHON) {
+    if (info->runtime == RUNTIME_PYTHON) {
         /* Check if 'python' exists, if not use 'python3' */
-        if (system("which python >/dev/null 2>&1") != 0 && 
-            system("which python3 >/dev/null 2>&1") == 0) {
+        if (process_find_program("python", NULL, 0) != 0 &&
+            process_find_program("python3", NULL, 0) == 0) {
             /* Replace "python " with "python3 " in the command */
             char temp_cmd[MAX_COMMAND_LEN];
             char *pos = strstr(exec_cmd, "python ");
             if (pos == exec_cmd || (pos && (*(pos-1) == ' ' || *(pos-1) == '&'))) {
                 size_t prefix_len = pos - exec_cmd;
-                strncpy(temp_cmd, exec_cmd, prefix_len);
-                temp_cmd[prefix_len] = '\0';
-                strcat(temp_cmd, "python3 ");
-                strcat(temp_cmd, pos + 7);  /* Skip "python " */
-                strncpy(exec_cmd, temp_cmd, MAX_COMMAND_LEN - 1);
+                snprintf(temp_cmd, sizeof(temp_cmd), "%.*spython3 %s", (int)prefix_len, exec_cmd, pos + 7);
+                snprintf(exec_cmd, size, "%s", temp_cmd);
             }
         }
     }
 #endif
+    return 0;
+}
+
+/*
+ * Run a command of an installed package from its directory. nex becomes
+ * the command, so this only returns on failure or under --timings, with
+ * the command's exit status. The package's run plan is rewritten on the
+ * way, so the next `nex run` can skip all of this (see plan.c).
+ */
+int package_execute(const char *package_id, const char *command, int argc, char *argv[]) {
+    LocalPackage local;
     
-    /* Build full command with args */
-    char full_cmd[MAX_COMMAND_LEN * 2];
-    snprintf(full_cmd, sizeof(full_cmd), "cd \"%s\" && %s", local.install_path, exec_cmd);
-    
-    /* Append user arguments */
-    for (int i = 0; i < argc; i++) {
-        strcat(full_cmd, " ");
-        /* Quote arguments with spaces */
-        if (strchr(argv[i], ' ')) {
-            strcat(full_cmd, "\"");
-            strcat(full_cmd, argv[i]);
-            strcat(full_cmd, "\"");
-        } else {
-            strcat(full_cmd, argv[i]);
+    if (!package_is_installed(package_id, &local)) {
+        print_error("Package not installed");
+        return -1;
+    }
+    
+    PackageInfo info;
+    package_load_local(local.install_path, &info, NULL, 0);
+    
+    /* Check if required runtime is available */
+    if (info.runtime != RUNTIME_UNKNOWN && info.runtime != RUNTIME_BINARY) {
+        if (runtime_ensure_available(info.runtime) != 0) {
+            print_error("Cannot run package without required runtime");
+            return -1;
         }
     }
     
-    return run_command(full_cmd);
+    /* Find command to execute */
+    char exec_cmd[MAX_COMMAND_LEN];
+    if (package_command_line(&info, command, exec_cmd, sizeof(exec_cmd)) != 0) {
+        print_error("No command '%s' found for package", command);
+        return -1;
+    }
+    
+    plan_write(package_id, local.install_path);
+    
+    /* Nothing more to fetch; save connection state before nex is replaced */
+    http_cleanup();
+    
+    /* Split once and exec directly; only commands that need sh get one */
+    int split_argc = 0;
+    char **split = command_split(exec_cmd, &split_argc);
+    if (!split) {
+        return process_run_shell(local.install_path, exec_cmd, argc, argv, 1);
+    }
+    
+    char **run_argv = malloc(((size_t)split_argc + (size_t)argc + 1) * sizeof(char*));
+    if (!run_argv) {
+        command_free(split);
+        return -1;
+    }
+    memcpy(run_argv, split, (size_t)split_argc * sizeof(char*));
+    memcpy(run_argv + split_argc, argv, (size_t)argc * sizeof(char*));
+    run_argv[split_argc + argc] = NULL;
+    
+    int result = process_run(local.install_path, run_argv, 1);
+    free(run_argv);
+    command_free(split);
+    return result;
 }
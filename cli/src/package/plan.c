@@ -0,0 +1,462 @@
+/*
+ * Run Plans - What `nex run` needs for a package, worked out in advance
+ *
+ * Running a package command means finding the package through links.json,
+ * parsing its manifest, picking the command, adapting it to the
+ * interpreters on this machine and splitting it into words. Install, link
+ * and any run that had to do all that store the outcome in
+ * ~/.nex/cache/plans/<id>.plan: the package directory, the runtime's
+ * interpreter and every command as an argv, its program already looked up
+ * on PATH. A plan is used only while the manifest, links.json and PATH are
+ * as they were when it was written; otherwise the run takes the long way
+ * and writes a new one. A short name is answered by the one plan file
+ * named for it, if no other local package had that name and installed.json
+ * has not changed since.
+ */
+
+#include "nex.h"
+#include <stdint.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define strcasecmp _stricmp
+#else
+#include <dirent.h>
+#include <strings.h>
+#endif
+
+#define PLAN_DIRNAME "plans"
+#define PLAN_MAGIC "NEXPLAN\n"
+#define PLAN_VERSION 1
+#define PLAN_MAX_SIZE (1 << 20)
+
+#define PLAN_SHELL 1u           /* Needs /bin/sh; its one word is the command line */
+#define PLAN_RESOLVED 2u        /* Its program was found on PATH when planned */
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t size;              /* Bytes after the header */
+    int64_t manifest_mtime;     /* The manifest this was built from */
+    int64_t manifest_size;
+    int64_t links_mtime;        /* links.json at the time; -1 if there was none */
+    int64_t links_size;
+    int64_t installed_mtime;    /* installed.json at the time, for short names */
+    int64_t installed_size;
+    uint64_t path_hash;         /* process_path_hash() at the time */
+    uint32_t command_count;
+    int32_t runtime;            /* RuntimeType of the manifest */
+    uint32_t name_unique;       /* No other local package had its short name */
+} PlanHeader;
+
+/*
+ * After the header come NUL-terminated strings and 32-bit numbers:
+ *   package directory, manifest path, interpreter ("" if none is needed)
+ *   per command: flags, argc, name ("" for the entrypoint), argv[argc]
+ */
+
+typedef struct {
+    char *data;
+    size_t size;
+    size_t capacity;
+    int failed;
+} PlanBuffer;
+
+typedef struct {
+    const char *at;
+    const char *end;
+} PlanReader;
+
+/* ============ Paths ============ */
+
+/* ~/.nex/cache/plans, or the plan of package_id in it */
+static int plan_path(const char *package_id, char *buffer, size_t size) {
+    char cache_dir[MAX_PATH_LEN];
+    if (config_get_cache_dir(cache_dir, sizeof(cache_dir)) != 0) {
+        return -1;
+    }
+    if (!package_id) {
+        snprintf(buffer, size, "%s%c%s", cache_dir, PATH_SEPARATOR, PLAN_DIRNAME);
+        return 0;
+    }
+    
+    /* The id becomes a file name */
+    if (!package_id[0] || package_id[0] == '.' || strpbrk(package_id, "/\\:")) {
+        return -1;
+    }
+    snprintf(buffer, size, "%s%c%s%c%s.plan", cache_dir, PATH_SEPARATOR,
+             PLAN_DIRNAME, PATH_SEPARATOR, package_id);
+    return 0;
+}
+
+/* Modification time and size of a file, or -1 for both if it is missing */
+static void file_stamp(const char *path, int64_t *mtime, int64_t *size) {
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        *mtime = (int64_t)st.st_mtime;
+        *size = (int64_t)st.st_size;
+    } else {
+        *mtime = -1;
+        *size = -1;
+    }
+}
+
+/* A file in ~/.nex: links.json decides where an id runs from, installed.json what a name means */
+static void home_stamp(const char *filename, int64_t *mtime, int64_t *size) {
+    char home[MAX_PATH_LEN];
+    char path[MAX_PATH_LEN];
+    *mtime = -1;
+    *size = -1;
+    if (config_get_home_dir(home, sizeof(home)) == 0) {
+        snprintf(path, sizeof(path), "%s%c%s", home, PATH_SEPARATOR, filename);
+        file_stamp(path, mtime, size);
+    }
+}
+
+/* Read the header of a plan; 0 if it is one this version wrote */
+static int read_header(FILE *f, PlanHeader *header) {
+    return fread(header, sizeof(*header), 1, f) == 1 &&
+           memcmp(header->magic, PLAN_MAGIC, sizeof(header->magic)) == 0 &&
+           header->version == PLAN_VERSION && header->size <= PLAN_MAX_SIZE ? 0 : -1;
+}
+
+/* ============ Writing ============ */
+
+static void put(PlanBuffer *buffer, const void *bytes, size_t length) {
+    if (buffer->failed) return;
+    if (buffer->size + length > buffer->capacity) {
+        size_t grown = buffer->capacity ? buffer->capacity * 2 : 1024;
+        while (grown < buffer->size + length) grown *= 2;
+        char *resized = realloc(buffer->data, grown);
+        if (!resized) {
+            buffer->failed = 1;
+            return;
+        }
+        buffer->data = resized;
+        buffer->capacity = grown;
+    }
+    memcpy(buffer->data + buffer->size, bytes, length);
+    buffer->size += length;
+}
+
+static void put_string(PlanBuffer *buffer, const char *text) {
+    put(buffer, text, strlen(text) + 1);
+}
+
+static void put_number(PlanBuffer *buffer, uint32_t value) {
+    put(buffer, &value, sizeof(value));
+}
+
+/* One command, split into words unless it needs a shell */
+static void put_command(PlanBuffer *buffer, const char *name, const char *line) {
+    int argc = 0;
+    char **words = command_split(line, &argc);
+    if (!words) {
+        put_number(buffer, PLAN_SHELL);
+        put_number(buffer, 1);
+        put_string(buffer, name);
+        put_string(buffer, line);
+        return;
+    }
+    
+    /* execvp would look along PATH for this on every run */
+    char program[MAX_PATH_LEN];
+    uint32_t flags = 0;
+    if (!strchr(words[0], '/') && !strchr(words[0], PATH_SEPARATOR) &&
+        process_find_program(words[0], program, sizeof(program)) == 0) {
+        flags |= PLAN_RESOLVED;
+    }
+    
+    put_number(buffer, flags);
+    put_number(buffer, (uint32_t)argc);
+    put_string(buffer, name);
+    put_string(buffer, (flags & PLAN_RESOLVED) ? program : words[0]);
+    for (int i = 1; i < argc; i++) {
+        put_string(buffer, words[i]);
+    }
+    command_free(words);
+}
+
+/*
+ * Work out and store how to run each command of the package installed in
+ * install_path. Returns -1 without writing one if the package has no
+ * manifest or its runtime is missing; that run must go the long way,
+ * which offers to install the runtime.
+ */
+int plan_write(const char *package_id, const char *install_path) {
+    char dir[MAX_PATH_LEN];
+    char path[MAX_PATH_LEN];
+    char tmp_path[MAX_PATH_LEN];
+    if (plan_path(NULL, dir, sizeof(dir)) != 0 || plan_path(package_id, path, sizeof(path)) != 0) {
+        return -1;
+    }
+    
+    PackageInfo info;
+    char manifest_path[MAX_PATH_LEN];
+    if (package_load_local(install_path, &info, manifest_path, sizeof(manifest_path)) != 0) {
+        return -1;
+    }
+    
+    char interpreter[MAX_PATH_LEN] = "";
+    if (info.runtime != RUNTIME_UNKNOWN && info.runtime != RUNTIME_BINARY &&
+        runtime_find(info.runtime, interpreter, sizeof(interpreter)) != 0) {
+        return -1;
+    }
+    
+    PlanHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PLAN_MAGIC, sizeof(header.magic));
+    header.version = PLAN_VERSION;
+    header.path_hash = process_path_hash();
+    header.runtime = (int32_t)info.runtime;
+    file_stamp(manifest_path, &header.manifest_mtime, &header.manifest_size);
+    home_stamp("links.json", &header.links_mtime, &header.links_size);
+    home_stamp("installed.json", &header.installed_mtime, &header.installed_size);
+    
+    const char *dot = strchr(package_id, '.');
+    header.name_unique = dot && package_count_local(dot + 1) == 1;
+    
+    PlanBuffer body = { NULL, 0, 0, 0 };
+    put_string(&body, install_path);
+    put_string(&body, manifest_path);
+    put_string(&body, interpreter);
+    
+    /* The manifest's commands, then the entrypoint under the name "" */
+    for (int i = 0; i <= info.command_count; i++) {
+        const char *name = i < info.command_count ? info.commands[i].name : "";
+        char line[MAX_COMMAND_LEN];
+        if (package_command_line(&info, name, line, sizeof(line)) != 0) {
+            continue;
+        }
+        put_command(&body, name, line);
+        header.command_count++;
+    }
+    header.size = (uint32_t)body.size;
+    
+    if (body.failed || body.size > PLAN_MAX_SIZE || make_directory_recursive(dir) != 0) {
+        free(body.data);
+        return -1;
+    }
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    
+    FILE *f = fopen(tmp_path, "wb");
+    int ok = f && fwrite(&header, sizeof(header), 1, f) == 1 &&
+             fwrite(body.data, 1, body.size, f) == body.size;
+    if (f && fclose(f) != 0) ok = 0;
+    free(body.data);
+    
+    if (ok) {
+#ifdef _WIN32
+        remove(path);
+#endif
+        if (rename(tmp_path, path) == 0) return 0;
+    }
+    remove(tmp_path);
+    return -1;
+}
+
+/*
+ * The id of the one package with a plan that goes by short name, if the
+ * plan can answer for the name: returns 0 and fills package_id, else -1
+ */
+int plan_find(const char *name, char *package_id, size_t size) {
+    char dir[MAX_PATH_LEN];
+    char found[MAX_NAME_LEN] = "";
+    int matches = 0;
+    if (plan_path(NULL, dir, sizeof(dir)) != 0) {
+        return -1;
+    }
+
+#ifdef _WIN32
+    char pattern[MAX_PATH_LEN];
+    snprintf(pattern, sizeof(pattern), "%s\\*.plan", dir);
+    WIN32_FIND_DATAA fd;
+    HANDLE find = FindFirstFileA(pattern, &fd);
+    if (find == INVALID_HANDLE_VALUE) return -1;
+    do {
+        const char *entry = fd.cFileName;
+#else
+    DIR *d = opendir(dir);
+    if (!d) return -1;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        const char *entry = de->d_name;
+#endif
+        size_t length = strlen(entry);
+        if (length <= 5 || length - 5 >= sizeof(found) || strcmp(entry + length - 5, ".plan") != 0) {
+            continue;
+        }
+        
+        char id[MAX_NAME_LEN];
+        memcpy(id, entry, length - 5);
+        id[length - 5] = '\0';
+        const char *dot = strchr(id, '.');
+        if (dot && strcasecmp(dot + 1, name) == 0) {
+            snprintf(found, sizeof(found), "%s", id);
+            matches++;
+        }
+#ifdef _WIN32
+    } while (FindNextFileA(find, &fd));
+    FindClose(find);
+#else
+    }
+    closedir(d);
+#endif
+
+    if (matches != 1) {
+        return -1;
+    }
+    
+    /* Still the only local package of that name */
+    char path[MAX_PATH_LEN];
+    PlanHeader header;
+    FILE *f = plan_path(found, path, sizeof(path)) == 0 ? fopen(path, "rb") : NULL;
+    if (!f) {
+        return -1;
+    }
+    int ok = read_header(f, &header) == 0;
+    fclose(f);
+    
+    int64_t mtime, length;
+    home_stamp("installed.json", &mtime, &length);
+    if (!ok || !header.name_unique || mtime != header.installed_mtime || length != header.installed_size) {
+        return -1;
+    }
+    snprintf(package_id, size, "%s", found);
+    return 0;
+}
+
+/* Forget the plan of a package that is no longer installed */
+void plan_remove(const char *package_id) {
+    char path[MAX_PATH_LEN];
+    if (plan_path(package_id, path, sizeof(path)) == 0) {
+        remove(path);
+    }
+}
+
+/* ============ Running ============ */
+
+static const char* get_string(PlanReader *reader) {
+    const char *text = reader->at;
+    const char *nul = memchr(text, '\0', (size_t)(reader->end - text));
+    if (!nul) {
+        reader->at = reader->end;
+        return NULL;
+    }
+    reader->at = nul + 1;
+    return text;
+}
+
+static int get_number(PlanReader *reader, uint32_t *value) {
+    if ((size_t)(reader->end - reader->at) < sizeof(*value)) {
+        return -1;
+    }
+    memcpy(value, reader->at, sizeof(*value));
+    reader->at += sizeof(*value);
+    return 0;
+}
+
+/* Whether a file still exists where the plan found it */
+static int still_there(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0;
+}
+
+/*
+ * Run command of package_id from its plan, followed by argv. Returns 0
+ * with the outcome in result (see package_execute) if it was run, or -1
+ * if there is no current plan that knows the command; the caller then
+ * goes through package_execute, which also writes a new plan.
+ */
+int plan_run(const char *package_id, const char *command, int argc, char *argv[], int *result) {
+    char path[MAX_PATH_LEN];
+    FILE *f = plan_path(package_id, path, sizeof(path)) == 0 ? fopen(path, "rb") : NULL;
+    if (!f) {
+        return -1;
+    }
+    
+    PlanHeader header;
+    char *body = NULL;
+    int ok = read_header(f, &header) == 0 &&
+             (body = malloc(header.size + 1)) != NULL &&
+             fread(body, 1, header.size, f) == header.size;
+    fclose(f);
+    
+    /* A link made or removed since may point the id somewhere else */
+    int64_t mtime, size;
+    home_stamp("links.json", &mtime, &size);
+    if (!ok || header.path_hash != process_path_hash() ||
+        mtime != header.links_mtime || size != header.links_size) {
+        free(body);
+        return -1;
+    }
+    
+    PlanReader reader = { body, body + header.size };
+    const char *dir = get_string(&reader);
+    const char *manifest_path = get_string(&reader);
+    const char *interpreter = get_string(&reader);
+    if (interpreter) {
+        file_stamp(manifest_path, &mtime, &size);
+    }
+    if (!interpreter || mtime != header.manifest_mtime || size != header.manifest_size ||
+        (interpreter[0] && !still_there(interpreter))) {
+        free(body);
+        return -1;
+    }
+    
+    /* The command of that name, else the entrypoint */
+    const char *chosen = NULL;
+    uint32_t chosen_flags = 0, chosen_argc = 0;
+    for (uint32_t i = 0; i < header.command_count; i++) {
+        uint32_t flags, words;
+        const char *name;
+        if (get_number(&reader, &flags) != 0 || get_number(&reader, &words) != 0 ||
+            !(name = get_string(&reader)) || words == 0) {
+            break;
+        }
+        
+        int named = strcmp(name, command) == 0;
+        if (named || (!name[0] && !chosen)) {
+            chosen = reader.at;
+            chosen_flags = flags;
+            chosen_argc = words;
+        }
+        for (uint32_t w = 0; w < words; w++) {
+            get_string(&reader);
+        }
+        if (named) break;
+    }
+    if (!chosen) {
+        free(body);
+        return -1;
+    }
+    
+    char **run_argv = malloc(((size_t)chosen_argc + (size_t)argc + 1) * sizeof(char*));
+    reader.at = chosen;
+    for (uint32_t w = 0; run_argv && w < chosen_argc; w++) {
+        run_argv[w] = (char *)get_string(&reader);
+        if (!run_argv[w]) {
+            free(run_argv);
+            run_argv = NULL;
+        }
+    }
+    if (!run_argv || ((chosen_flags & PLAN_RESOLVED) && !still_there(run_argv[0]))) {
+        free(run_argv);
+        free(body);
+        return -1;
+    }
+    memcpy(run_argv + chosen_argc, argv, (size_t)argc * sizeof(char*));
+    run_argv[chosen_argc + argc] = NULL;
+    
+    /* Nothing more to fetch; save connection state before nex is replaced */
+    http_cleanup();
+    
+    if (chosen_flags & PLAN_SHELL) {
+        *result = process_run_shell(dir, run_argv[0], argc, argv, 1);
+    } else {
+        *result = process_run(dir, run_argv, 1);
+    }
+    free(run_argv);
+    free(body);
+    return 0;
+}
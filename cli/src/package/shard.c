@@ -0,0 +1,368 @@
+/*
+ * Registry Index Shards - Resolve a name from one slice of the index
+ *
+ * Without a local index.json, resolving a single short name used to mean
+ * downloading the whole index first. Registries that support it split the
+ * index into shards by a hash of the package name (the id after the dot)
+ * and list each shard's version in a small manifest at /packages/shards.
+ * Only the shard that can hold the name is fetched; both are kept in
+ * ~/.nex/shards, the manifest for index_ttl seconds and a shard until the
+ * manifest lists a new version of it.
+ */
+
+#include "nex.h"
+#include "cJSON.h"
+#include <stdint.h>
+#include <ctype.h>
+#include <time.h>
+#include <sys/stat.h>
+
+/* Windows compatibility */
+#ifdef _WIN32
+#define strcasecmp _stricmp
+#endif
+
+#define SHARD_DIRNAME "shards"
+#define SHARD_MANIFEST_FILENAME "manifest.json"
+#define SHARD_MAX_COUNT 4096
+#define SHARD_DEFAULT_TTL 3600      /* seconds, as index_ttl */
+
+/* Set once this process has fetched the manifest itself */
+static int manifest_fetched = 0;
+
+/* FNV-1a of the ASCII-lowercased name part of an id, as the registry computes it */
+static uint32_t shard_hash(const char *id) {
+    const char *dot = strchr(id, '.');
+    const unsigned char *p = (const unsigned char *)(dot ? dot + 1 : id);
+    uint32_t hash = 2166136261u;
+    for (; *p; p++) {
+        hash ^= (uint32_t)(*p >= 'A' && *p <= 'Z' ? *p + 32 : *p);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* ~/.nex/shards, or a file in it */
+static int shard_path(char *buffer, size_t size, const char *filename) {
+    char home[MAX_PATH_LEN];
+    if (config_get_home_dir(home, sizeof(home)) != 0) {
+        return -1;
+    }
+    if (filename) {
+        snprintf(buffer, size, "%s%c%s%c%s", home, PATH_SEPARATOR, SHARD_DIRNAME,
+                 PATH_SEPARATOR, filename);
+    } else {
+        snprintf(buffer, size, "%s%c%s", home, PATH_SEPARATOR, SHARD_DIRNAME);
+    }
+    return 0;
+}
+
+/* The manifest's shard count, or -1 unless it is well formed */
+static int manifest_count(const cJSON *manifest) {
+    cJSON *count = cJSON_GetObjectItemCaseSensitive(manifest, "count");
+    cJSON *shards = cJSON_GetObjectItemCaseSensitive(manifest, "shards");
+    if (!cJSON_IsNumber(count) || !cJSON_IsArray(shards) ||
+        count->valueint <= 0 || count->valueint > SHARD_MAX_COUNT ||
+        cJSON_GetArraySize(shards) != count->valueint) {
+        return -1;
+    }
+    return count->valueint;
+}
+
+static const char* manifest_version(const cJSON *manifest, int shard) {
+    cJSON *shards = cJSON_GetObjectItemCaseSensitive(manifest, "shards");
+    cJSON *entry = cJSON_GetArrayItem(shards, shard);
+    cJSON *version = cJSON_GetObjectItemCaseSensitive(entry, "version");
+    return cJSON_IsString(version) ? version->valuestring : NULL;
+}
+
+static cJSON* manifest_read(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    
+    char *content = size > 0 ? malloc((size_t)size + 1) : NULL;
+    if (!content) {
+        fclose(f);
+        return NULL;
+    }
+    size_t got = fread(content, 1, (size_t)size, f);
+    content[got] = '\0';
+    fclose(f);
+    
+    cJSON *manifest = cJSON_Parse(content);
+    free(content);
+    if (manifest && manifest_count(manifest) < 0) {
+        cJSON_Delete(manifest);
+        manifest = NULL;
+    }
+    return manifest;
+}
+
+static int file_sink(const char *data, size_t size, void *ctx) {
+    return fwrite(data, 1, size, (FILE *)ctx) == size ? 0 : -1;
+}
+
+/*
+ * Ask the registry for the manifest and keep a copy. NULL on any failure,
+ * including a 404 from a registry that does not publish shards. Streamed
+ * rather than through http_get, whose response cache would hide a new one.
+ */
+static cJSON* manifest_fetch(const char *path) {
+    char index_url[MAX_URL_LEN];
+    char url[MAX_URL_LEN];
+    char dir[MAX_PATH_LEN];
+    char tmp_path[MAX_PATH_LEN];
+    config_get_registry_index_url(index_url, sizeof(index_url));
+    snprintf(url, sizeof(url), "%s/shards", index_url);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    manifest_fetched = 1;
+    
+    FILE *f = NULL;
+    if (shard_path(dir, sizeof(dir), NULL) == 0 && make_directory_recursive(dir) == 0) {
+        f = fopen(tmp_path, "wb");
+    }
+    if (!f) {
+        return NULL;
+    }
+    
+    long status = http_get_stream(url, file_sink, f);
+    int closed = fclose(f);
+    cJSON *manifest = status == 200 && closed == 0 ? manifest_read(tmp_path) : NULL;
+    if (!manifest) {
+        remove(tmp_path);
+        return NULL;
+    }
+
+#ifdef _WIN32
+    remove(path);
+#endif
+    if (rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+    }
+    return manifest;
+}
+
+/*
+ * The shard manifest: the copy on disk while younger than index_ttl (or
+ * at any age when offline), else a fresh one. With refresh the registry
+ * is asked again, unless this process already did.
+ */
+static cJSON* manifest_load(int refresh) {
+    char path[MAX_PATH_LEN];
+    if (shard_path(path, sizeof(path), SHARD_MANIFEST_FILENAME) != 0) {
+        return NULL;
+    }
+    
+    if (refresh) {
+        return manifest_fetched || http_is_offline() ? NULL : manifest_fetch(path);
+    }
+    
+    struct stat st;
+    int cached = stat(path, &st) == 0;
+    long ttl = config_get_long("index_ttl", SHARD_DEFAULT_TTL);
+    if (cached && (http_is_offline() || manifest_fetched || time(NULL) - st.st_mtime <= ttl)) {
+        cJSON *manifest = manifest_read(path);
+        if (manifest) return manifest;
+    }
+    return http_is_offline() ? NULL : manifest_fetch(path);
+}
+
+/*
+ * One pass over a shard, from its cached file or while it downloads.
+ * Packages are only parsed when their raw text mentions the name.
+ */
+typedef struct {
+    const char *name;
+    char name_lower[MAX_NAME_LEN];
+    size_t name_length;
+    const char *version;        /* Expected version; NULL accepts any */
+    char *resolved_id;
+    size_t resolved_size;
+    int matches;
+    int has_packages;
+    int stale;                  /* The shard is not the version expected */
+    int failed;
+    FILE *out;
+    JsonStream json;
+} ShardScan;
+
+static int scan_value(const char *member, const char *json, size_t len, void *ctx) {
+    ShardScan *scan = ctx;
+    if (!json) {
+        if (strcmp(member, "packages") == 0) scan->has_packages = 1;
+        return 0;
+    }
+    if (strcmp(member, "version") != 0 || !scan->version) {
+        return 0;
+    }
+    
+    size_t expected = strlen(scan->version);
+    if (len != expected + 2 || json[0] != '"' || memcmp(json + 1, scan->version, expected) != 0) {
+        scan->stale = 1;
+        return scan->out ? 0 : 1;   /* A cached copy is refetched anyway */
+    }
+    return 0;
+}
+
+static int scan_item(const char *member, const char *json, size_t len, void *ctx) {
+    (void)len;
+    ShardScan *scan = ctx;
+    if (strcmp(member, "packages") != 0 ||
+        !match_contains(json, scan->name_lower, scan->name_length)) {
+        return 0;
+    }
+    
+    cJSON *pkg = cJSON_Parse(json);
+    if (!pkg) return -1;
+    
+    cJSON *id = cJSON_GetObjectItemCaseSensitive(pkg, "id");
+    cJSON *short_name = cJSON_GetObjectItemCaseSensitive(pkg, "shortName");
+    const char *dot = cJSON_IsString(id) ? strchr(id->valuestring, '.') : NULL;
+    if (cJSON_IsString(id) &&
+        ((dot && strcasecmp(dot + 1, scan->name) == 0) ||
+         (cJSON_IsString(short_name) && strcasecmp(short_name->valuestring, scan->name) == 0))) {
+        strncpy(scan->resolved_id, id->valuestring, scan->resolved_size - 1);
+        scan->resolved_id[scan->resolved_size - 1] = '\0';
+        scan->matches++;
+    }
+    cJSON_Delete(pkg);
+    return 0;
+}
+
+static int scan_sink(const char *data, size_t size, void *ctx) {
+    ShardScan *scan = ctx;
+    if (fwrite(data, 1, size, scan->out) != size) {
+        scan->failed = 1;
+        return -1;
+    }
+    return json_stream_feed(&scan->json, data, size);
+}
+
+static void scan_init(ShardScan *scan, const char *name, const char *version,
+                      char *resolved_id, size_t resolved_size) {
+    memset(scan, 0, sizeof(ShardScan));
+    scan->name = name;
+    scan->version = version;
+    scan->resolved_id = resolved_id;
+    scan->resolved_size = resolved_size;
+    
+    for (; name[scan->name_length] && scan->name_length < sizeof(scan->name_lower) - 1;
+         scan->name_length++) {
+        scan->name_lower[scan->name_length] = (char)tolower((unsigned char)name[scan->name_length]);
+    }
+    scan->name_lower[scan->name_length] = '\0';
+}
+
+/* Download shard n into ~/.nex/shards/<n>.json, scanning it on the way */
+static int shard_fetch(ShardScan *scan, int shard, const char *path) {
+    char index_url[MAX_URL_LEN];
+    char url[MAX_URL_LEN];
+    char tmp_path[MAX_PATH_LEN];
+    config_get_registry_index_url(index_url, sizeof(index_url));
+    snprintf(url, sizeof(url), "%s/shards/%d", index_url, shard);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    
+    scan->out = fopen(tmp_path, "wb");
+    if (!scan->out) {
+        return -1;
+    }
+    json_stream_init(&scan->json, scan_value, scan_item, scan);
+    
+    long status = http_get_stream(url, scan_sink, scan);
+    
+    int closed = fclose(scan->out);
+    scan->out = NULL;
+    int complete = json_stream_finish(&scan->json) == 0;
+    json_stream_free(&scan->json);
+    if (status != 200 || closed != 0 || scan->failed || !complete || !scan->has_packages) {
+        remove(tmp_path);
+        return -1;
+    }
+
+#ifdef _WIN32
+    remove(path);
+#endif
+    if (rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+    }
+    return 0;
+}
+
+/*
+ * Look name up in the shard of manifest that can hold it, fetching the
+ * shard when missing or out of date. *outdated is set when the registry
+ * sent a version the manifest does not list, so the manifest is old.
+ */
+static int shard_lookup(const cJSON *manifest, const char *name,
+                        char *resolved_id, size_t resolved_size, int *outdated) {
+    int shard = (int)(shard_hash(name) % (uint32_t)manifest_count(manifest));
+    const char *version = manifest_version(manifest, shard);
+    
+    char dir[MAX_PATH_LEN];
+    char filename[32];
+    char path[MAX_PATH_LEN];
+    snprintf(filename, sizeof(filename), "%d.json", shard);
+    if (shard_path(dir, sizeof(dir), NULL) != 0 || shard_path(path, sizeof(path), filename) != 0) {
+        return -1;
+    }
+    
+    /* Offline, a copy of any version will do */
+    ShardScan scan;
+    scan_init(&scan, name, http_is_offline() ? NULL : version, resolved_id, resolved_size);
+    if (json_stream_file(path, scan_value, scan_item, &scan) == 0 && !scan.stale &&
+        scan.has_packages) {
+        return scan.matches;
+    }
+    if (http_is_offline() || make_directory_recursive(dir) != 0) {
+        return -1;
+    }
+    
+    /* Missing, damaged or superseded */
+    scan_init(&scan, name, version, resolved_id, resolved_size);
+    if (shard_fetch(&scan, shard, path) != 0) {
+        return -1;
+    }
+    *outdated = scan.stale;
+    return scan.matches;
+}
+
+/*
+ * Resolve a short name from the one index shard that can hold it. Returns
+ * the number of packages found (resolved_id holds the last), or -1 when
+ * the registry has no shards or they cannot be had right now, in which
+ * case the caller falls back to the full index.
+ */
+int shard_resolve_name(const char *name, char *resolved_id, size_t resolved_size) {
+    cJSON *manifest = manifest_load(0);
+    if (!manifest) {
+        return -1;
+    }
+    
+    int outdated = 0;
+    int matches = shard_lookup(manifest, name, resolved_id, resolved_size, &outdated);
+    
+    /*
+     * A cached manifest may predate the package, or list an older version
+     * of the shard than was just fetched; ask the registry once
+     */
+    if ((matches == 0 || outdated) && !manifest_fetched) {
+        cJSON *fresh = manifest_load(1);
+        if (fresh && matches == 0) {
+            int shard = (int)(shard_hash(name) % (uint32_t)manifest_count(fresh));
+            const char *before = manifest_count(fresh) == manifest_count(manifest) ?
+                manifest_version(manifest, shard) : NULL;
+            const char *after = manifest_version(fresh, shard);
+            if (!before || !after || strcmp(before, after) != 0) {
+                matches = shard_lookup(fresh, name, resolved_id, resolved_size, &outdated);
+            }
+        }
+        cJSON_Delete(fresh);
+    }
+    
+    cJSON_Delete(manifest);
+    return matches;
+}
@@ -1,66 +1,396 @@
 /*
  * Runtime Management - Detect, install, and manage runtimes
+ *
+ * Asking an interpreter for its version means starting it, which takes
+ * tens of milliseconds. Answers are kept in ~/.nex/cache/runtimes, one
+ * file per program, each with a fingerprint of the program (resolved
+ * path, inode, size and mtime) and of PATH, and the program is only
+ * asked again once either changes. Programs that must be asked are all
+ * started at once and read together, each within a deadline, so a hung
+ * interpreter costs RUNTIME_PROBE_TIMEOUT_MS rather than the command.
  */
 
 #include "nex.h"
+#include "cJSON.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+extern char **environ;
+#endif
+
+#define RUNTIME_CACHE_DIRNAME "runtimes"
+#define RUNTIME_PROBE_TIMEOUT_MS 3000
 
 /* Check if a command exists in PATH */
 static int command_exists(const char *cmd) {
-    char check_cmd[MAX_COMMAND_LEN];
-    
-#ifdef _WIN32
-    snprintf(check_cmd, sizeof(check_cmd), "where %s >nul 2>&1", cmd);
-#else
-    snprintf(check_cmd, sizeof(check_cmd), "which %s >/dev/null 2>&1", cmd);
-#endif
-    
-    return system(check_cmd) == 0;
+    return process_find_program(cmd, NULL, 0) == 0;
 }
 
+#ifdef _WIN32
 /* Get version of a runtime */
 static int get_runtime_version(const char *cmd, const char *version_flag, char *version, size_t size) {
     char check_cmd[MAX_COMMAND_LEN];
-    FILE *fp;
-    
-#ifdef _WIN32
     snprintf(check_cmd, sizeof(check_cmd), "%s %s 2>nul", cmd, version_flag);
-    fp = _popen(check_cmd, "r");
-#else
-    snprintf(check_cmd, sizeof(check_cmd), "%s %s 2>/dev/null", cmd, version_flag);
-    fp = popen(check_cmd, "r");
-#endif
     
+    FILE *fp = _popen(check_cmd, "r");
     if (!fp) {
         return -1;
     }
     
     if (fgets(version, (int)size, fp) == NULL) {
-#ifdef _WIN32
         _pclose(fp);
-#else
-        pclose(fp);
+        return -1;
+    }
+    _pclose(fp);
+    return 0;
+}
 #endif
+
+/* ============ Version cache ============ */
+
+/* ~/.nex/cache/runtimes, or the cached answer for program in it */
+static int probe_path(const char *program, char *buffer, size_t size) {
+    char cache_dir[MAX_PATH_LEN];
+    if (config_get_cache_dir(cache_dir, sizeof(cache_dir)) != 0) {
         return -1;
     }
-    
+    if (program) {
+        snprintf(buffer, size, "%s%c%s%c%s.json", cache_dir, PATH_SEPARATOR,
+                 RUNTIME_CACHE_DIRNAME, PATH_SEPARATOR, program);
+    } else {
+        snprintf(buffer, size, "%s%c%s", cache_dir, PATH_SEPARATOR, RUNTIME_CACHE_DIRNAME);
+    }
+    return 0;
+}
+
+static cJSON* probe_load(const char *program) {
+    char path[MAX_PATH_LEN];
+    char data[MAX_PATH_LEN * 2];
+    FILE *f = probe_path(program, path, sizeof(path)) == 0 ? fopen(path, "rb") : NULL;
+    if (!f) {
+        return NULL;
+    }
+    size_t got = fread(data, 1, sizeof(data) - 1, f);
+    data[got] = '\0';
+    fclose(f);
+    return cJSON_Parse(data);
+}
+
+/*
+ * Written beside the old answer and renamed over it. Each program has its
+ * own file, so the first probes of a new machine only ever create files.
+ */
+static void probe_store(const char *program, const char *fingerprint, const char *version) {
+    char dir[MAX_PATH_LEN];
+    char path[MAX_PATH_LEN];
+    char tmp_path[MAX_PATH_LEN];
+    if (probe_path(NULL, dir, sizeof(dir)) != 0 || probe_path(program, path, sizeof(path)) != 0 ||
+        make_directory_recursive(dir) != 0) {
+        return;
+    }
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    
+    cJSON *entry = cJSON_CreateObject();
+    if (!entry) return;
+    cJSON_AddStringToObject(entry, "fingerprint", fingerprint);
+    cJSON_AddStringToObject(entry, "version", version);
+    char *json = cJSON_PrintUnformatted(entry);
+    cJSON_Delete(entry);
+    if (!json) return;
+    
+    FILE *f = fopen(tmp_path, "wb");
+    int written = f && fputs(json, f) >= 0;
+    if (f && fclose(f) != 0) written = 0;
+    free(json);
+    
+    if (written) {
 #ifdef _WIN32
-    _pclose(fp);
-#else
-    pclose(fp);
+        remove(path);
 #endif
+        if (rename(tmp_path, path) == 0) return;
+    }
+    remove(tmp_path);
+}
+
+/* What the cached answer for a program depends on, as text */
+static int program_fingerprint(const char *path, char *buffer, size_t size) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return -1;
+    }
     
-    /* Remove trailing newline */
-    size_t len = strlen(version);
-    if (len > 0 && version[len - 1] == '\n') {
-        version[len - 1] = '\0';
+    snprintf(buffer, size, "%s|%llu|%lld|%lld|%016llx", path,
+             (unsigned long long)st.st_ino, (long long)st.st_size,
+             (long long)st.st_mtime, process_path_hash());
+    return 0;
+}
+
+/* Whether the cached answer for program still holds; copies it if so */
+static int probe_cached(const char *program, const char *fingerprint, char *version, size_t size) {
+    cJSON *entry = probe_load(program);
+    cJSON *known = cJSON_GetObjectItemCaseSensitive(entry, "fingerprint");
+    cJSON *answer = cJSON_GetObjectItemCaseSensitive(entry, "version");
+    int hit = cJSON_IsString(known) && cJSON_IsString(answer) &&
+              strcmp(known->valuestring, fingerprint) == 0;
+    if (hit) {
+        snprintf(version, size, "%s", answer->valuestring);
+    }
+    cJSON_Delete(entry);
+    return hit;
+}
+
+/* ============ Probing ============ */
+
+/* A program being asked for its version */
+typedef struct {
+    RuntimeProbe *probe;
+    char path[MAX_PATH_LEN];
+    char fingerprint[MAX_PATH_LEN + 96];
+#ifndef _WIN32
+    pid_t pid;              /* 0 once reaped */
+    int fd;                 /* Read end of its stdout; -1 once at EOF */
+    size_t length;
+#endif
+} ProbeRun;
+
+#ifndef _WIN32
+
+/* Start `<path> --version` with stdout on a pipe, stdin and stderr on /dev/null */
+static int probe_spawn(ProbeRun *run) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return -1;
     }
     
+    /* Other probes must not inherit this pipe, or its EOF waits for them */
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    
+    /* Its own process group, so a wrapper script can be killed with what it started */
+    posix_spawnattr_t attributes;
+    posix_spawnattr_init(&attributes);
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setpgroup(&attributes, 0);
+    
+    char *argv[] = { run->path, "--version", NULL };
+    int result = posix_spawn(&run->pid, run->path, &actions, &attributes, argv, environ);
+    posix_spawnattr_destroy(&attributes);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+    
+    if (result != 0) {
+        close(fds[0]);
+        run->pid = 0;
+        return -1;
+    }
+    run->fd = fds[0];
     return 0;
 }
 
+/* Take what the probe wrote; only the start of it is kept */
+static void probe_read(ProbeRun *run) {
+    char chunk[512];
+    ssize_t got = read(run->fd, chunk, sizeof(chunk));
+    if (got < 0 && errno == EINTR) {
+        return;
+    }
+    if (got <= 0) {
+        close(run->fd);
+        run->fd = -1;
+        return;
+    }
+    
+    size_t room = sizeof(run->probe->version) - 1 - run->length;
+    size_t take = (size_t)got < room ? (size_t)got : room;
+    memcpy(run->probe->version + run->length, chunk, take);
+    run->length += take;
+    run->probe->version[run->length] = '\0';
+}
+
+/* Read every probe until it exits or the deadline passes, then kill what is left */
+static void probe_collect(ProbeRun *runs, int count) {
+    struct pollfd *fds = malloc((size_t)count * sizeof(struct pollfd));
+    int *owners = malloc((size_t)count * sizeof(int));
+    double deadline = timing_now_ms() + RUNTIME_PROBE_TIMEOUT_MS;
+    
+    while (fds && owners) {
+        int nfds = 0;
+        int alive = 0;
+        for (int i = 0; i < count; i++) {
+            if (runs[i].fd >= 0) {
+                fds[nfds].fd = runs[i].fd;
+                fds[nfds].events = POLLIN;
+                fds[nfds].revents = 0;
+                owners[nfds++] = i;
+            }
+            if (runs[i].pid > 0) alive++;
+        }
+        
+        double remaining = deadline - timing_now_ms();
+        if (alive == 0 || remaining <= 0) {
+            break;
+        }
+        
+        /* With every pipe at EOF, only exits are left to notice */
+        int wait_ms = nfds > 0 ? (int)remaining + 1 : 1;
+        if (poll(fds, (nfds_t)nfds, wait_ms) > 0) {
+            for (int k = 0; k < nfds; k++) {
+                if (fds[k].revents) probe_read(&runs[owners[k]]);
+            }
+        }
+        
+        for (int i = 0; i < count; i++) {
+            int status;
+            if (runs[i].fd < 0 && runs[i].pid > 0 && waitpid(runs[i].pid, &status, WNOHANG) != 0) {
+                runs[i].pid = 0;
+            }
+        }
+    }
+    
+    for (int i = 0; i < count; i++) {
+        if (runs[i].pid > 0) {
+            int status;
+            kill(-runs[i].pid, SIGKILL);
+            waitpid(runs[i].pid, &status, 0);
+            runs[i].pid = 0;
+            runs[i].probe->timed_out = 1;
+            runs[i].probe->version[0] = '\0';
+        }
+        if (runs[i].fd >= 0) {
+            close(runs[i].fd);
+            runs[i].fd = -1;
+        }
+    }
+    free(fds);
+    free(owners);
+}
+
+#endif
+
+/*
+ * Fill in the version of each program: the first line it prints for
+ * --version (e.g. "Python 3.12.1"), or "" when it is not on PATH, prints
+ * nothing or does not answer in time. With use_cache, only programs whose
+ * fingerprint changed are run; the others are answered from the cache.
+ * Programs that are run are all started before any is waited for.
+ */
+void runtime_probe_all(RuntimeProbe *probes, int count, int use_cache) {
+    ProbeRun *runs = calloc((size_t)(count > 0 ? count : 1), sizeof(ProbeRun));
+    int pending = 0;
+    
+    for (int i = 0; i < count; i++) {
+        RuntimeProbe *probe = &probes[i];
+        probe->version[0] = '\0';
+        probe->found = 0;
+        probe->timed_out = 0;
+        
+        char path[MAX_PATH_LEN];
+        char fingerprint[MAX_PATH_LEN + 96];
+        if (process_find_program(probe->program, path, sizeof(path)) != 0 ||
+            program_fingerprint(path, fingerprint, sizeof(fingerprint)) != 0) {
+            continue;
+        }
+        probe->found = 1;
+        
+        if ((use_cache && probe_cached(probe->program, fingerprint, probe->version,
+                                       sizeof(probe->version))) || !runs) {
+            continue;
+        }
+        ProbeRun *run = &runs[pending++];
+        run->probe = probe;
+        snprintf(run->path, sizeof(run->path), "%s", path);
+        snprintf(run->fingerprint, sizeof(run->fingerprint), "%s", fingerprint);
+    }
+
+#ifdef _WIN32
+    for (int i = 0; i < pending; i++) {
+        /* Quoted, since the resolved path may contain spaces */
+        char quoted[MAX_PATH_LEN + 2];
+        snprintf(quoted, sizeof(quoted), "\"%s\"", runs[i].path);
+        if (get_runtime_version(quoted, "--version", runs[i].probe->version,
+                                sizeof(runs[i].probe->version)) != 0) {
+            runs[i].probe->version[0] = '\0';
+        }
+    }
+#else
+    for (int i = 0; i < pending; i++) {
+        runs[i].fd = -1;
+        probe_spawn(&runs[i]);
+    }
+    probe_collect(runs, pending);
+#endif
+
+    for (int i = 0; i < pending; i++) {
+        RuntimeProbe *probe = runs[i].probe;
+        probe->version[strcspn(probe->version, "\r\n")] = '\0';
+        
+        /* An empty answer is kept too, so a silent program is not asked again */
+        if (!probe->timed_out) {
+            probe_store(probe->program, runs[i].fingerprint, probe->version);
+        }
+    }
+    free(runs);
+}
+
+/* runtime_probe_all for one program; -1 unless it reported a version */
+int runtime_probe_version(const char *program, char *version, size_t size) {
+    RuntimeProbe probe;
+    memset(&probe, 0, sizeof(probe));
+    probe.program = program;
+    runtime_probe_all(&probe, 1, 1);
+    
+    snprintf(version, size, "%s", probe.version);
+    return probe.version[0] ? 0 : -1;
+}
+
+/*
+ * The interpreter a runtime runs packages with, as found on PATH: 0 and
+ * its path, or -1 for runtimes that need none and ones not installed
+ */
+int runtime_find(RuntimeType runtime, char *path, size_t size) {
+    if (!runtime_is_installed(runtime)) {
+        return -1;
+    }
+    switch (runtime) {
+        case RUNTIME_PYTHON:
+            if (process_find_program("python3", path, size) == 0) return 0;
+            return process_find_program("python", path, size);
+        
+        case RUNTIME_NODE:
+            return process_find_program("node", path, size);
+        
+        case RUNTIME_BASH:
+            return process_find_program("bash", path, size);
+        
+        case RUNTIME_POWERSHELL:
+#ifdef _WIN32
+            return process_find_program("powershell", path, size);
+#else
+            return process_find_program("pwsh", path, size);
+#endif
+
+        default:
+            return -1;
+    }
+}
+
 int runtime_is_installed(RuntimeType runtime) {
     switch (runtime) {
         case RUNTIME_PYTHON:
@@ -69,7 +399,7 @@ int runtime_is_installed(RuntimeType runtime) {
             if (command_exists("python")) {
                 /* Verify it's Python 3 */
                 char version[64];
-                if (get_runtime_version("python", "--version", version, sizeof(version)) == 0) {
+                if (runtime_probe_version("python", version, sizeof(version)) == 0) {
                     if (strstr(version, "Python 3") != NULL) {
                         return 1;
                     }
@@ -200,6 +530,7 @@ int runtime_install(RuntimeType runtime) {
     }
     
     if (result == 0) {
+        process_forget_programs();
         print_success("%s installed successfully!", runtime_to_string(runtime));
         print_info("You may need to restart your terminal for changes to take effect.");
     }
@@ -0,0 +1,229 @@
+/*
+ * JSON Stream - Incremental reader for documents shaped like the registry index
+ *
+ * Bytes are fed in arbitrary chunks (straight from an HTTP write callback
+ * or a file). The root must be an object. Each member value is handed to
+ * on_value as raw JSON text, except arrays: on_value sees them open with
+ * json == NULL and every element then goes to on_item on its own. Only
+ * the value being handed over is ever buffered, so memory is bounded by
+ * the largest element rather than the document.
+ */
+
+#include "nex.h"
+#include <ctype.h>
+
+enum {
+    JS_START,
+    JS_EXPECT_KEY,
+    JS_IN_KEY,
+    JS_EXPECT_COLON,
+    JS_EXPECT_VALUE,
+    JS_IN_ARRAY,
+    JS_AFTER_VALUE,
+    JS_DONE
+};
+
+void json_stream_init(JsonStream *stream, JsonStreamFn on_value, JsonStreamFn on_item, void *ctx) {
+    memset(stream, 0, sizeof(JsonStream));
+    stream->on_value = on_value;
+    stream->on_item = on_item;
+    stream->ctx = ctx;
+    stream->state = JS_START;
+}
+
+void json_stream_free(JsonStream *stream) {
+    free(stream->buffer);
+    stream->buffer = NULL;
+    stream->capacity = 0;
+}
+
+static int stream_append(JsonStream *stream, char c) {
+    if (stream->length + 2 > stream->capacity) {
+        size_t capacity = stream->capacity ? stream->capacity * 2 : 4096;
+        char *buffer = realloc(stream->buffer, capacity);
+        if (!buffer) return -1;
+        stream->buffer = buffer;
+        stream->capacity = capacity;
+    }
+    stream->buffer[stream->length++] = c;
+    return 0;
+}
+
+/* Hand the captured value to its callback; the buffer is NUL-terminated */
+static int stream_emit(JsonStream *stream) {
+    stream->capturing = 0;
+    stream->buffer[stream->length] = '\0';
+    
+    JsonStreamFn fn = stream->in_array ? stream->on_item : stream->on_value;
+    stream->state = stream->in_array ? JS_IN_ARRAY : JS_AFTER_VALUE;
+    if (fn && fn(stream->member, stream->buffer, stream->length, stream->ctx) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/* One byte of a value being captured */
+static int stream_capture(JsonStream *stream, char c) {
+    if (stream_append(stream, c) != 0) return -1;
+    
+    if (stream->in_string) {
+        if (stream->escaped) {
+            stream->escaped = 0;
+        } else if (c == '\\') {
+            stream->escaped = 1;
+        } else if (c == '"') {
+            stream->in_string = 0;
+            if (stream->depth == stream->capture_depth) return stream_emit(stream);
+        }
+        return 0;
+    }
+    
+    if (c == '"') {
+        stream->in_string = 1;
+    } else if (c == '{' || c == '[') {
+        stream->depth++;
+    } else if (c == '}' || c == ']') {
+        stream->depth--;
+        if (stream->depth < stream->capture_depth) return -1;
+        if (stream->depth == stream->capture_depth) return stream_emit(stream);
+    }
+    return 0;
+}
+
+static int stream_begin_value(JsonStream *stream, char c) {
+    stream->capturing = 1;
+    stream->capture_depth = stream->depth;
+    stream->length = 0;
+    stream->bare = c != '{' && c != '[' && c != '"';
+    return stream_capture(stream, c);
+}
+
+static int stream_step(JsonStream *stream, char c) {
+    if (stream->capturing) {
+        /* Numbers and literals end at the next delimiter, which is not theirs */
+        int ends_bare = c == ',' || c == ']' || c == '}' || isspace((unsigned char)c);
+        if (!stream->bare || !ends_bare) {
+            return stream_capture(stream, c);
+        }
+        if (stream_emit(stream) != 0) return -1;
+    }
+    
+    if (stream->state == JS_IN_KEY) {
+        if (stream->escaped) {
+            stream->escaped = 0;
+        } else if (c == '\\') {
+            stream->escaped = 1;
+        } else if (c == '"') {
+            stream->member[stream->member_length] = '\0';
+            stream->state = JS_EXPECT_COLON;
+            return 0;
+        }
+        if (stream->member_length + 1 < sizeof(stream->member)) {
+            stream->member[stream->member_length++] = c;
+        }
+        return 0;
+    }
+    
+    if (isspace((unsigned char)c)) return 0;
+    
+    switch (stream->state) {
+        case JS_START:
+            if (c != '{') return -1;
+            stream->depth = 1;
+            stream->state = JS_EXPECT_KEY;
+            return 0;
+        
+        case JS_EXPECT_KEY:
+            if (c == '}') {
+                stream->depth = 0;
+                stream->state = JS_DONE;
+                return 0;
+            }
+            if (c != '"') return -1;
+            stream->member_length = 0;
+            stream->state = JS_IN_KEY;
+            return 0;
+        
+        case JS_EXPECT_COLON:
+            if (c != ':') return -1;
+            stream->state = JS_EXPECT_VALUE;
+            return 0;
+        
+        case JS_EXPECT_VALUE:
+            if (c == '[') {
+                stream->depth = 2;
+                stream->in_array = 1;
+                stream->state = JS_IN_ARRAY;
+                if (stream->on_value && stream->on_value(stream->member, NULL, 0, stream->ctx) != 0) {
+                    return -1;
+                }
+                return 0;
+            }
+            stream->in_array = 0;
+            return stream_begin_value(stream, c);
+        
+        case JS_IN_ARRAY:
+            if (c == ',') return 0;
+            if (c == ']') {
+                stream->depth = 1;
+                stream->in_array = 0;
+                stream->state = JS_AFTER_VALUE;
+                return 0;
+            }
+            return stream_begin_value(stream, c);
+        
+        case JS_AFTER_VALUE:
+            if (c == ',') {
+                stream->state = JS_EXPECT_KEY;
+                return 0;
+            }
+            if (c != '}') return -1;
+            stream->depth = 0;
+            stream->state = JS_DONE;
+            return 0;
+        
+        default:
+            return -1;  /* Trailing data after the root object */
+    }
+}
+
+/* Feed the next chunk; fails on malformed input or a callback abort */
+int json_stream_feed(JsonStream *stream, const char *data, size_t size) {
+    if (stream->failed) return -1;
+    
+    for (size_t i = 0; i < size; i++) {
+        if (stream_step(stream, data[i]) != 0) {
+            stream->failed = 1;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Whether the whole document arrived */
+int json_stream_finish(JsonStream *stream) {
+    return !stream->failed && stream->state == JS_DONE ? 0 : -1;
+}
+
+/* Run a file through a stream in fixed-size chunks */
+int json_stream_file(const char *path, JsonStreamFn on_value, JsonStreamFn on_item, void *ctx) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    
+    JsonStream stream;
+    json_stream_init(&stream, on_value, on_item, ctx);
+    
+    char chunk[65536];
+    size_t got;
+    int result = 0;
+    while (result == 0 && (got = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        result = json_stream_feed(&stream, chunk, got);
+    }
+    if (result == 0 && (ferror(f) || json_stream_finish(&stream) != 0)) {
+        result = -1;
+    }
+    
+    fclose(f);
+    json_stream_free(&stream);
+    return result;
+}
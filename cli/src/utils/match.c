@@ -0,0 +1,187 @@
+/*
+ * Match - Case-insensitive substring search used by `nex search`
+ *
+ * The caller lowercases the needle once. The text may hold NULs, so a
+ * whole string pool can be searched in one pass. Candidate positions are found
+ * by testing the needle's first and last byte against 16 (SSE2) or 32
+ * (AVX2) text positions at a time, and only those are compared in full.
+ * A needle letter c matches text byte x exactly when (x | 0x20) == c, so
+ * the text is folded in place without copies. The widest implementation
+ * the CPU supports is chosen on first use.
+ */
+
+#include "nex.h"
+#include <ctype.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define MATCH_SSE2 1
+#include <emmintrin.h>
+#if defined(__GNUC__)
+#define MATCH_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+typedef const char* (*MatchFn)(const char *text, size_t len, const char *needle, size_t needle_len);
+
+static MatchFn match_fn = NULL;
+static const char *match_name = NULL;
+
+/* Bits or'ed into a text byte before comparing it with needle byte c */
+static unsigned char fold_mask(char c) {
+    return (c >= 'a' && c <= 'z') ? 0x20 : 0;
+}
+
+/* Compare n text bytes with the lowercased needle */
+static int equal_folded(const char *text, const char *needle, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (tolower((unsigned char)text[i]) != (unsigned char)needle[i]) return 0;
+    }
+    return 1;
+}
+
+static const char* match_scalar(const char *text, size_t len, const char *needle, size_t needle_len) {
+    if (needle_len > len) return NULL;
+    
+    unsigned char first = (unsigned char)needle[0];
+    unsigned char mask = fold_mask(needle[0]);
+    for (size_t i = 0; i + needle_len <= len; i++) {
+        if (((unsigned char)text[i] | mask) == first &&
+            equal_folded(text + i + 1, needle + 1, needle_len - 1)) {
+            return text + i;
+        }
+    }
+    return NULL;
+}
+
+#ifdef MATCH_SSE2
+
+static int lowest_bit(unsigned int bits) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, bits);
+    return (int)index;
+#else
+    return __builtin_ctz(bits);
+#endif
+}
+
+/* Verify each candidate position flagged in bits, lowest first */
+static const char* check_candidates(const char *block, unsigned int bits, const char *needle, size_t needle_len) {
+    while (bits) {
+        int offset = lowest_bit(bits);
+        if (equal_folded(block + offset + 1, needle + 1, needle_len - 1)) return block + offset;
+        bits &= bits - 1;
+    }
+    return NULL;
+}
+
+static const char* match_sse2(const char *text, size_t len, const char *needle, size_t needle_len) {
+    if (needle_len > len) return NULL;
+    
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needle_len - 1]);
+    const __m128i first_fold = _mm_set1_epi8((char)fold_mask(needle[0]));
+    const __m128i last_fold = _mm_set1_epi8((char)fold_mask(needle[needle_len - 1]));
+    
+    /* Both loads of a block must stay inside the text */
+    size_t i = 0;
+    for (; i + needle_len - 1 + 16 <= len; i += 16) {
+        __m128i head = _mm_loadu_si128((const __m128i *)(text + i));
+        __m128i tail = _mm_loadu_si128((const __m128i *)(text + i + needle_len - 1));
+        __m128i hits = _mm_and_si128(
+            _mm_cmpeq_epi8(_mm_or_si128(head, first_fold), first),
+            _mm_cmpeq_epi8(_mm_or_si128(tail, last_fold), last));
+        
+        unsigned int bits = (unsigned int)_mm_movemask_epi8(hits);
+        const char *found = bits ? check_candidates(text + i, bits, needle, needle_len) : NULL;
+        if (found) return found;
+    }
+    
+    return match_scalar(text + i, len - i, needle, needle_len);
+}
+
+#endif
+
+#ifdef MATCH_AVX2
+
+__attribute__((target("avx2")))
+static const char* match_avx2(const char *text, size_t len, const char *needle, size_t needle_len) {
+    if (needle_len > len) return NULL;
+    
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[needle_len - 1]);
+    const __m256i first_fold = _mm256_set1_epi8((char)fold_mask(needle[0]));
+    const __m256i last_fold = _mm256_set1_epi8((char)fold_mask(needle[needle_len - 1]));
+    
+    size_t i = 0;
+    for (; i + needle_len - 1 + 32 <= len; i += 32) {
+        __m256i head = _mm256_loadu_si256((const __m256i *)(text + i));
+        __m256i tail = _mm256_loadu_si256((const __m256i *)(text + i + needle_len - 1));
+        __m256i hits = _mm256_and_si256(
+            _mm256_cmpeq_epi8(_mm256_or_si256(head, first_fold), first),
+            _mm256_cmpeq_epi8(_mm256_or_si256(tail, last_fold), last));
+        
+        unsigned int bits = (unsigned int)_mm256_movemask_epi8(hits);
+        const char *found = bits ? check_candidates(text + i, bits, needle, needle_len) : NULL;
+        if (found) return found;
+    }
+    
+    /* Finish shorter tails 16 bytes at a time */
+    return match_sse2(text + i, len - i, needle, needle_len);
+}
+
+#endif
+
+/*
+ * Switch to a named implementation ("scalar", "sse2" or "avx2").
+ * Returns -1 if this build or CPU cannot run it.
+ */
+int match_use(const char *name) {
+    if (strcmp(name, "scalar") == 0) {
+        match_fn = match_scalar;
+        match_name = "scalar";
+        return 0;
+    }
+#ifdef MATCH_SSE2
+    if (strcmp(name, "sse2") == 0) {
+        match_fn = match_sse2;
+        match_name = "sse2";
+        return 0;
+    }
+#endif
+#ifdef MATCH_AVX2
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        match_fn = match_avx2;
+        match_name = "avx2";
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+/* Name of the implementation in use, selecting the best one if needed */
+const char* match_backend(void) {
+    if (!match_fn) {
+        if (match_use("avx2") != 0 && match_use("sse2") != 0) {
+            match_use("scalar");
+        }
+    }
+    return match_name;
+}
+
+/* First occurrence of needle_lower in text[0..len), ignoring case, or NULL */
+const char* match_find(const char *text, size_t len, const char *needle_lower, size_t needle_len) {
+    if (needle_len == 0) return text;
+    if (!match_fn) match_backend();
+    return match_fn(text, len, needle_lower, needle_len);
+}
+
+/* Whether the string text contains needle_lower, ignoring case */
+int match_contains(const char *text, const char *needle_lower, size_t needle_len) {
+    return match_find(text, strlen(text), needle_lower, needle_len) != NULL;
+}
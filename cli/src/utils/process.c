@@ -0,0 +1,426 @@
+/*
+ * Process - Run package commands without an intermediate shell
+ *
+ * A manifest command such as `python "main.py" --quiet` is split into an
+ * argv vector once, with the sh quoting rules it is written in, and run
+ * with execvp from the package directory. Commands that need a shell
+ * (pipes, redirections, variables, globs, builtins) go to /bin/sh, with
+ * the user's arguments passed as "$@" so they are never re-parsed. For
+ * the last thing nex does, the command replaces the nex process instead
+ * of running as its child. Whether a program is installed is answered by
+ * scanning PATH here, never by running `which`.
+ */
+
+#include "nex.h"
+#include <errno.h>
+
+#ifdef _WIN32
+#include <process.h>
+#define chdir _chdir
+#else
+#include <sys/wait.h>
+#endif
+
+/* Characters that mean something to sh outside quotes */
+#define SHELL_SPECIAL "|&;<>()$`*?[]{}~#\n"
+
+#define PROGRAM_MEMO_SIZE 16
+
+#ifdef _WIN32
+#define PATH_LIST_SEPARATOR ';'
+#else
+#define PATH_LIST_SEPARATOR ':'
+#endif
+
+/* Programs already looked up in this process, found or not */
+typedef struct {
+    char name[MAX_NAME_LEN];
+    char path[MAX_PATH_LEN];
+    int found;
+} ProgramLookup;
+
+static ProgramLookup program_memo[PROGRAM_MEMO_SIZE];
+static int program_memo_count = 0;
+
+/* Words sh runs itself; execvp cannot */
+static const char *shell_builtins[] = {
+    ".", ":", "alias", "cd", "eval", "exec", "export", "set", "source",
+    "ulimit", "umask", "unset", NULL
+};
+
+static int argv_push(char ***argv, int *count, int *capacity, char *word) {
+    if (*count + 1 >= *capacity) {
+        int grown = *capacity ? *capacity * 2 : 8;
+        char **resized = realloc(*argv, (size_t)grown * sizeof(char*));
+        if (!resized) return -1;
+        *argv = resized;
+        *capacity = grown;
+    }
+    (*argv)[(*count)++] = word;
+    (*argv)[*count] = NULL;
+    return 0;
+}
+
+void command_free(char **argv) {
+    if (!argv) return;
+    for (char **word = argv; *word; word++) {
+        free(*word);
+    }
+    free(argv);
+}
+
+/*
+ * Split command into words the way sh would, for the commands that need
+ * nothing else from it: blanks separate words, and quotes and backslashes
+ * are removed. Returns a NULL-terminated vector and sets *argc, or NULL
+ * when the command needs a real shell (or is empty).
+ */
+char** command_split(const char *command, int *argc) {
+    char **argv = NULL;
+    int count = 0;
+    int capacity = 0;
+    size_t length = strlen(command);
+    char *word = malloc(length + 1);
+    size_t used = 0;
+    int in_word = 0;
+    int shell = 0;
+    
+    if (!word) return NULL;
+    
+    for (const char *p = command; *p && !shell; p++) {
+        if (*p == ' ' || *p == '\t') {
+            if (in_word) {
+                word[used] = '\0';
+                char *copy = strdup(word);
+                if (!copy || argv_push(&argv, &count, &capacity, copy) != 0) {
+                    free(copy);
+                    shell = 1;
+                }
+                used = 0;
+                in_word = 0;
+            }
+            continue;
+        }
+        
+        in_word = 1;
+        if (*p == '\'') {
+            const char *end = strchr(p + 1, '\'');
+            if (!end) {
+                shell = 1;
+                break;
+            }
+            memcpy(word + used, p + 1, (size_t)(end - p - 1));
+            used += (size_t)(end - p - 1);
+            p = end;
+        } else if (*p == '"') {
+            for (p++; *p && *p != '"'; p++) {
+                if (*p == '$' || *p == '`') {
+                    shell = 1;
+                    break;
+                }
+                if (*p == '\\' && p[1] && strchr("\"\\$`", p[1])) {
+                    p++;
+                }
+                word[used++] = *p;
+            }
+            if (*p != '"') {
+                /* Unterminated, or needs expansion; p may be at the NUL */
+                shell = 1;
+                break;
+            }
+        } else if (*p == '\\') {
+            if (!p[1] || p[1] == '\n') {
+                shell = 1;
+                break;
+            }
+            word[used++] = *++p;
+        } else if (strchr(SHELL_SPECIAL, *p) || (*p == '=' && count == 0)) {
+            /* An '=' in the first word is an assignment: VAR=value cmd */
+            shell = 1;
+        } else {
+            word[used++] = *p;
+        }
+    }
+    
+    if (!shell && in_word) {
+        word[used] = '\0';
+        char *copy = strdup(word);
+        if (!copy || argv_push(&argv, &count, &capacity, copy) != 0) {
+            free(copy);
+            shell = 1;
+        }
+    }
+    free(word);
+    
+    for (int i = 0; !shell && count > 0 && shell_builtins[i]; i++) {
+        if (strcmp(argv[0], shell_builtins[i]) == 0) shell = 1;
+    }
+    
+    if (shell || count == 0) {
+        command_free(argv);
+        return NULL;
+    }
+    
+    *argc = count;
+    return argv;
+}
+
+/* ============ PATH lookup ============ */
+
+static int is_program(const char *path) {
+#ifdef _WIN32
+    DWORD attrs = GetFileAttributesA(path);
+    return attrs != INVALID_FILE_ATTRIBUTES && !(attrs & FILE_ATTRIBUTE_DIRECTORY);
+#else
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0;
+#endif
+}
+
+/* Whether dir/name (plus one of PATHEXT's extensions on Windows) is a program */
+static int program_in(const char *dir, size_t dir_length, const char *name,
+                      char *path, size_t size) {
+    if (dir_length == 0) {
+        dir = ".";     /* An empty PATH entry means the current directory */
+        dir_length = 1;
+    }
+    snprintf(path, size, "%.*s%c%s", (int)dir_length, dir, PATH_SEPARATOR, name);
+    if (is_program(path)) return 1;
+
+#ifdef _WIN32
+    const char *extensions = getenv("PATHEXT");
+    if (!extensions || !extensions[0]) extensions = ".COM;.EXE;.BAT;.CMD";
+    size_t base = strlen(path);
+    for (const char *ext = extensions; *ext; ) {
+        const char *end = strchr(ext, ';');
+        size_t ext_length = end ? (size_t)(end - ext) : strlen(ext);
+        if (ext_length > 0 && base + ext_length < size) {
+            memcpy(path + base, ext, ext_length);
+            path[base + ext_length] = '\0';
+            if (is_program(path)) return 1;
+        }
+        ext += ext_length;
+        if (*ext) ext++;
+    }
+#endif
+    return 0;
+}
+
+/*
+ * Find the program a command named name would run, as execvp does: a
+ * name with a directory part is taken as a path, anything else is looked
+ * for along PATH. Answers are kept for the rest of the process. Returns 0
+ * and fills path (when given) if found, -1 if not.
+ */
+int process_find_program(const char *name, char *path, size_t size) {
+    for (int i = 0; i < program_memo_count; i++) {
+        if (strcmp(program_memo[i].name, name) == 0) {
+            if (program_memo[i].found && path) {
+                snprintf(path, size, "%s", program_memo[i].path);
+            }
+            return program_memo[i].found ? 0 : -1;
+        }
+    }
+    
+    char found_path[MAX_PATH_LEN] = {0};
+    int found = 0;
+    if (strchr(name, '/') || strchr(name, PATH_SEPARATOR)) {
+        snprintf(found_path, sizeof(found_path), "%s", name);
+        found = is_program(found_path);
+    } else {
+        const char *dirs = getenv("PATH");
+        if (!dirs) dirs = "/usr/bin:/bin";
+        for (const char *dir = dirs; !found; ) {
+            const char *end = strchr(dir, PATH_LIST_SEPARATOR);
+            size_t length = end ? (size_t)(end - dir) : strlen(dir);
+            found = program_in(dir, length, name, found_path, sizeof(found_path));
+            if (!end) break;
+            dir = end + 1;
+        }
+    }
+    
+    if (program_memo_count < PROGRAM_MEMO_SIZE && strlen(name) < MAX_NAME_LEN) {
+        ProgramLookup *lookup = &program_memo[program_memo_count++];
+        snprintf(lookup->name, sizeof(lookup->name), "%s", name);
+        snprintf(lookup->path, sizeof(lookup->path), "%s", found_path);
+        lookup->found = found;
+    }
+    if (found && path) {
+        snprintf(path, size, "%s", found_path);
+    }
+    return found ? 0 : -1;
+}
+
+/* FNV-1a of PATH: the same name may resolve elsewhere once it changes */
+unsigned long long process_path_hash(void) {
+    const char *env = getenv("PATH");
+    unsigned long long hash = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *)(env ? env : ""); *p; p++) {
+        hash = (hash ^ *p) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/* Drop remembered lookups, after installing something that may be on PATH now */
+void process_forget_programs(void) {
+    program_memo_count = 0;
+}
+
+/* ============ Running ============ */
+
+#ifdef _WIN32
+
+/* Quote one argument for the MSVC runtime's command-line parser */
+static void append_quoted(char *line, size_t size, const char *arg) {
+    size_t used = strlen(line);
+    if (arg[0] && !strpbrk(arg, " \t\"")) {
+        snprintf(line + used, size - used, "%s", arg);
+        return;
+    }
+    
+    if (used + 1 < size) line[used++] = '"';
+    for (const char *p = arg; *p && used + 3 < size; p++) {
+        if (*p == '"') line[used++] = '\\';
+        line[used++] = *p;
+    }
+    if (used + 1 < size) line[used++] = '"';
+    line[used] = '\0';
+}
+
+static int run_line(const char *dir, const char *first, int quote_first, int argc, char *argv[]) {
+    size_t size = strlen(first) + 3;
+    for (int i = 0; i < argc; i++) {
+        size += strlen(argv[i]) * 2 + 3;
+    }
+    char *line = malloc(size);
+    if (!line) return -1;
+    
+    line[0] = '\0';
+    if (quote_first) {
+        append_quoted(line, size, first);
+    } else {
+        snprintf(line, size, "%s", first);
+    }
+    for (int i = 0; i < argc; i++) {
+        strcat(line, " ");
+        append_quoted(line, size, argv[i]);
+    }
+    
+    int result = -1;
+    if (chdir(dir) != 0) {
+        print_error("Cannot enter %s", dir);
+    } else {
+        result = run_command(line);
+    }
+    free(line);
+    return result;
+}
+
+int process_run(const char *dir, char *const argv[], int replace) {
+    (void)replace;
+    int argc = 0;
+    while (argv[argc + 1]) argc++;
+    return run_line(dir, argv[0], 1, argc, (char **)argv + 1);
+}
+
+int process_run_shell(const char *dir, const char *command, int argc, char *argv[], int replace) {
+    (void)replace;
+    return run_line(dir, command, 0, argc, argv);
+}
+
+#else
+
+/* Exit status of a finished child, with signals reported as 128+n like sh */
+static int wait_status(pid_t pid) {
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return -1;
+}
+
+static int process_start(const char *dir, char *const argv[], int replace, const char *label) {
+    fflush(stdout);
+    fflush(stderr);
+    
+    if (replace && !timing_enabled()) {
+        if (chdir(dir) != 0) {
+            print_error("Cannot enter %s: %s", dir, strerror(errno));
+            return -1;
+        }
+        execvp(argv[0], argv);
+        int error = errno;
+        print_error("Cannot run %s: %s", argv[0], strerror(error));
+        return error == ENOENT ? 127 : 126;
+    }
+    
+    double started = timing_now_ms();
+    pid_t pid = fork();
+    if (pid < 0) {
+        print_error("Cannot start %s: %s", argv[0], strerror(errno));
+        return -1;
+    }
+    if (pid == 0) {
+        if (chdir(dir) != 0) {
+            print_error("Cannot enter %s: %s", dir, strerror(errno));
+            _exit(126);
+        }
+        execvp(argv[0], argv);
+        int error = errno;
+        print_error("Cannot run %s: %s", argv[0], strerror(error));
+        _exit(error == ENOENT ? 127 : 126);
+    }
+    
+    int result = wait_status(pid);
+    
+    if (timing_enabled()) {
+        TimingPhases phases;
+        memset(&phases, 0, sizeof(phases));
+        phases.total_ms = timing_now_ms() - started;
+        timing_add("command", label, &phases);
+    }
+    return result;
+}
+
+/*
+ * Run argv (argv[0] looked up in PATH) from dir and return its exit
+ * status. With replace, nex itself becomes the command and this only
+ * returns on failure; --timings still waits so the run can be reported.
+ */
+int process_run(const char *dir, char *const argv[], int replace) {
+    return process_start(dir, argv, replace, argv[0]);
+}
+
+/*
+ * Run command through /bin/sh from dir, with argv as its positional
+ * parameters so they reach the command exactly as given
+ */
+int process_run_shell(const char *dir, const char *command, int argc, char *argv[], int replace) {
+    size_t length = strlen(command) + sizeof(" \"$@\"");
+    char *script = malloc(length);
+    char **shell_argv = malloc(((size_t)argc + 5) * sizeof(char*));
+    if (!script || !shell_argv) {
+        free(script);
+        free(shell_argv);
+        return -1;
+    }
+    snprintf(script, length, "%s \"$@\"", command);
+    
+    shell_argv[0] = "/bin/sh";
+    shell_argv[1] = "-c";
+    shell_argv[2] = script;
+    shell_argv[3] = "sh";
+    for (int i = 0; i < argc; i++) {
+        shell_argv[4 + i] = argv[i];
+    }
+    shell_argv[4 + argc] = NULL;
+    
+    int result = process_start(dir, shell_argv, replace, command);
+    free(shell_argv);
+    free(script);
+    return result;
+}
+
+#endif
@@ -0,0 +1,162 @@
+/*
+ * Terminal - Raw keyboard input and screen size for interactive commands
+ *
+ * In raw mode keys arrive one at a time without echo, and Ctrl-C is a
+ * key rather than a signal. When stdin is not a terminal (keys piped in
+ * by a script), bytes are read as they come and mapped the same way.
+ */
+
+#include "nex.h"
+#include <errno.h>
+
+#ifdef _WIN32
+#include <conio.h>
+#include <io.h>
+#else
+#include <termios.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#endif
+
+#define ESCAPE_WAIT_MS 25   /* Keys like arrows send ESC and the rest at once */
+
+static int raw_active = 0;
+
+#ifndef _WIN32
+static struct termios saved_mode;
+#endif
+
+int terminal_is_tty(FILE *stream) {
+#ifdef _WIN32
+    return _isatty(_fileno(stream));
+#else
+    return isatty(fileno(stream));
+#endif
+}
+
+/*
+ * Switch stdin to raw mode until terminal_raw_end (also run at exit).
+ * Returns -1 if stdin is not a terminal; keys are then read as bytes.
+ */
+int terminal_raw_begin(void) {
+    static int registered = 0;
+    if (raw_active) return 0;
+    if (!terminal_is_tty(stdin)) return -1;
+
+#ifndef _WIN32
+    if (tcgetattr(STDIN_FILENO, &saved_mode) != 0) return -1;
+    
+    struct termios raw = saved_mode;
+    raw.c_lflag &= ~(tcflag_t)(ICANON | ECHO | ISIG | IEXTEN);
+    raw.c_iflag &= ~(tcflag_t)(IXON | ICRNL);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) != 0) return -1;
+#endif
+    /* _getch() already reads unbuffered and without echo on Windows */
+    
+    raw_active = 1;
+    if (!registered) {
+        atexit(terminal_raw_end);
+        registered = 1;
+    }
+    return 0;
+}
+
+void terminal_raw_end(void) {
+    if (!raw_active) return;
+#ifndef _WIN32
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved_mode);
+#endif
+    raw_active = 0;
+}
+
+/* Visible rows and columns of the terminal on stdout */
+int terminal_size(int *rows, int *cols) {
+#ifdef _WIN32
+    CONSOLE_SCREEN_BUFFER_INFO info;
+    if (!GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &info)) return -1;
+    *rows = info.srWindow.Bottom - info.srWindow.Top + 1;
+    *cols = info.srWindow.Right - info.srWindow.Left + 1;
+#else
+    struct winsize size;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) != 0 || size.ws_row == 0) return -1;
+    *rows = size.ws_row;
+    *cols = size.ws_col;
+#endif
+    return 0;
+}
+
+/* Next input byte, or -1 at end of input */
+static int read_byte(void) {
+#ifdef _WIN32
+    if (raw_active) return _getch();
+    return getchar();
+#else
+    unsigned char c;
+    ssize_t n;
+    do {
+        n = read(STDIN_FILENO, &c, 1);
+    } while (n < 0 && errno == EINTR);
+    return n == 1 ? c : -1;
+#endif
+}
+
+#ifndef _WIN32
+/* After ESC: skip the rest of a key sequence, if one follows at once */
+static int skip_sequence(void) {
+    struct pollfd input = { STDIN_FILENO, POLLIN, 0 };
+    if (poll(&input, 1, ESCAPE_WAIT_MS) <= 0) return 0;
+    
+    int c = read_byte();
+    if (c == '[' || c == 'O') {
+        /* CSI parameters end with a byte from '@' to '~' */
+        do {
+            c = read_byte();
+        } while (c >= 0 && (c < 0x40 || c > 0x7e));
+    }
+    return 1;
+}
+#endif
+
+/*
+ * Wait for a key. Returns a character (bytes of a UTF-8 character come
+ * one at a time), a TERM_KEY_* code, or TERM_KEY_NONE for keys with no
+ * meaning here such as arrows.
+ */
+int terminal_read_key(void) {
+    int c = read_byte();
+    
+    switch (c) {
+        case -1:
+        case 4:         /* Ctrl-D */
+            return TERM_KEY_EOF;
+        case '\r':
+        case '\n':
+            return TERM_KEY_ENTER;
+        case 8:
+        case 127:
+            return TERM_KEY_BACKSPACE;
+        case 3:
+            return TERM_KEY_CANCEL;
+        case 21:        /* Ctrl-U */
+            return TERM_KEY_CLEAR;
+        case 23:        /* Ctrl-W */
+            return TERM_KEY_DELETE_WORD;
+#ifdef _WIN32
+        case 0:
+        case 0xe0:      /* Arrows and function keys: a prefix, then the key */
+            if (raw_active) _getch();
+            return TERM_KEY_NONE;
+#endif
+        case 27:
+#ifndef _WIN32
+            if (raw_active && skip_sequence()) {
+                return TERM_KEY_NONE;
+            }
+#endif
+            return TERM_KEY_ESCAPE;
+        default:
+            return c < 32 ? TERM_KEY_NONE : c;
+    }
+}
@@ -0,0 +1,136 @@
+/*
+ * Timing - Per-phase timing breakdown for --timings / NEX_TIMINGS=1
+ */
+
+#include "nex.h"
+#include <time.h>
+
+#define TIMING_MAX_ROWS 256
+#define TIMING_LABEL_LEN 44
+
+typedef struct {
+    char kind[12];
+    char label[TIMING_LABEL_LEN + 1];
+    TimingPhases phases;
+} TimingRow;
+
+static int timing_on = 0;
+static double timing_started = 0;
+static TimingRow rows[TIMING_MAX_ROWS];
+static int row_count = 0;
+static int rows_dropped = 0;
+
+double timing_now_ms(void) {
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart * 1000.0 / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+#endif
+}
+
+void timing_init(int enabled) {
+    const char *env = getenv("NEX_TIMINGS");
+    if (env && env[0] && strcmp(env, "0") != 0) {
+        enabled = 1;
+    }
+    
+    timing_on = enabled;
+    timing_started = timing_now_ms();
+}
+
+int timing_enabled(void) {
+    return timing_on;
+}
+
+/* Keep the end of long labels: URL paths and commands differ at the tail */
+static void shorten(const char *text, char *out, size_t size) {
+    size_t len = strlen(text);
+    if (len < size) {
+        memcpy(out, text, len + 1);
+        return;
+    }
+    
+    const char *tail = text + len - (size - 4);
+    snprintf(out, size, "...%s", tail);
+}
+
+void timing_add(const char *kind, const char *label, const TimingPhases *phases) {
+    if (!timing_on) return;
+    
+    if (row_count >= TIMING_MAX_ROWS) {
+        rows_dropped++;
+        return;
+    }
+    
+    TimingRow *row = &rows[row_count++];
+    snprintf(row->kind, sizeof(row->kind), "%s", kind);
+    shorten(label ? label : "", row->label, sizeof(row->label));
+    row->phases = *phases;
+}
+
+static void print_ms(double ms) {
+    if (ms > 0) {
+        fprintf(stderr, " %9.1f", ms);
+    } else {
+        fprintf(stderr, " %9s", "-");
+    }
+}
+
+void timing_print(void) {
+    if (!timing_on) return;
+    
+    TimingPhases sum;
+    memset(&sum, 0, sizeof(sum));
+    
+    fprintf(stderr, "\n\033[1mTimings (ms)\033[0m\n");
+    fprintf(stderr, "  %-8s %-*s %9s %9s %9s %9s %9s %9s %10s\n",
+        "phase", TIMING_LABEL_LEN, "target",
+        "dns", "connect", "tls", "ttfb", "transfer", "total", "bytes");
+    
+    for (int i = 0; i < row_count; i++) {
+        const TimingPhases *p = &rows[i].phases;
+        fprintf(stderr, "  %-8s %-*s", rows[i].kind, TIMING_LABEL_LEN, rows[i].label);
+        print_ms(p->dns_ms);
+        print_ms(p->connect_ms);
+        print_ms(p->tls_ms);
+        print_ms(p->ttfb_ms);
+        print_ms(p->transfer_ms);
+        print_ms(p->total_ms);
+        if (p->bytes > 0) {
+            fprintf(stderr, " %10lld\n", p->bytes);
+        } else {
+            fprintf(stderr, " %10s\n", "-");
+        }
+        
+        sum.dns_ms += p->dns_ms;
+        sum.connect_ms += p->connect_ms;
+        sum.tls_ms += p->tls_ms;
+        sum.ttfb_ms += p->ttfb_ms;
+        sum.transfer_ms += p->transfer_ms;
+        sum.bytes += p->bytes;
+    }
+    
+    if (rows_dropped > 0) {
+        fprintf(stderr, "  (%d more not shown)\n", rows_dropped);
+    }
+    
+    /* Phases of parallel requests overlap, so their sum can exceed wall time */
+    fprintf(stderr, "  %-8s %-*s", "sum", TIMING_LABEL_LEN, "");
+    print_ms(sum.dns_ms);
+    print_ms(sum.connect_ms);
+    print_ms(sum.tls_ms);
+    print_ms(sum.ttfb_ms);
+    print_ms(sum.transfer_ms);
+    print_ms(0);
+    fprintf(stderr, " %10lld\n", sum.bytes);
+    
+    fprintf(stderr, "  %-8s %-*s", "wall", TIMING_LABEL_LEN, "");
+    for (int i = 0; i < 5; i++) print_ms(0);
+    print_ms(timing_now_ms() - timing_started);
+    fprintf(stderr, "\n");
+}
@@ -7,6 +7,10 @@
 #include <ctype.h>
 #include <errno.h>
 
+#ifdef __APPLE__
+#include <mach-o/dyld.h>
+#endif
+
 /* ANSI color codes shared definition */
 static int colors_enabled = 0;
 
@@ -152,5 +156,56 @@ const char* runtime_to_string(RuntimeType runtime) {
 }
 
 int run_command(const char *command) {
-    return system(command);
+    if (!timing_enabled()) {
+        return system(command);
+    }
+    
+    double started = timing_now_ms();
+    int result = system(command);
+    
+    TimingPhases phases;
+    memset(&phases, 0, sizeof(phases));
+    phases.total_ms = timing_now_ms() - started;
+    timing_add("command", command, &phases);
+    
+    return result;
+}
+
+/* Get the path to the current executable */
+int get_executable_path(char *path, size_t size) {
+#ifdef _WIN32
+    DWORD len = GetModuleFileNameA(NULL, path, (DWORD)size);
+    return (len > 0 && len < size) ? 0 : -1;
+#elif __APPLE__
+    uint32_t bufsize = (uint32_t)size;
+    return _NSGetExecutablePath(path, &bufsize) == 0 ? 0 : -1;
+#else
+    ssize_t len = readlink("/proc/self/exe", path, size - 1);
+    if (len > 0) {
+        path[len] = '\0';
+        return 0;
+    }
+    return -1;
+#endif
+}
+
+/* Encode a string for a URL query (form encoding, spaces become +) */
+void url_encode(const char *src, char *dest, size_t dest_size) {
+    static const char hex[] = "0123456789ABCDEF";
+    size_t i = 0, j = 0;
+    
+    while (src[i] && j < dest_size - 4) {
+        unsigned char c = src[i];
+        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+            dest[j++] = c;
+        } else if (c == ' ') {
+            dest[j++] = '+';
+        } else {
+            dest[j++] = '%';
+            dest[j++] = hex[c >> 4];
+            dest[j++] = hex[c & 0x0F];
+        }
+        i++;
+    }
+    dest[j] = '\0';
 }
@@ -0,0 +1,69 @@
+/*
+ * Tests for command_split (src/utils/process.c)
+ *
+ * Each command is copied into a buffer of exactly its size, so a read
+ * past the terminating NUL shows up under AddressSanitizer, which the
+ * build enables for this test where the compiler has it.
+ *
+ *   ctest --test-dir build
+ */
+
+#include "nex.h"
+
+static int failures = 0;
+
+/* Split command and compare with the expected words (NULL: needs a shell) */
+static void check(const char *command, const char **expected) {
+    size_t size = strlen(command) + 1;
+    char *copy = malloc(size);
+    if (!copy) {
+        failures++;
+        return;
+    }
+    memcpy(copy, command, size);
+    
+    int argc = 0;
+    char **argv = command_split(copy, &argc);
+    int ok;
+    if (!expected) {
+        ok = argv == NULL;
+    } else {
+        int count = 0;
+        while (expected[count]) count++;
+        ok = argv != NULL && argc == count;
+        for (int i = 0; ok && i < count; i++) {
+            ok = strcmp(argv[i], expected[i]) == 0;
+        }
+    }
+    
+    if (!ok) {
+        fprintf(stderr, "FAIL: command_split(%s)\n", command);
+        failures++;
+    }
+    command_free(argv);
+    free(copy);
+}
+
+int main(void) {
+    const char *plain[] = { "python", "main.py", "--flag", NULL };
+    const char *quoted[] = { "echo", "a b", "c d", "e\"f", NULL };
+    const char *escaped[] = { "echo", "a b", NULL };
+    
+    check("python main.py --flag", plain);
+    check("echo \"a b\" 'c d' e\\\"f", quoted);
+    check("echo a\\ b", escaped);
+    
+    /* Left to the shell, without reading past the end */
+    check("echo \"abc", NULL);
+    check("echo \"", NULL);
+    check("echo 'abc", NULL);
+    check("echo abc\\", NULL);
+    check("echo \"$HOME", NULL);
+    
+    if (failures) {
+        fprintf(stderr, "%d command_split check(s) failed\n", failures);
+        return 1;
+    }
+    printf("command_split: all checks passed\n");
+    return 0;
+}